@@ -0,0 +1,175 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_abbrev.c
+ *	  Abbreviated keys of the cached B+-tree pages.
+ *
+ * The bounds are found with a binary search without branches on the keys:
+ * each step moves the base of the range with a conditional move, so the
+ * probes of a search do not wait on each other to be predicted, and the
+ * loop runs the same number of steps for every key.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/access/common/soe_abbrev.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "access/soe_abbrev.h"
+#include "utils/soe_keycmp.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Key attribute of item offnum of page */
+#define abbrev_datum(page, offnum) \
+	index_getattr_s((IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum)))
+
+/*
+ * Builds the abbreviated keys of the items first to last of page. The first
+ * of them is minus infinity, the first data item of an internal page, if
+ * minusInfinity is set.
+ */
+PageAbbrevKeys *
+abbrev_build(Form_pg_attribute att, Page page, OffsetNumber first,
+			 OffsetNumber last, bool minusInfinity)
+{
+	PageAbbrevKeys *abbrevs;
+	const char *prefix = NULL;
+	const char *bytes;
+	int			nkeys = last >= first ? last - first + 1 : 0;
+	int			start = minusInfinity ? 1 : 0;
+	int			skip = 0;
+	int			minlen = 0;
+	int			len;
+	int			i;
+
+	/*
+	 * The prefix is the common prefix of all the keys, and the width is
+	 * bounded by the bytes that the shortest key has after it.
+	 */
+	if (start < nkeys)
+	{
+		prefix = keycmp_datum_bytes(att, abbrev_datum(page, first + start), &minlen);
+		skip = minlen;
+	}
+	for (i = start + 1; prefix != NULL && i < nkeys; i++)
+	{
+		bytes = keycmp_datum_bytes(att, abbrev_datum(page, first + i), &len);
+		minlen = Min_s(minlen, len);
+		skip = Min_s(skip, len);
+		while (skip > 0 && memcmp(prefix, bytes, skip) != 0)
+		{
+			skip--;
+		}
+	}
+
+	abbrevs = (PageAbbrevKeys *) malloc(offsetof(PageAbbrevKeys, keys) + nkeys * sizeof(uint64) + skip);
+	abbrevs->first = first;
+	abbrevs->nkeys = nkeys;
+	abbrevs->minusInfinity = minusInfinity;
+	abbrevs->prefix = (char *) &abbrevs->keys[nkeys];
+	abbrevs->skip = skip;
+	abbrevs->width = prefix != NULL ? Min_s(minlen - skip, 8) : 8;
+	abbrevs->usable = abbrevs->width > 0;
+	memcpy(abbrevs->prefix, prefix, skip);
+
+	for (i = 0; i < nkeys && abbrevs->usable; i++)
+	{
+		if (i < start)
+		{
+			abbrevs->keys[i] = 0;
+			continue;
+		}
+		abbrevs->keys[i] = keycmp_abbrev_datum(att, abbrev_datum(page, first + i),
+											   skip, abbrevs->width);
+	}
+
+	return abbrevs;
+}
+
+/* Position of the first of the n keys that is not less than key. */
+static inline int
+abbrev_lower_bound(const uint64 *keys, int n, uint64 key)
+{
+	const uint64 *base = keys;
+	int			half;
+
+	if (n == 0)
+		return 0;
+
+	while (n > 1)
+	{
+		half = n / 2;
+		base = base[half] < key ? base + half : base;
+		n -= half;
+	}
+
+	return (base - keys) + (*base < key);
+}
+
+/* Position of the first of the n keys that is greater than key. */
+static inline int
+abbrev_upper_bound(const uint64 *keys, int n, uint64 key)
+{
+	const uint64 *base = keys;
+	int			half;
+
+	if (n == 0)
+		return 0;
+
+	while (n > 1)
+	{
+		half = n / 2;
+		base = base[half] <= key ? base + half : base;
+		n -= half;
+	}
+
+	return (base - keys) + (*base <= key);
+}
+
+/*
+ * Narrows the items low to high of a page, which are sorted, to the ones
+ * with the abbreviated key of scankey. The items before the new low are
+ * less than the scan key and the ones after the new high are greater, so
+ * high is left below low when no item has the same abbreviated key.
+ * Nothing changes if abbrevs was not built for these items.
+ */
+void
+abbrev_narrow(PageAbbrevKeys * abbrevs, Form_pg_attribute att, ScanKey scankey,
+			  OffsetNumber *low, OffsetNumber *high)
+{
+	uint64		key;
+	int			result;
+	int			lower;
+	int			upper;
+
+	if (!abbrevs->usable || abbrevs->first != *low
+		|| abbrevs->nkeys != *high - *low + 1)
+	{
+		return;
+	}
+
+	result = keycmp_abbrev_key(att, scankey->sk_argument, scankey->datumSize,
+							   abbrevs->prefix, abbrevs->skip, abbrevs->width,
+							   &key);
+	if (result < 0)
+	{
+		/* Only minus infinity is less than the scan key. */
+		lower = upper = abbrevs->minusInfinity ? 1 : 0;
+	}
+	else if (result > 0)
+	{
+		lower = upper = abbrevs->nkeys;
+	}
+	else
+	{
+		lower = abbrev_lower_bound(abbrevs->keys, abbrevs->nkeys, key);
+		upper = abbrev_upper_bound(abbrevs->keys + lower, abbrevs->nkeys - lower, key) + lower;
+	}
+
+	*low = abbrevs->first + lower;
+	*high = abbrevs->first + upper - 1;
+}
@@ -30,6 +30,7 @@
 #include "access/soe_hash.h"
 #include "storage/soe_bufmgr.h"
 #include "logger/logger.h"
+#include "utils/soe_counters.h"
 #include "access/soe_hash.h"
 
 
@@ -894,6 +895,7 @@ _hash_splitbucket_s(VRelation rel,
 	int			i;
 	uint16		nitups = 0;
 
+	COUNTERS_INC(bucketSplits);
 	bucket_obuf = obuf;
 	/* selog(DEBUG1, "Going to split"); */
 	/* selog(DEBUG1, "going to get old page %d", obuf); */
@@ -27,7 +27,15 @@ heap_insert_s(VRelation rel, Item tup, Size len, HeapTuple tuple)
 		selog(ERROR, "An invalid block number was requested");
 	}
 
+	/*
+	 * The free space block may have never been written, in which case the
+	 * ORAM returns a zeroed page that has to be initialized before use.
+	 */
 	page = BufferGetPage_s(rel, buffer);
+	if (PageIsNew_s(page))
+	{
+		rel->pageinit(page, buffer, BLCKSZ);
+	}
 	/* selog(DEBUG1, " Going to align size %d ", len); */
 	alignedSize = MAXALIGN_s(len);	/* be conservative */
 	/* selog(DEBUG1, "Size %d aligned is %d", len, alignedSize); */
@@ -59,7 +67,15 @@ heap_insert_s(VRelation rel, Item tup, Size len, HeapTuple tuple)
 
 		ReleaseBuffer_s(rel, buffer);
 		buffer = ReadBuffer_s(rel, FreeSpaceBlock_s(rel));
+		if (buffer == DUMMY_BLOCK)
+		{
+			selog(ERROR, "An invalid block number was requested");
+		}
 		page = BufferGetPage_s(rel, buffer);
+		if (PageIsNew_s(page))
+		{
+			rel->pageinit(page, buffer, BLCKSZ);
+		}
 	}
 
 	offnum = PageAddItem_s(page, tup, len, InvalidOffsetNumber, false, true);
@@ -147,19 +163,54 @@ heap_insert_block_s(VRelation rel, char *rpage, int blkno)
       
 	MarkBufferDirty_s(rel, buffer);
 	ReleaseBuffer_s(rel, buffer);
+	LoadedBlock_s(rel, blkno);
 	//UpdateFSM(rel);
 	//BufferFull_s(rel, buffer);
 
 }
 
+
+/*
+ * Loads nblocks contiguous heap pages starting at block blkno. The block
+ * number in the special space of every page is checked before anything is
+ * written, so a malformed run is rejected as a whole. The pages are then
+ * written in a single pass without reading the blocks they replace.
+ */
+void
+heap_insert_blocks_s(VRelation rel, char *rpages, int nblocks, int blkno)
+{
+	int			offset;
+	int		   *r_blkno;
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		r_blkno = (int *) PageGetSpecialPointer_s(rpages + offset * BLCKSZ);
+
+		if (*r_blkno != blkno + offset)
+		{
+			selog(ERROR, "Page block %d number does not match offset %d", *r_blkno, blkno + offset);
+			return;
+		}
+	}
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		WriteBlock_s(rel, blkno + offset, rpages + offset * BLCKSZ);
+		LoadedBlock_s(rel, blkno + offset);
+	}
+}
+
 /**
 * The logic for this function was taken from the functions index_fetch_heap in
 * indexam.c and from heap_hot_search_buffer in heapam.c.
 * The major difference is the lack of support for locks and Hot-chains.
-* So its just a simple tuple access.
+* So its just a simple tuple access. The tuple data is copied from the
+* pinned page straight to data, which can be the output buffer of the ECALL.
+* Returns false, with a NULL t_data, if the tuple is longer than dataLen.
 **/
-void
-heap_gettuple_s(VRelation rel, ItemPointer tid, HeapTuple tuple)
+bool
+heap_gettuple_s(VRelation rel, ItemPointer tid, HeapTuple tuple, char *data,
+				Size dataLen)
 {
 
 	BlockNumber blkno;
@@ -191,9 +242,17 @@ heap_gettuple_s(VRelation rel, ItemPointer tid, HeapTuple tuple)
 	}
 	tuple->t_len = ItemIdGetLength_s(lp);
 	tuple->t_tableOid = RelationGetRelid_s(rel);
-	tuple->t_data = (HeapTupleHeader) malloc(tuple->t_len);
-	memcpy(tuple->t_data, PageGetItem_s(page, lp), tuple->t_len);
 	ItemPointerSetOffsetNumber_s(&tuple->t_self, offnum);
 
+	if (tuple->t_len > dataLen)
+	{
+		tuple->t_data = NULL;
+		ReleaseBuffer_s(rel, buffer);
+		return false;
+	}
+	tuple->t_data = (HeapTupleHeader) data;
+	memcpy(data, PageGetItem_s(page, lp), tuple->t_len);
+
 	ReleaseBuffer_s(rel, buffer);
+	return true;
 }
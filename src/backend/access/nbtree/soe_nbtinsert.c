@@ -16,6 +16,7 @@
 
 #include "access/soe_nbtree.h"
 #include "logger/logger.h"
+#include "utils/soe_counters.h"
 
 
 
@@ -148,13 +149,7 @@ _bt_doinsert_s(VRelation rel, IndexTuple itup, char *datum, int size, VRelation
 
 	_bt_insertonpg_s(rel, buf, InvalidBuffer, stack, itup, offset, false);
 
-
-
-	/* be tidy */
-	if (stack)
-		_bt_freestack_s(stack);
-	_bt_freeskey_s(itup_scankey);
-
+	/* the scan key and the stack are released with the request arena */
 	return is_unique;
 }
 
@@ -579,6 +574,8 @@ _bt_split_s(VRelation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 	 * 1;//IndexRelationGetNumberOfKeyAttributes(rel);
 	 */
 
+	COUNTERS_INC(pageSplits);
+
 	/* Acquire a new page to split into */
 	rbuf = _bt_getbuf_s(rel, P_NEW, BT_WRITE);
 
@@ -24,15 +24,62 @@
 #include "access/soe_nbtree.h"
 #include "logger/logger.h"
 
-int* sfanouts;
-unsigned int snlevels;
-
-extern void btree_fanout_setup(int* fanouts,unsigned int fanout_size, 
-                               unsigned int nlevels){
-    
-    sfanouts = (int*)malloc(fanout_size);
-    memcpy(sfanouts, fanouts, fanout_size);
-    snlevels = nlevels;
+/*
+ * Computes the first logical block of each tree level on the index ORAM.
+ * Level 0 is the root block and every other level starts after the blocks
+ * of the levels above it.
+ */
+void
+btree_fanout_setup(VRelation rel, int *fanouts, unsigned int fanout_size,
+				   unsigned int nlevels)
+{
+	unsigned int nfanouts = fanout_size / sizeof(int);
+	unsigned int level;
+
+	rel->level_offsets = (unsigned int *) malloc(sizeof(unsigned int) * (nlevels + 1));
+	rel->level_offsets[0] = 0;
+	rel->nlevels = nlevels;
+
+	for (level = 1; level <= nlevels; level++)
+	{
+		if (level == 1)
+		{
+			rel->level_offsets[level] = 1;
+		}
+		else if (level - 2 < nfanouts)
+		{
+			rel->level_offsets[level] = rel->level_offsets[level - 1] + fanouts[level - 2];
+		}
+		else
+		{
+			rel->level_offsets[level] = rel->level_offsets[level - 1];
+		}
+	}
+
+	/* Cache the levels above the leaves that fit in INDEX_CACHE_SIZE. */
+	for (level = 0; level < nlevels; level++)
+	{
+		if ((Size) rel->level_offsets[level + 1] * BLCKSZ > INDEX_CACHE_SIZE)
+		{
+			break;
+		}
+	}
+	CacheLevels_s(rel, level, rel->level_offsets[level]);
+}
+
+/*
+ * Returns the number of blocks of a tree level. A level below the ones set
+ * up by btree_fanout_setup can take any block after them.
+ */
+BlockNumber
+_bt_level_nblocks_s(VRelation rel, unsigned int level)
+{
+	if (level < rel->nlevels)
+	{
+		return rel->level_offsets[level + 1] - rel->level_offsets[level];
+	}
+
+	return rel->totalBlocks - rel->level_offsets[rel->nlevels];
 }
 
 
@@ -212,29 +259,7 @@ _bt_getbuf_s(VRelation rel, BlockNumber blkno, int access)
 Buffer
 _bt_getbuf_level_s(VRelation rel, BlockNumber blkno)
 {
-
-    unsigned int clevel = rel->level;
-    unsigned int l_offset;
-    unsigned int l_ob_blkno;
-    Buffer  buf;
-
-    if(clevel == 0){
-        l_ob_blkno = blkno;
-
-    }else{
-
-        l_offset = 1;
-
-        for(int i=0; i < clevel-1; i++){
-            l_offset += sfanouts[i];
-        }
-    
-        l_ob_blkno = l_offset + blkno;
-    }
-    
-    buf = ReadBuffer_s(rel, l_ob_blkno);
-
-    return buf;
+    return ReadBuffer_s(rel, rel->level_offsets[rel->level] + blkno);
 }
 
 
@@ -74,6 +74,24 @@ void btree_load_s(VRelation indexRel, char* block, unsigned int level, unsigned
     ReleaseBuffer_s(indexRel, buffer);
 }
 
+/*
+ * Loads nblocks consecutive pages of a tree level, starting at the level
+ * block offset. The pages are written directly to their final position on
+ * the ORAM without reading the blocks they replace.
+ */
+void btree_load_level_s(VRelation indexRel, char* blocks, unsigned int nblocks,
+                        unsigned int level, unsigned int offset)
+{
+    unsigned int boffset;
+    unsigned int l_offset = indexRel->level_offsets[level] + offset;
+
+    indexRel->level = level;
+
+    for(boffset = 0; boffset < nblocks; boffset++){
+        WriteBlock_s(indexRel, l_offset + boffset, blocks + boffset * BLCKSZ);
+    }
+}
+
 /*
  *	btinsert() -- insert an index tuple into a btree.
  *
@@ -85,23 +103,45 @@ btinsert_s(VRelation indexRel, VRelation heapRel, ItemPointer ht_ctid, char *dat
 {
 	bool		result;
 	IndexTuple	itup;
-
-	Datum		index_values[1];
-	bool		index_isnull[1];
-
-	index_values[0] = PointerGetDatum_s(datum);
-	index_isnull[0] = false;
+	Size		size;
+	int16		attlen = indexRel->tDesc->attrs[0].attlen;
 
 	/* enable  */
 	/* bool checkUnique = UNIQUE_CHECK_NO; //enable duplicate? */
-	/* generate an index tuple */
-	itup = index_form_tuple_s(indexRel->tDesc, index_values, index_isnull);
+
+	/*
+	 * Generate an index tuple with the key as in the index pages built by
+	 * postgres: fixed-width keys as they are, and the others as a varlena.
+	 * index_form_tuple_s only sizes fixed length keys, so the tuple is
+	 * formed here.
+	 */
+	if (attlen > 0)
+	{
+		if (datumSize < attlen)
+		{
+			selog(ERROR, "Index key of %u bytes is shorter than its type, %d bytes",
+				  datumSize, attlen);
+			return false;
+		}
+		size = MAXALIGN_s(sizeof(IndexTupleData) + attlen);
+		itup = (IndexTuple) request_alloc(size);
+		memset(itup, 0, size);
+		itup->t_info = size;
+		memcpy(index_getattr_s(itup), datum, attlen);
+	}
+	else
+	{
+		size = MAXALIGN_s(sizeof(IndexTupleData) + VARHDRSZ + datumSize);
+		itup = (IndexTuple) request_alloc(size);
+		memset(itup, 0, size);
+		itup->t_info = size | INDEX_VAR_MASK;
+		SET_VARSIZE_S(index_getattr_s(itup), VARHDRSZ + datumSize);
+		memcpy(VARDATA_S(index_getattr_s(itup)), datum, datumSize);
+	}
 	itup->t_tid = *ht_ctid;
 
 	result = _bt_doinsert_s(indexRel, itup, datum, datumSize, heapRel);
 
-	free(itup);
-
 	return result;
 }
 
@@ -135,11 +175,18 @@ btgettuple_s(IndexScanDesc scan)
 #ifdef DUMMYS 
     /*I'm almost sure that when one condition is true so is the other. Validate
      * this assumption. No more results*/
-    if(res == false && (so->currPos.nextPage == P_NONE || !so->currPos.moreRight))
+    if(res == false && (!BTScanPosIsValid_s(so->currPos)
+                        || so->currPos.nextPage == P_NONE
+                        || !so->currPos.moreRight))
     {
         return false;
     }
 
+    /* A step without a match must not return the previous TID again. */
+    if(res == false)
+    {
+        ItemPointerSetInvalid_s(&scan->xs_ctup.t_self);
+    }
     return true;
 #else
     return res;
@@ -147,24 +194,52 @@ btgettuple_s(IndexScanDesc scan)
 
 }
 
+/*
+ * Sets scanKey to search for key, copied to argument, which holds the
+ * larger of keysize and the length of the key type.
+ */
+static void
+btinitscankey_s(VRelation rel, ScanKey scanKey, const char *key, int keysize,
+				char *argument)
+{
+	Form_pg_attribute att = &rel->tDesc->attrs[0];
+
+	scanKey->sk_subtype = rel->foid;
+	/*
+	 * A short key of a fixed-width type is zero padded, so that its
+	 * comparator does not read past it.
+	 */
+	if (keysize < att->attlen)
+	{
+		selog(ERROR, "Scan key of %d bytes is shorter than its type, %d bytes",
+			  keysize, att->attlen);
+	}
+	scanKey->sk_argument = argument;
+	memset(scanKey->sk_argument, 0, Max_s(keysize, att->attlen));
+	memcpy(scanKey->sk_argument, key, keysize);
+	scanKey->datumSize = keysize;
+	scanKey->sk_compare = keycmp_lookup(att);
+}
+
 /*
  *	btbeginscan() -- start a scan on a btree index
+ *
+ * The scan state is allocated on arena, which btendscan resets.
  */
 IndexScanDesc
-btbeginscan_s(VRelation rel, const char *key, int keysize)
+btbeginscan_s(VRelation rel, const char *key, int keysize, SOEArena arena)
 {
 	IndexScanDesc scan;
 	BTScanOpaque so;
 	ScanKey		scanKey;
+	int16		attlen = rel->tDesc->attrs[0].attlen;
 
-	scanKey = (ScanKey) malloc(sizeof(ScanKeyData));
-	scanKey->sk_subtype = rel->foid;
-	scanKey->sk_argument = (char *) malloc(keysize);
-	memcpy(scanKey->sk_argument, key, keysize);
-	scanKey->datumSize = keysize;
+	scanKey = (ScanKey) arena_alloc(arena, sizeof(ScanKeyData));
+	btinitscankey_s(rel, scanKey, key, keysize,
+					(char *) arena_alloc(arena, Max_s(keysize, attlen)));
 
 	/* allocate private workspace */
-	so = (BTScanOpaque) malloc(sizeof(BTScanOpaqueData));
+	so = (BTScanOpaque) arena_alloc(arena, sizeof(BTScanOpaqueData));
 	BTScanPosInvalidate_s(so->currPos);
 	BTScanPosInvalidate_s(so->markPos);
 
@@ -183,10 +258,11 @@ btbeginscan_s(VRelation rel, const char *key, int keysize)
     so->currPos.lastItem = 0;
 
 	/* get the scan */
-	scan = (IndexScanDesc) malloc(sizeof(IndexScanDescData));
+	scan = (IndexScanDesc) arena_alloc(arena, sizeof(IndexScanDescData));
 	scan->indexRelation = rel;
 	scan->keyData = scanKey;
 	scan->opaque = so;
+	scan->arena = arena;
 
 	ItemPointerSetInvalid_s(&scan->xs_ctup.t_self);
 	scan->xs_ctup.t_data = NULL;
@@ -197,6 +273,31 @@ btbeginscan_s(VRelation rel, const char *key, int keysize)
 }
 
 
+/*
+ *	btgetbatch() -- look up nkeys keys on a btree index at once
+ *
+ * Sets tids[i] to the heap TID of an index tuple equal to keys[i], of
+ * keySizes[i] bytes, or invalidates it if there is none. The tree levels
+ * are searched for all the keys together, see _bt_search_batch.
+ */
+void
+btgetbatch_s(VRelation rel, const char **keys, const int *keySizes, int nkeys,
+			 ItemPointer tids)
+{
+	ScanKey		scanKeys;
+	int16		attlen = rel->tDesc->attrs[0].attlen;
+	int			i;
+
+	scanKeys = (ScanKey) request_alloc(sizeof(ScanKeyData) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		btinitscankey_s(rel, &scanKeys[i], keys[i], keySizes[i],
+						(char *) request_alloc(Max_s(keySizes[i], attlen)));
+	}
+
+	_bt_search_batch_s(rel, scanKeys, nkeys, tids);
+}
+
 /*
  *	btendscan() -- close down a scan
  */
@@ -209,11 +310,6 @@ btendscan_s(IndexScanDesc scan)
 
 	/* No need to invalidate positions, the RAM is about to be freed. */
 
-	/* Release storage */
-	/* if (so->keyData != NULL) */
-	free(scan->keyData->sk_argument);
-	free(scan->keyData);
-	/* so->markTuples should not be pfree'd, see btrescan */
-	free(so);
-	free(scan);
+	/* Release storage, the scan itself included */
+	arena_reset(scan->arena);
 }
@@ -14,7 +14,10 @@
  */
 
 #include "access/soe_nbtree.h"
+#include "access/soe_abbrev.h"
 #include "logger/logger.h"
+#include "utils/soe_counters.h"
+#include "utils/soe_qsort.h"
 
 static bool _bt_readpage_s(IndexScanDesc scan,
 						   OffsetNumber offnum);
@@ -30,7 +33,10 @@ bt_dummy_search_s(VRelation rel, int maxHeight){
     #ifdef DUMMYS
     int height = 0;
     while(height < maxHeight){
-        ReadDummyBuffer(rel, 0);
+        /* The search reads the cached levels without the ORAM. */
+        if(height >= rel->cachedLevels){
+            ReadDummyBuffer(rel, 0);
+        }
         height++;
     }
     #endif
@@ -114,7 +120,9 @@ _bt_search_s(VRelation rel, int keysz, ScanKey scankey, bool nextkey,
 		{ 
             #ifdef DUMMYS
                 while(doDummy && tHeight < rel->tHeight){
-                    ReadDummyBuffer(rel, 0);
+                    if(tHeight + 1 >= rel->cachedLevels){
+                        ReadDummyBuffer(rel, 0);
+                    }
                     tHeight +=1;
                 }
             #endif
@@ -142,7 +150,7 @@ _bt_search_s(VRelation rel, int keysz, ScanKey scankey, bool nextkey,
 		 * child link to disambiguate duplicate keys in the index -- Lehman
 		 * and Yao disallow duplicate keys.)
 		 */
-		new_stack = (BTStack) malloc(sizeof(BTStackData));
+		new_stack = (BTStack) request_alloc(sizeof(BTStackData));
 		new_stack->bts_blkno = par_blkno;
 		new_stack->bts_offset = offnum;
 		new_stack->bts_btentry = blkno;
@@ -152,6 +160,7 @@ _bt_search_s(VRelation rel, int keysz, ScanKey scankey, bool nextkey,
 
         tHeight++;
         rel->level = tHeight;
+		COUNTERS_INC(levelsDescended);
 
 		*bufP = _bt_getbuf_level_s(rel, blkno);
 		/* drop the read lock on the parent page, acquire one on the child */
@@ -167,6 +176,141 @@ _bt_search_s(VRelation rel, int keysz, ScanKey scankey, bool nextkey,
 
 
 
+/* Key of a batched search and the block it descends to */
+typedef struct BTBatchItem
+{
+	BlockNumber blkno;
+	int			key;
+} BTBatchItem;
+
+static int
+_bt_batch_item_cmp(const void *a, const void *b)
+{
+	const BTBatchItem *ia = (const BTBatchItem *) a;
+	const BTBatchItem *ib = (const BTBatchItem *) b;
+
+	if (ia->blkno != ib->blkno)
+		return ia->blkno < ib->blkno ? -1 : 1;
+	return ia->key - ib->key;
+}
+
+/*
+ * Pads the nread accesses made by a batch of nkeys searches to a tree level
+ * with dummy accesses, up to one per key or per block of the level. Both
+ * are public, so the number of accesses does not tell how many keys share
+ * a page. The cached levels are read without the ORAM.
+ */
+static void
+_bt_batch_dummies_s(VRelation rel, unsigned int level, int nkeys, int nread)
+{
+#ifdef DUMMYS
+	int			naccesses;
+
+	if (level < rel->cachedLevels)
+	{
+		return;
+	}
+
+	naccesses = Min_s(nkeys, _bt_level_nblocks_s(rel, level));
+	for (; nread < naccesses; nread++)
+	{
+		ReadDummyBuffer(rel, 0);
+	}
+#endif
+}
+
+/*
+ *	_bt_search_batch() -- Search the tree for the nkeys scankeys together.
+ *
+ * The tree is descended one level at a time for all the keys. The keys are
+ * sorted by the block they descend to, so each distinct page of a level is
+ * read once and searched for all the keys that reach it. tids[i] is set to
+ * the heap TID of an index tuple equal to scankeys[i], or invalidated if
+ * there is none.
+ *
+ * The internal pages are searched for the last key <= scankey, as with
+ * nextkey, so that a key equal to the first key of a leaf, which is also
+ * its downlink, descends to that leaf instead of its left sibling. Every
+ * match is then found without moving right.
+ */
+void
+_bt_search_batch_s(VRelation rel, ScanKey scankeys, int nkeys,
+				   ItemPointer tids)
+{
+	BTBatchItem *items;
+	unsigned int height = 0;
+	bool		leaf = false;
+	int			nread;
+	int			i;
+	int			j;
+
+	items = (BTBatchItem *) request_alloc(sizeof(BTBatchItem) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		items[i].blkno = 0;
+		items[i].key = i;
+		ItemPointerSetInvalid_s(&tids[i]);
+	}
+
+	while (!leaf && nkeys > 0)
+	{
+		rel->level = height;
+		qsort_s(items, nkeys, sizeof(BTBatchItem), _bt_batch_item_cmp);
+
+		nread = 0;
+		for (i = 0; i < nkeys; i = j)
+		{
+			BlockNumber blkno = items[i].blkno;
+			Buffer		buf;
+			Page		page;
+			BTPageOpaque opaque;
+			OffsetNumber offnum;
+			IndexTuple	itup;
+			ScanKey		scankey;
+
+			buf = _bt_getbuf_level_s(rel, blkno);
+			nread++;
+			page = BufferGetPage_s(rel, buf);
+			opaque = (BTPageOpaque) PageGetSpecialPointer_s(page);
+			leaf = P_ISLEAF_s(opaque);
+
+			for (j = i; j < nkeys && items[j].blkno == blkno; j++)
+			{
+				scankey = &scankeys[items[j].key];
+				offnum = _bt_binsrch_s(rel, buf, 1, scankey, !leaf);
+
+				if (!leaf)
+				{
+					itup = (IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum));
+					items[j].blkno = BTreeInnerTupleGetDownLink_s(itup);
+				}
+				else if (offnum <= PageGetMaxOffsetNumber_s(page)
+						 && _bt_compare_s(rel, 1, scankey, page, offnum) == 0)
+				{
+					itup = (IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum));
+					tids[items[j].key] = itup->t_tid;
+				}
+			}
+
+			ReleaseBuffer_s(rel, buf);
+		}
+
+		_bt_batch_dummies_s(rel, height, nkeys, nread);
+		if (!leaf)
+		{
+			COUNTERS_ADD(levelsDescended, nkeys);
+			height++;
+		}
+	}
+
+	/* As _bt_search, the levels below a leaf root are accessed too. */
+	while (height < rel->tHeight)
+	{
+		height++;
+		_bt_batch_dummies_s(rel, height, nkeys, 0);
+	}
+}
+
 /*
  *	_bt_binsrch() -- Do a binary search for a key on a particular page.
  *
@@ -207,6 +351,7 @@ _bt_binsrch_s(VRelation rel,
 				high;
 	int32		result,
 				cmpval;
+	PageAbbrevKeys **abbrevs;
 
 	page = BufferGetPage_s(rel, buf);
 	opaque = (BTPageOpaque) PageGetSpecialPointer_s(page);
@@ -227,6 +372,21 @@ _bt_binsrch_s(VRelation rel,
 		return low;
 	}
 
+	/*
+	 * On a cached page, only the items with the abbreviated key of the scan
+	 * key are left to compare.
+	 */
+	abbrevs = BufferGetAbbrevKeys_s(rel, buf);
+	if (abbrevs != NULL)
+	{
+		if (*abbrevs == NULL)
+		{
+			*abbrevs = abbrev_build(&rel->tDesc->attrs[0], page, low, high,
+									!P_ISLEAF_s(opaque));
+		}
+		abbrev_narrow(*abbrevs, &rel->tDesc->attrs[0], scankey, &low, &high);
+	}
+
 	/*
 	 * Binary search to find the first key on the page >= scan key, or first
 	 * key > scankey when nextkey is true.
@@ -309,7 +469,6 @@ _bt_compare_s(VRelation rel,
 			  Page page,
 			  OffsetNumber offnum)
 {
-	char	   *datum;
 	IndexTuple	itup;
 	int32		result;
 
@@ -327,18 +486,9 @@ _bt_compare_s(VRelation rel,
 
 	itup = (IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum));
 
-
-
-	//datum = index_getattr_s(itup);
-    datum = VARDATA_ANY_S(DatumGetBpCharPP_S(index_getattr_s(itup)));
-
-	/* We assume we are comparing strings(varchars) */
-	//if (rel->foid == 1078)
-	//{
-	//	result = (int32) strcmp(scankey->sk_argument, datum);
-	//}
-
-    result = (int32) strncmp(scankey->sk_argument, datum, strlen(datum)-1);
+	/* The comparator of the key type, see soe_keycmp.h */
+	result = scankey->sk_compare(scankey->sk_argument, scankey->datumSize,
+								 index_getattr_s(itup));
 
 	/* if the keys are unequal, return the difference */
 	if (result != 0)
@@ -374,7 +524,6 @@ _bt_first_s(IndexScanDesc scan)
 	VRelation	rel = scan->indexRelation;
 	BTScanOpaque so = (BTScanOpaque) scan->opaque;
 	Buffer		buf;
-	BTStack		stack;
 	OffsetNumber offnum;
 
 	/* StrategyNumber strat; */
@@ -496,10 +645,8 @@ _bt_first_s(IndexScanDesc scan)
 	 * position ourselves on the target leaf page.
 	 */
 	/* selog(DEBUG1, "Going to search for page"); */
-	stack = _bt_search_s(rel, 1, cur, nextkey, &buf, BT_READ, true);
-	/* selog(DEBUG1, "Going to free search stack"); */
-	/* don't need to keep the stack around... */
-	_bt_freestack_s(stack);
+	_bt_search_s(rel, 1, cur, nextkey, &buf, BT_READ, true);
+	/* a read needs no stack, which is left on the request arena */
 	/* selog(DEBUG1, "GOING to initialize more data"); */
 
 	_bt_initialize_more_data_s(so);
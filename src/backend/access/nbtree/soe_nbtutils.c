@@ -24,7 +24,8 @@
  *		Build an insertion scan key that contains comparison data from itup
  *		as well as comparator routines appropriate to the key datatypes.
  *
- *		The result is intended for use with _bt_compare().
+ *		The result is intended for use with _bt_compare(), and it is
+ *		allocated on the request arena.
  */
 ScanKey
 _bt_mkscankey_s(VRelation rel, IndexTuple itup, char *datum, int dsize)
@@ -47,38 +48,15 @@ _bt_mkscankey_s(VRelation rel, IndexTuple itup, char *datum, int dsize)
 	 * We'll execute search using scan key constructed on key columns. Non-key
 	 * (INCLUDE index) columns are always omitted from scan keys.
 	 */
-	skey = (ScanKey) malloc(sizeof(ScanKeyData));
+	skey = (ScanKey) request_alloc(sizeof(ScanKeyData));
 	skey->sk_subtype = rel->foid;
 	skey->sk_argument = datum;
 	skey->datumSize = dsize;
+	skey->sk_compare = keycmp_lookup(&rel->tDesc->attrs[0]);
 
 	return skey;
 }
 
-/*
- * free a scan key made by either _bt_mkscankey or _bt_mkscankey_nodata.
- */
-void
-_bt_freeskey_s(ScanKey skey)
-{
-	free(skey);
-}
-
-/*
- * free a retracement stack made by _bt_search.
- */
-void
-_bt_freestack_s(BTStack stack)
-{
-	BTStack		ostack;
-
-	while (stack != NULL)
-	{
-		ostack = stack;
-		stack = stack->bts_parent;
-		free(ostack);
-	}
-}
 
 
 
@@ -108,8 +86,7 @@ _bt_checkkeys_s(IndexScanDesc scan,
 {
 	ItemId		iid = PageGetItemId_s(page, offnum);
 	IndexTuple	tuple;
-	char	   *keyValue;
-	char	   *datum;
+	ScanKey		key = scan->keyData;
 	int			test;
 
 
@@ -126,13 +103,9 @@ _bt_checkkeys_s(IndexScanDesc scan,
 
 
 	tuple = (IndexTuple) PageGetItem_s(page, iid);
-	//datum = index_getattr_s(tuple);
-    datum = VARDATA_ANY_S(DatumGetBpCharPP_S(index_getattr_s(tuple)));
-	/* datumSize = strlen(datum)+1; */
-	keyValue = scan->keyData->sk_argument;
-	/* the prototype assumes string comparisons */
-	//test = (int32) strcmp(datum, keyValue);
-    test = (int32) strncmp(datum, keyValue, strlen(datum)-1);
+	/* test is the order of the index key to the scan key */
+	test = -key->sk_compare(key->sk_argument, key->datumSize,
+							index_getattr_s(tuple));
 	/**
 	* Look at soe_nbtsearch.c function _bt_first_s to which operations the
 	* opoids correspond to.
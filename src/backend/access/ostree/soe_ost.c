@@ -74,6 +74,27 @@ insert_ost(OSTRelation rel, char *block, unsigned int level, unsigned int offset
 	return true;
 }
 
+/*
+ * Loads nblocks consecutive pages of a tree level starting at block offset.
+ * The pages are written to the level ORAM without reading the blocks they
+ * replace.
+ */
+bool
+insert_level_ost(OSTRelation rel, char *blocks, unsigned int nblocks,
+				 unsigned int level, unsigned int offset)
+{
+	unsigned int boffset;
+
+	rel->level = level;
+
+	for (boffset = 0; boffset < nblocks; boffset++)
+	{
+		WriteBlock_ost(rel, offset + boffset, blocks + boffset * BLCKSZ);
+	}
+
+	return true;
+}
+
 /*
  *	btgettuple() -- Get the next tuple in the scan.
  */
@@ -98,13 +119,20 @@ btgettuple_ost(IndexScanDesc scan)
 		res = _bt_next_ost(scan);
 	}
 #ifdef DUMMYS 
-    if(res == false && (so->currPos.nextPage == P_NONE || !so->currPos.moreRight))
+    if(res == false && (!BTScanPosIsValid_OST(so->currPos)
+                        || so->currPos.nextPage == P_NONE
+                        || !so->currPos.moreRight))
     {
 
     	//ReleaseBuffer_ost(scan->ost, so->currPos.buf);
         //selog(DEBUG1, "No more results on the tree");
         return false;
     }
+    /* A step without a match must not return the previous TID again. */
+    if(res == false)
+    {
+        ItemPointerSetInvalid_s(&scan->xs_ctup.t_self);
+    }
     return true;
 #else
     return res;
@@ -112,23 +140,51 @@ btgettuple_ost(IndexScanDesc scan)
 
 }
 
+/*
+ * Sets scanKey to search for key, copied to argument, which holds the
+ * larger of keysize and the length of the key type.
+ */
+static void
+btinitscankey_ost(OSTRelation rel, ScanKey scanKey, const char *key,
+				  int keysize, char *argument)
+{
+	Form_pg_attribute att = &rel->tDesc->attrs[0];
+
+	/*
+	 * A short key of a fixed-width type is zero padded, so that its
+	 * comparator does not read past it.
+	 */
+	if (keysize < att->attlen)
+	{
+		selog(ERROR, "Scan key of %d bytes is shorter than its type, %d bytes",
+			  keysize, att->attlen);
+	}
+	scanKey->sk_argument = argument;
+	memset(scanKey->sk_argument, 0, Max_s(keysize, att->attlen));
+	memcpy(scanKey->sk_argument, key, keysize);
+	scanKey->datumSize = keysize;
+	scanKey->sk_compare = keycmp_lookup(att);
+}
+
 /*
  *	btbeginscan() -- start a scan on a btree index
+ *
+ * The scan state is allocated on arena, which btendscan resets.
  */
 IndexScanDesc
-btbeginscan_ost(OSTRelation rel, const char *key, int keysize)
+btbeginscan_ost(OSTRelation rel, const char *key, int keysize, SOEArena arena)
 {
 	IndexScanDesc scan;
 	BTScanOpaqueOST so;
 	ScanKey		scanKey;
+	int16		attlen = rel->tDesc->attrs[0].attlen;
 
-	scanKey = (ScanKey) malloc(sizeof(ScanKeyData));
-	scanKey->sk_argument = (char *) malloc(keysize);
-	memcpy(scanKey->sk_argument, key, keysize);
-	scanKey->datumSize = keysize;
+	scanKey = (ScanKey) arena_alloc(arena, sizeof(ScanKeyData));
+	btinitscankey_ost(rel, scanKey, key, keysize,
+					  (char *) arena_alloc(arena, Max_s(keysize, attlen)));
 
 	/* allocate private workspace */
-	so = (BTScanOpaqueOST) malloc(sizeof(BTScanOpaqueDataOST));
+	so = (BTScanOpaqueOST) arena_alloc(arena, sizeof(BTScanOpaqueDataOST));
 	BTScanPosInvalidate_OST(so->currPos);
 	BTScanPosInvalidate_OST(so->markPos);
 
@@ -145,10 +201,11 @@ btbeginscan_ost(OSTRelation rel, const char *key, int keysize)
 	so->currTuples = so->markTuples = NULL;
 
 	/* get the scan */
-	scan = (IndexScanDesc) malloc(sizeof(IndexScanDescData));
+	scan = (IndexScanDesc) arena_alloc(arena, sizeof(IndexScanDescData));
 	scan->ost = rel;
 	scan->keyData = scanKey;
 	scan->opaque = so;
+	scan->arena = arena;
 
 	ItemPointerSetInvalid_s(&scan->xs_ctup.t_self);
 	scan->xs_ctup.t_data = NULL;
@@ -159,6 +216,31 @@ btbeginscan_ost(OSTRelation rel, const char *key, int keysize)
 }
 
 
+/*
+ *	btgetbatch() -- look up nkeys keys on a btree index at once
+ *
+ * Sets tids[i] to the heap TID of an index tuple equal to keys[i], of
+ * keySizes[i] bytes, or invalidates it if there is none. The tree levels
+ * are searched for all the keys together, see _bt_search_batch.
+ */
+void
+btgetbatch_ost(OSTRelation rel, const char **keys, const int *keySizes,
+			   int nkeys, ItemPointer tids)
+{
+	ScanKey		scanKeys;
+	int16		attlen = rel->tDesc->attrs[0].attlen;
+	int			i;
+
+	scanKeys = (ScanKey) request_alloc(sizeof(ScanKeyData) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		btinitscankey_ost(rel, &scanKeys[i], keys[i], keySizes[i],
+						  (char *) request_alloc(Max_s(keySizes[i], attlen)));
+	}
+
+	_bt_search_batch_ost(rel, scanKeys, nkeys, tids);
+}
+
 /*
  *	btendscan() -- close down a scan
  */
@@ -171,11 +253,6 @@ btendscan_ost(IndexScanDesc scan)
 
 	/* No need to invalidate positions, the RAM is about to be freed. */
 
-	/* Release storage */
-	/* if (so->keyData != NULL) */
-	free(scan->keyData->sk_argument);
-	free(scan->keyData);
-	/* so->markTuples should not be pfree'd, see btrescan */
-	free(so);
-	free(scan);
+	/* Release storage, the scan itself included */
+	arena_reset(scan->arena);
 }
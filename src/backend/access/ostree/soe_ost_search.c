@@ -14,8 +14,11 @@
  */
 
 #include "access/soe_ost.h"
+#include "access/soe_abbrev.h"
 #include "storage/soe_ost_ofile.h"
 #include "logger/logger.h"
+#include "utils/soe_counters.h"
+#include "utils/soe_qsort.h"
 
 static bool _bt_readpage_ost(IndexScanDesc scan,
 							 OffsetNumber offnum);
@@ -145,7 +148,7 @@ _bt_search_ost(OSTRelation rel, int keysz, ScanKey scankey, bool nextkey,
 		 * child link to disambiguate duplicate keys in the index -- Lehman
 		 * and Yao disallow duplicate keys.)
 		 */
-		new_stack = (BTStackOST) malloc(sizeof(BTStackDataOST));
+		new_stack = (BTStackOST) request_alloc(sizeof(BTStackDataOST));
 		new_stack->bts_blkno = par_blkno;
 		new_stack->bts_offset = offnum;
 		new_stack->bts_btentry = blkno;
@@ -154,6 +157,7 @@ _bt_search_ost(OSTRelation rel, int keysz, ScanKey scankey, bool nextkey,
 		ReleaseBuffer_ost(rel, *bufP);
 		height += 1;
 		rel->level = height;
+		COUNTERS_INC(levelsDescended);
 
 		*bufP = ReadBuffer_ost(rel, blkno);
 
@@ -164,6 +168,128 @@ _bt_search_ost(OSTRelation rel, int keysz, ScanKey scankey, bool nextkey,
 	return stack_in;
 }
 
+/* Key of a batched search and the block it descends to */
+typedef struct BTBatchItemOST
+{
+	BlockNumber blkno;
+	int			key;
+} BTBatchItemOST;
+
+static int
+_bt_batch_item_cmp_ost(const void *a, const void *b)
+{
+	const BTBatchItemOST *ia = (const BTBatchItemOST *) a;
+	const BTBatchItemOST *ib = (const BTBatchItemOST *) b;
+
+	if (ia->blkno != ib->blkno)
+		return ia->blkno < ib->blkno ? -1 : 1;
+	return ia->key - ib->key;
+}
+
+/*
+ * Pads the nread accesses made by a batch of nkeys searches to a tree level
+ * with dummy accesses, up to one per key or per block of the level.
+ * ReadDummyBuffer_ost skips the cached levels.
+ */
+static void
+_bt_batch_dummies_ost(OSTRelation rel, unsigned int level, int nkeys, int nread)
+{
+#ifdef DUMMYS
+	int			nblocks = level == 0 ? 1 : rel->osts->fanouts[level - 1];
+	int			naccesses = Min_s(nkeys, nblocks);
+
+	for (; nread < naccesses; nread++)
+	{
+		ReadDummyBuffer_ost(rel, level, 0);
+	}
+#endif
+}
+
+/*
+ *	_bt_search_batch() -- Search the tree for the nkeys scankeys together.
+ *
+ * Same as _bt_search_batch_s: each distinct page of a level is read once
+ * for all the keys that descend to it, and tids[i] is set to the heap TID
+ * of an index tuple equal to scankeys[i], or invalidated.
+ */
+void
+_bt_search_batch_ost(OSTRelation rel, ScanKey scankeys, int nkeys,
+					 ItemPointer tids)
+{
+	BTBatchItemOST *items;
+	unsigned int height = 0;
+	bool		leaf = false;
+	int			nread;
+	int			i;
+	int			j;
+
+	items = (BTBatchItemOST *) request_alloc(sizeof(BTBatchItemOST) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		items[i].blkno = 0;
+		items[i].key = i;
+		ItemPointerSetInvalid_s(&tids[i]);
+	}
+
+	while (!leaf && nkeys > 0)
+	{
+		rel->level = height;
+		qsort_s(items, nkeys, sizeof(BTBatchItemOST), _bt_batch_item_cmp_ost);
+
+		nread = 0;
+		for (i = 0; i < nkeys; i = j)
+		{
+			BlockNumber blkno = items[i].blkno;
+			Buffer		buf;
+			Page		page;
+			BTPageOpaqueOST opaque;
+			OffsetNumber offnum;
+			IndexTuple	itup;
+			ScanKey		scankey;
+
+			buf = ReadBuffer_ost(rel, blkno);
+			nread++;
+			page = BufferGetPage_ost(rel, buf);
+			opaque = (BTPageOpaqueOST) PageGetSpecialPointer_s(page);
+			leaf = P_ISLEAF_OST(opaque);
+
+			for (j = i; j < nkeys && items[j].blkno == blkno; j++)
+			{
+				scankey = &scankeys[items[j].key];
+				offnum = _bt_binsrch_ost(rel, buf, 1, scankey, !leaf);
+
+				if (!leaf)
+				{
+					itup = (IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum));
+					items[j].blkno = BTreeInnerTupleGetDownLink_OST(itup);
+				}
+				else if (offnum <= PageGetMaxOffsetNumber_s(page)
+						 && _bt_compare_ost(rel, 1, scankey, page, offnum) == 0)
+				{
+					itup = (IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum));
+					tids[items[j].key] = itup->t_tid;
+				}
+			}
+
+			ReleaseBuffer_ost(rel, buf);
+		}
+
+		_bt_batch_dummies_ost(rel, height, nkeys, nread);
+		if (!leaf)
+		{
+			COUNTERS_ADD(levelsDescended, nkeys);
+			height++;
+		}
+	}
+
+	/* As _bt_search, the levels below a leaf root are accessed too. */
+	while (height < rel->osts->nlevels)
+	{
+		height++;
+		_bt_batch_dummies_ost(rel, height, nkeys, 0);
+	}
+}
+
 /*
  *	_bt_binsrch() -- Do a binary search for a key on a particular page.
  *
@@ -204,6 +330,7 @@ _bt_binsrch_ost(OSTRelation rel,
 				high;
 	int32		result,
 				cmpval;
+	PageAbbrevKeys **abbrevs;
 
 	page = BufferGetPage_ost(rel, buf);
 	opaque = (BTPageOpaqueOST) PageGetSpecialPointer_s(page);
@@ -224,6 +351,21 @@ _bt_binsrch_ost(OSTRelation rel,
 		return low;
 	}
 
+	/*
+	 * On a cached page, only the items with the abbreviated key of the scan
+	 * key are left to compare.
+	 */
+	abbrevs = BufferGetAbbrevKeys_ost(rel, buf);
+	if (abbrevs != NULL)
+	{
+		if (*abbrevs == NULL)
+		{
+			*abbrevs = abbrev_build(&rel->tDesc->attrs[0], page, low, high,
+									!P_ISLEAF_OST(opaque));
+		}
+		abbrev_narrow(*abbrevs, &rel->tDesc->attrs[0], scankey, &low, &high);
+	}
+
 	/*
 	 * Binary search to find the first key on the page >= scan key, or first
 	 * key > scankey when nextkey is true.
@@ -306,7 +448,6 @@ _bt_compare_ost(OSTRelation rel,
 				Page page,
 				OffsetNumber offnum)
 {
-	char	   *datum;
 	IndexTuple	itup;
 	int32		result;
 
@@ -324,13 +465,9 @@ _bt_compare_ost(OSTRelation rel,
 
 	itup = (IndexTuple) PageGetItem_s(page, PageGetItemId_s(page, offnum));
 
-
-
-	/* datum = NameStr_s(*DatumGetName_s(index_getattr_s(itup))); */
-	datum = VARDATA_ANY_S(DatumGetBpCharPP_S(index_getattr_s(itup)));
-
-	/* We assume we are comparing strings(varchars) */
-    result = (int32) strncmp(scankey->sk_argument, datum, strlen(datum)-1);
+	/* The comparator of the key type, see soe_keycmp.h */
+	result = scankey->sk_compare(scankey->sk_argument, scankey->datumSize,
+								 index_getattr_s(itup));
 
 	/* if the keys are unequal, return the difference */
 	if (result != 0)
@@ -366,7 +503,6 @@ _bt_first_ost(IndexScanDesc scan)
 	OSTRelation rel = scan->ost;
 	BTScanOpaqueOST so = (BTScanOpaqueOST) scan->opaque;
 	Buffer		buf;
-	BTStackOST	stack;
 	OffsetNumber offnum;
 
 	/* StrategyNumber strat; */
@@ -487,9 +623,8 @@ _bt_first_ost(IndexScanDesc scan)
 	 * Use the manufactured insertion scan key to descend the tree and
 	 * position ourselves on the target leaf page.
 	 */
-	stack = _bt_search_ost(rel, 1, cur, nextkey, &buf, BT_READ_OST, true);
-	/* don't need to keep the stack around... */
-	_bt_freestack_ost(stack);
+	_bt_search_ost(rel, 1, cur, nextkey, &buf, BT_READ_OST, true);
+	/* a read needs no stack, which is left on the request arena */
 	/* selog(DEBUG1, "GOING to initialize more data"); */
 
 	_bt_initialize_more_data_ost(so);
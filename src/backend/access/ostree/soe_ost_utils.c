@@ -45,8 +45,7 @@ _bt_checkkeys_ost(IndexScanDesc scan,
 {
 	ItemId		iid = PageGetItemId_s(page, offnum);
 	IndexTuple	tuple;
-	char	   *keyValue;
-	char	   *datum;
+	ScanKey		key = scan->keyData;
 	int			test;
 
 
@@ -63,12 +62,9 @@ _bt_checkkeys_ost(IndexScanDesc scan,
 
 
 	tuple = (IndexTuple) PageGetItem_s(page, iid);
-	datum = VARDATA_ANY_S(DatumGetBpCharPP_S(index_getattr_s(tuple)));
-	/* selog(DEBUG1, "Current datum is %s", datum); */
-	/* datumSize = strlen(datum)+1; */
-	keyValue = scan->keyData->sk_argument;
-	/* the prototype assumes string comparisons */
-	test = (int32) strncmp(datum, keyValue, strlen(datum)-1);
+	/* test is the order of the index key to the scan key */
+	test = -key->sk_compare(key->sk_argument, key->datumSize,
+							index_getattr_s(tuple));
 
     /**
 	* Look at soe_nbtsearch.c function _bt_first_s to which operations the
@@ -86,19 +82,3 @@ _bt_checkkeys_ost(IndexScanDesc scan,
 
 	}
 }
-
-/*
- * free a retracement stack made by _bt_search.
- */
-void
-_bt_freestack_ost(BTStackOST stack)
-{
-	BTStackOST	ostack;
-
-	while (stack != NULL)
-	{
-		ostack = stack;
-		stack = stack->bts_parent;
-		free(ostack);
-	}
-}
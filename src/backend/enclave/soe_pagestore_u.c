@@ -0,0 +1,703 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_pagestore_u.c
+ *	  Untrusted page store that serves the file OCALLs of the SOE.
+ *
+ * Each relation file is opened on the first OCALL that names it and kept
+ * open until outFileClose, or until the last OCALL that was using it when
+ * outFileClose was called returns. With the mmap backend the whole file is mapped
+ * shared and pages are copied in and out of the mapping; outFileInit is
+ * the only call that extends a file, and it remaps it under the write lock
+ * of the file. With the pread backends every page is a system call, and
+ * with O_DIRECT the pages that are not aligned for the device go through
+ * a bounce buffer of the calling thread.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifdef UNSAFE
+#include "Enclave_dt.h"
+#else
+#include "Enclave_u.h"
+#endif
+
+#include "soe_pagestore.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Alignment of the buffers given to O_DIRECT reads and writes. */
+#define PAGESTORE_ALIGN 4096
+
+#ifdef UNSAFE
+#define PAGESTORE_STATUS(ok) ((ok) ? SGX_SUCCESS : 0)
+#endif
+
+typedef struct PageStoreFile
+{
+	char	   *filename;
+	int			fd;
+	/* mapping of the whole file, for the mmap backend */
+	char	   *map;
+	size_t		size;
+	/* taken for writing to remap the file */
+	pthread_rwlock_t lock;
+	/* OCALLs using the file, plus one while it is open, under store_lock */
+	int			refcount;
+	struct PageStoreFile *next;
+}			PageStoreFile;
+
+static char *store_dir = NULL;
+static SOEPageStoreBackend store_backend = SOE_PAGESTORE_MMAP;
+static SOEPageStoreSync store_sync = SOE_PAGESTORE_SYNC_NONE;
+
+static PageStoreFile *store_files = NULL;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread char *bounce = NULL;
+static __thread size_t bounce_size = 0;
+
+int
+soe_pagestore_configure(const char *dir, SOEPageStoreBackend backend,
+						SOEPageStoreSync sync)
+{
+	struct stat st;
+
+	if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		fprintf(stderr, "soe page store: %s is not a directory\n", dir);
+		return -1;
+	}
+
+	pthread_mutex_lock(&store_lock);
+	free(store_dir);
+	store_dir = strdup(dir);
+	store_backend = backend;
+	store_sync = sync;
+	pthread_mutex_unlock(&store_lock);
+
+	return 0;
+}
+
+/* Sets the store up from the environment. The caller holds store_lock. */
+static void
+pagestore_configure_env(void)
+{
+	const char *value;
+
+	value = getenv("SOE_PAGESTORE_DIR");
+	store_dir = strdup(value != NULL ? value : ".");
+
+	value = getenv("SOE_PAGESTORE_BACKEND");
+	if (value != NULL && strcmp(value, "pread") == 0)
+	{
+		store_backend = SOE_PAGESTORE_PREAD;
+	}
+	else if (value != NULL && strcmp(value, "direct") == 0)
+	{
+		store_backend = SOE_PAGESTORE_DIRECT;
+	}
+
+	value = getenv("SOE_PAGESTORE_SYNC");
+	if (value != NULL && strcmp(value, "close") == 0)
+	{
+		store_sync = SOE_PAGESTORE_SYNC_CLOSE;
+	}
+	else if (value != NULL && strcmp(value, "write") == 0)
+	{
+		store_sync = SOE_PAGESTORE_SYNC_WRITE;
+	}
+}
+
+static bool
+pagestore_map(PageStoreFile * file, size_t size)
+{
+	if (file->map != NULL)
+	{
+		munmap(file->map, file->size);
+		file->map = NULL;
+	}
+
+	file->size = size;
+	if (size == 0)
+	{
+		return true;
+	}
+
+	file->map = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+	if (file->map == MAP_FAILED)
+	{
+		fprintf(stderr, "soe page store: could not map %s: %s\n", file->filename, strerror(errno));
+		file->map = NULL;
+		file->size = 0;
+		return false;
+	}
+
+	return true;
+}
+
+static PageStoreFile *
+pagestore_open(const char *filename)
+{
+	PageStoreFile *file;
+	char	   *path;
+	int			flags = O_RDWR | O_CREAT;
+	struct stat st;
+
+#ifdef O_DIRECT
+	if (store_backend == SOE_PAGESTORE_DIRECT)
+	{
+		flags |= O_DIRECT;
+	}
+#endif
+	if (store_backend != SOE_PAGESTORE_MMAP && store_sync == SOE_PAGESTORE_SYNC_WRITE)
+	{
+		flags |= O_DSYNC;
+	}
+
+	path = (char *) malloc(strlen(store_dir) + strlen(filename) + 2);
+	sprintf(path, "%s/%s", store_dir, filename);
+
+	file = (PageStoreFile *) calloc(1, sizeof(PageStoreFile));
+	file->fd = open(path, flags, 0600);
+	if (file->fd < 0)
+	{
+		fprintf(stderr, "soe page store: could not open %s: %s\n", path, strerror(errno));
+		free(path);
+		free(file);
+		return NULL;
+	}
+	free(path);
+
+	file->filename = strdup(filename);
+	file->refcount = 1;
+	pthread_rwlock_init(&file->lock, NULL);
+
+	if (store_backend == SOE_PAGESTORE_MMAP && fstat(file->fd, &st) == 0)
+	{
+		pagestore_map(file, (size_t) st.st_size);
+	}
+
+	return file;
+}
+
+/*
+ * Returns the open relation file filename, opening it on the first call.
+ * The file stays valid until the caller gives it back with pagestore_put.
+ */
+static PageStoreFile *
+pagestore_file(const char *filename)
+{
+	PageStoreFile *file;
+
+	pthread_mutex_lock(&store_lock);
+	if (store_dir == NULL)
+	{
+		pagestore_configure_env();
+	}
+
+	for (file = store_files; file != NULL; file = file->next)
+	{
+		if (strcmp(file->filename, filename) == 0)
+		{
+			break;
+		}
+	}
+
+	if (file == NULL)
+	{
+		file = pagestore_open(filename);
+		if (file != NULL)
+		{
+			file->next = store_files;
+			store_files = file;
+		}
+	}
+	if (file != NULL)
+	{
+		file->refcount++;
+	}
+	pthread_mutex_unlock(&store_lock);
+
+	return file;
+}
+
+static void
+pagestore_release(PageStoreFile * file)
+{
+	if (file->map != NULL)
+	{
+		if (store_sync != SOE_PAGESTORE_SYNC_NONE)
+		{
+			msync(file->map, file->size, MS_SYNC);
+		}
+		munmap(file->map, file->size);
+	}
+	else if (store_sync == SOE_PAGESTORE_SYNC_CLOSE)
+	{
+		fsync(file->fd);
+	}
+
+	close(file->fd);
+	pthread_rwlock_destroy(&file->lock);
+	free(file->filename);
+	free(file);
+}
+
+/* Drops a reference to file, closing it if it was the last one. */
+static void
+pagestore_put(PageStoreFile * file)
+{
+	bool		last;
+
+	if (file == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&store_lock);
+	last = --file->refcount == 0;
+	pthread_mutex_unlock(&store_lock);
+
+	if (last)
+	{
+		pagestore_release(file);
+	}
+}
+
+/* Returns a buffer of the calling thread aligned for O_DIRECT. */
+static char *
+pagestore_bounce(size_t size)
+{
+	if (size > bounce_size)
+	{
+		free(bounce);
+		if (posix_memalign((void **) &bounce, PAGESTORE_ALIGN, size) != 0)
+		{
+			bounce = NULL;
+			bounce_size = 0;
+			return NULL;
+		}
+		bounce_size = size;
+	}
+
+	return bounce;
+}
+
+static bool
+pagestore_pread(PageStoreFile * file, char *page, size_t offset, size_t size)
+{
+	char	   *buffer = page;
+
+	if (store_backend == SOE_PAGESTORE_DIRECT && (uintptr_t) page % PAGESTORE_ALIGN != 0)
+	{
+		buffer = pagestore_bounce(size);
+		if (buffer == NULL)
+		{
+			return false;
+		}
+	}
+
+	if (pread(file->fd, buffer, size, offset) != (ssize_t) size)
+	{
+		return false;
+	}
+
+	if (buffer != page)
+	{
+		memcpy(page, buffer, size);
+	}
+
+	return true;
+}
+
+static bool
+pagestore_pwrite(PageStoreFile * file, const char *page, size_t offset, size_t size)
+{
+	const char *buffer = page;
+	char	   *aligned;
+
+	if (store_backend == SOE_PAGESTORE_DIRECT && (uintptr_t) page % PAGESTORE_ALIGN != 0)
+	{
+		aligned = pagestore_bounce(size);
+		if (aligned == NULL)
+		{
+			return false;
+		}
+		memcpy(aligned, page, size);
+		buffer = aligned;
+	}
+
+	return pwrite(file->fd, buffer, size, offset) == (ssize_t) size;
+}
+
+static bool
+pagestore_read(PageStoreFile * file, char *page, int blkno, int pageSize)
+{
+	size_t		offset = (size_t) blkno * pageSize;
+	bool		ok;
+
+	if (file == NULL || blkno < 0)
+	{
+		return false;
+	}
+
+	if (store_backend != SOE_PAGESTORE_MMAP)
+	{
+		return pagestore_pread(file, page, offset, pageSize);
+	}
+
+	pthread_rwlock_rdlock(&file->lock);
+	ok = offset + pageSize <= file->size;
+	if (ok)
+	{
+		memcpy(page, file->map + offset, pageSize);
+	}
+	pthread_rwlock_unlock(&file->lock);
+
+	return ok;
+}
+
+static bool
+pagestore_write(PageStoreFile * file, const char *page, int blkno, int pageSize)
+{
+	size_t		offset = (size_t) blkno * pageSize;
+	bool		ok;
+
+	if (file == NULL || blkno < 0)
+	{
+		return false;
+	}
+
+	if (store_backend != SOE_PAGESTORE_MMAP)
+	{
+		return pagestore_pwrite(file, page, offset, pageSize);
+	}
+
+	pthread_rwlock_rdlock(&file->lock);
+	ok = offset + pageSize <= file->size;
+	if (ok)
+	{
+		memcpy(file->map + offset, page, pageSize);
+		if (store_sync == SOE_PAGESTORE_SYNC_WRITE)
+		{
+			ok = msync(file->map + offset, pageSize, MS_SYNC) == 0;
+		}
+	}
+	pthread_rwlock_unlock(&file->lock);
+
+	return ok;
+}
+
+/*
+ * Writes the nblocks pages of an initialization batch from block boffset
+ * on, extending the file to hold them.
+ */
+static bool
+pagestore_init(PageStoreFile * file, const char *pages, unsigned int nblocks,
+			   unsigned int blocksize, int boffset)
+{
+	size_t		offset = (size_t) boffset * blocksize;
+	size_t		size = (size_t) nblocks * blocksize;
+	bool		ok = true;
+
+	if (file == NULL || boffset < 0)
+	{
+		return false;
+	}
+
+	if (store_backend != SOE_PAGESTORE_MMAP)
+	{
+		return pagestore_pwrite(file, pages, offset, size);
+	}
+
+	pthread_rwlock_wrlock(&file->lock);
+	if (offset + size > file->size)
+	{
+		ok = ftruncate(file->fd, offset + size) == 0 && pagestore_map(file, offset + size);
+	}
+	if (ok)
+	{
+		memcpy(file->map + offset, pages, size);
+		if (store_sync == SOE_PAGESTORE_SYNC_WRITE)
+		{
+			ok = msync(file->map, file->size, MS_SYNC) == 0;
+		}
+	}
+	pthread_rwlock_unlock(&file->lock);
+
+	return ok;
+}
+
+static bool
+pagestore_readv(PageStoreFile * file, char *pages, const int *blknos, int nblocks,
+				int pageSize)
+{
+	int			offset;
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		if (!pagestore_read(file, pages + (size_t) offset * pageSize, blknos[offset], pageSize))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+pagestore_writev(PageStoreFile * file, const char *pages, const int *blknos,
+				 int nblocks, int pageSize)
+{
+	int			offset;
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		if (!pagestore_write(file, pages + (size_t) offset * pageSize, blknos[offset], pageSize))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+pagestore_close(const char *filename)
+{
+	PageStoreFile **prev;
+	PageStoreFile *file;
+
+	pthread_mutex_lock(&store_lock);
+	for (prev = &store_files; *prev != NULL; prev = &(*prev)->next)
+	{
+		if (strcmp((*prev)->filename, filename) == 0)
+		{
+			break;
+		}
+	}
+	file = *prev;
+	if (file != NULL)
+	{
+		*prev = file->next;
+	}
+	pthread_mutex_unlock(&store_lock);
+
+	/* The OCALLs still using the file close it when they return. */
+	pagestore_put(file);
+
+	return true;
+}
+
+void
+soe_pagestore_close(void)
+{
+	PageStoreFile *files;
+	PageStoreFile *file;
+
+	pthread_mutex_lock(&store_lock);
+	files = store_files;
+	store_files = NULL;
+	pthread_mutex_unlock(&store_lock);
+
+	while (files != NULL)
+	{
+		file = files;
+		files = file->next;
+		pagestore_put(file);
+	}
+}
+
+void
+oc_logger(const char *str)
+{
+	fprintf(stderr, "%s\n", str);
+}
+
+static void
+pagestore_error(const char *op, const char *filename, int blkno)
+{
+	fprintf(stderr, "soe page store: %s of block %d of %s failed\n", op, blkno, filename);
+}
+
+
+/*
+ * The OCALLs return a status on the UNSAFE build, where the SOE calls
+ * them directly, and nothing on the SGX build, where the bridge generated
+ * from Enclave.edl calls them.
+ */
+#ifdef UNSAFE
+
+sgx_status_t
+outFileInit(const char *filename, const char *pages, unsigned int nblocks,
+			unsigned int blocksize, int pagesSize, int boffset)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_init(file, pages, nblocks, blocksize, boffset);
+
+	pagestore_put(file);
+
+	if (!ok)
+	{
+		pagestore_error("initialization", filename, boffset);
+	}
+	return PAGESTORE_STATUS(ok);
+}
+
+sgx_status_t
+outFileRead(char *page, const char *filename, int blkno, int pageSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_read(file, page, blkno, pageSize);
+
+	pagestore_put(file);
+
+	if (!ok)
+	{
+		pagestore_error("read", filename, blkno);
+	}
+	return PAGESTORE_STATUS(ok);
+}
+
+sgx_status_t
+outFileWrite(const char *block, const char *filename, int oblkno, int pageSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_write(file, block, oblkno, pageSize);
+
+	pagestore_put(file);
+
+	if (!ok)
+	{
+		pagestore_error("write", filename, oblkno);
+	}
+	return PAGESTORE_STATUS(ok);
+}
+
+sgx_status_t
+outFileReadv(char *pages, const char *filename, const int *blknos, int nblocks,
+			 int pageSize, int pagesSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_readv(file, pages, blknos, nblocks, pageSize);
+
+	pagestore_put(file);
+
+	if (!ok)
+	{
+		pagestore_error("vectored read", filename, blknos[0]);
+	}
+	return PAGESTORE_STATUS(ok);
+}
+
+sgx_status_t
+outFileWritev(const char *pages, const char *filename, const int *blknos,
+			  int nblocks, int pageSize, int pagesSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_writev(file, pages, blknos, nblocks, pageSize);
+
+	pagestore_put(file);
+
+	if (!ok)
+	{
+		pagestore_error("vectored write", filename, blknos[0]);
+	}
+	return PAGESTORE_STATUS(ok);
+}
+
+sgx_status_t
+outFileClose(const char *filename)
+{
+	return PAGESTORE_STATUS(pagestore_close(filename));
+}
+
+#else
+
+void
+outFileInit(const char *filename, const char *pages, unsigned int nblocks,
+			unsigned int blocksize, int pagesSize, int initOffset)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_init(file, pages, nblocks, blocksize, initOffset);
+
+	pagestore_put(file);
+	if (!ok)
+	{
+		pagestore_error("initialization", filename, initOffset);
+	}
+}
+
+void
+outFileRead(char *page, const char *filename, int blkno, int pageSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_read(file, page, blkno, pageSize);
+
+	pagestore_put(file);
+	if (!ok)
+	{
+		pagestore_error("read", filename, blkno);
+	}
+}
+
+void
+outFileWrite(const char *block, const char *filename, int oblkno, int pageSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_write(file, block, oblkno, pageSize);
+
+	pagestore_put(file);
+	if (!ok)
+	{
+		pagestore_error("write", filename, oblkno);
+	}
+}
+
+void
+outFileReadv(char *pages, const char *filename, const int *blknos, int nblocks,
+			 int pageSize, int pagesSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_readv(file, pages, blknos, nblocks, pageSize);
+
+	pagestore_put(file);
+	if (!ok)
+	{
+		pagestore_error("vectored read", filename, blknos[0]);
+	}
+}
+
+void
+outFileWritev(const char *pages, const char *filename, const int *blknos,
+			  int nblocks, int pageSize, int pagesSize)
+{
+	PageStoreFile *file = pagestore_file(filename);
+	bool		ok = pagestore_writev(file, pages, blknos, nblocks, pageSize);
+
+	pagestore_put(file);
+	if (!ok)
+	{
+		pagestore_error("vectored write", filename, blknos[0]);
+	}
+}
+
+void
+outFileClose(const char *filename)
+{
+	pagestore_close(filename);
+}
+
+#endif
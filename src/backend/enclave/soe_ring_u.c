@@ -0,0 +1,96 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_ring_u.c
+ *	  Untrusted side of the request ring shared with the enclave.
+ *
+ * The worker polls the ring slots and serves the posted page requests with
+ * the functions that implement the outFileRead and outFileWrite OCALLs. On
+ * the UNSAFE build it runs in the same process as the SOE, which gives a
+ * stand-in for the switchless transport without SGX hardware.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifdef UNSAFE
+#include "Enclave_dt.h"
+#else
+#include "Enclave_u.h"
+#endif
+
+#include "soe_ring.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_t ring_worker;
+
+void
+soe_ring_serve(SOERing * ring)
+{
+	int			offset;
+	int			served;
+	SOERingSlot *slot;
+
+	while (!__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE))
+	{
+		served = 0;
+		for (offset = 0; offset < SOE_RING_SLOTS; offset++)
+		{
+			slot = &ring->slots[offset];
+
+			if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SOE_RING_POSTED)
+			{
+				continue;
+			}
+
+			if (slot->op == SOE_RING_READ)
+			{
+				outFileRead(slot->page, slot->filename, slot->blkno, SOE_RING_PAGESIZE);
+			}
+			else
+			{
+				outFileWrite(slot->page, slot->filename, slot->blkno, SOE_RING_PAGESIZE);
+			}
+
+			__atomic_store_n(&slot->state, SOE_RING_DONE, __ATOMIC_RELEASE);
+			served++;
+		}
+
+		if (served == 0)
+		{
+			__builtin_ia32_pause();
+		}
+	}
+}
+
+static void *
+soe_ring_worker(void *ring)
+{
+	soe_ring_serve((SOERing *) ring);
+	return NULL;
+}
+
+SOERing *
+soe_ring_start(void)
+{
+	SOERing    *ring = (SOERing *) calloc(1, sizeof(SOERing));
+
+	if (pthread_create(&ring_worker, NULL, &soe_ring_worker, ring) != 0)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+void
+soe_ring_stop(SOERing * ring)
+{
+	__atomic_store_n(&ring->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(ring_worker, NULL);
+	free(ring);
+}
@@ -19,7 +19,18 @@
 #include "storage/soe_nbtree_ofile.h"
 #include "storage/soe_ost_ofile.h"
 #include "storage/soe_itemptr.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_lock.h"
+#include "storage/soe_partition.h"
+#include "storage/soe_treetop.h"
+#include "utils/soe_counters.h"
+#include "utils/soe_arena.h"
+#include "utils/soe_keycmp.h"
 #include "logger/logger.h"
+#include "common/soe_pe.h"
+#ifdef UNSAFE
+#include "soe_ring.h"
+#endif
 
 #include <oram/oram.h>
 #include <oram/plblock.h>
@@ -28,47 +39,278 @@
 #include <oram/ofile.h>
 
 
-/*  Bucket capacity */
-#ifdef SMALL_BKCAP
-#define BKCAP 1
-#else
-#define BKCAP 4
-#endif
-
 /* Predefined max tuple size for sgx to copy the real tuple to*/
 #define MAX_TUPLE_SIZE 1400
 
-ORAMState	stateTable = NULL;
-ORAMState	stateIndex = NULL;
-
-OSTreeState ostTable = NULL;
+/* Maximum number of relations hosted by the enclave */
+#define MAX_RELATIONS 64
 
-VRelation	oTable;
-VRelation	oIndex;
-OSTRelation ostIndex;
+/*
+ * Maximum number of client threads with a scan in progress. It should not be
+ * lower than the TCSNum of the enclave configuration.
+ */
+#define MAX_SESSIONS 32
 
-Amgr	   *tamgr;
-Amgr	   *iamgr;
+/*
+ * A protected table and its index. The handle returned by initSOE and
+ * initFSOE is the position of the relation in the registry.
+ */
+typedef struct SOERelationData
+{
+	bool		inuse;
+	/* Operation mode */
+	Mode		mode;
+	VRelation	oTable;
+	VRelation	oIndex;
+	OSTRelation ostIndex;
+	Amgr	   *tamgr;
+	Amgr	   *iamgr;
+
+	/*
+	 * Every ORAM access updates the ORAM state, so the accesses to the table
+	 * and to the index are serialized by their own lock. When both are
+	 * held, tlock is taken first.
+	 */
+	SOEMutex	tlock;
+	SOEMutex	ilock;
+	/* Index scan in progress of each session, protected by ilock */
+	IndexScanDesc scans[MAX_SESSIONS];
+	/* Arena of the scan state of each session, protected by ilock */
+	SOEArena	scanArenas[MAX_SESSIONS];
+	/* Counters of the ECALLs on the relation */
+	SOEStats	stats;
+}			SOERelationData;
+
+typedef SOERelationData *SOERelation;
+
+SOERelationData relations[MAX_RELATIONS];
 
+/*
+ * Protects the registry. The ECALLs on a relation hold it in shared mode
+ * and the ones that create or close relations hold it exclusively.
+ */
+SOERWLock	relations_lock = SOE_RWLOCK_INITIALIZER;
 
-//Index scan global status
-IndexScanDesc scan;
+/*
+ * A client thread in a scan ECALL, or with a scan in progress on some
+ * relation. The session is released at the end of an ECALL that leaves the
+ * thread without scans, so that a pool of threads that come and go does not
+ * run out of sessions, and a thread that gets the id of one that is gone
+ * does not find its scans.
+ */
+typedef struct SOESession
+{
+	bool		inuse;
+	SOEThread	thread;
+	/* relations with a scan of the session, updated atomically */
+	int			nscans;
+}			SOESession;
 
+/* The position of a session is its id, protected by sessions_lock */
+SOESession	sessions[MAX_SESSIONS];
+SOEMutex	sessions_lock = SOE_MUTEX_INITIALIZER;
 
+/* Session taken by the ECALL of the calling thread, or -1 */
+static __thread int callSession = -1;
 
-//Operation mode
-Mode        mode;
 int counter = 0;
 
+#ifdef UNSAFE
+/* Request ring started by initRing, stopped on closeSoe */
+SOERing    *oring = NULL;
+#endif
 
-void
+/*
+ * Returns the handle of a free registry entry, or -1 if there is none. The
+ * caller holds relations_lock exclusively.
+ */
+static int
+newRelation(void)
+{
+	int			handle;
+
+	for (handle = 0; handle < MAX_RELATIONS; handle++)
+	{
+		if (!relations[handle].inuse)
+		{
+			memset(&relations[handle], 0, sizeof(SOERelationData));
+			relations[handle].inuse = true;
+			soe_mutex_init(&relations[handle].tlock);
+			soe_mutex_init(&relations[handle].ilock);
+			counters_reset(&relations[handle].stats);
+			return handle;
+		}
+	}
+
+	selog(ERROR, "Can't host more than %d relations", MAX_RELATIONS);
+	return -1;
+}
+
+/*
+ * Returns the relation of handle with relations_lock held in shared mode,
+ * which the caller releases with releaseRelation. Returns NULL without the
+ * lock if the handle is not valid. Until then the counters updated by the
+ * thread are charged to the relation.
+ */
+static SOERelation
+getRelation(int handle)
+{
+	soe_rwlock_rdlock(&relations_lock);
+
+	if (handle < 0 || handle >= MAX_RELATIONS || !relations[handle].inuse)
+	{
+		soe_rwlock_rdunlock(&relations_lock);
+		selog(ERROR, "Invalid relation handle %d", handle);
+		return NULL;
+	}
+
+	counters_set_relation(&relations[handle].stats);
+	return &relations[handle];
+}
+
+/* Releases the session taken by the ECALL if it has no scan left. */
+static void
+releaseSession(void)
+{
+	if (callSession < 0)
+	{
+		return;
+	}
+
+	soe_mutex_lock(&sessions_lock);
+	if (__atomic_load_n(&sessions[callSession].nscans, __ATOMIC_ACQUIRE) == 0)
+	{
+		sessions[callSession].inuse = false;
+	}
+	soe_mutex_unlock(&sessions_lock);
+	callSession = -1;
+}
+
+/*
+ * Also releases the memory allocated by the ECALL on the request arena, and
+ * the session it took.
+ */
+static void
+releaseRelation(void)
+{
+	counters_set_relation(NULL);
+	soe_rwlock_rdunlock(&relations_lock);
+	request_reset();
+	releaseSession();
+}
+
+/*
+ * Returns the session of the calling thread, taking a free one if the thread
+ * has none, or -1 if there are too many threads with a scan in progress.
+ * The caller holds a relation, which releaseRelation releases with the
+ * session.
+ */
+static int
+getSession(void)
+{
+	SOEThread	self = soe_thread_self();
+	int			session;
+	int			free = -1;
+
+	soe_mutex_lock(&sessions_lock);
+	for (session = 0; session < MAX_SESSIONS; session++)
+	{
+		if (!sessions[session].inuse)
+		{
+			free = free < 0 ? session : free;
+		}
+		else if (sessions[session].thread == self)
+		{
+			break;
+		}
+	}
+
+	if (session == MAX_SESSIONS)
+	{
+		session = free;
+		if (session >= 0)
+		{
+			sessions[session].inuse = true;
+			sessions[session].thread = self;
+		}
+	}
+	soe_mutex_unlock(&sessions_lock);
+
+	if (session < 0)
+	{
+		selog(ERROR, "Can't run scans from more than %d threads", MAX_SESSIONS);
+	}
+	callSession = session;
+
+	return session;
+}
+
+/*
+ * Sets the scan of session on rel, with rel->ilock held, and keeps count of
+ * the relations with a scan of the session.
+ */
+static void
+setSessionScan(SOERelation rel, int session, IndexScanDesc scan)
+{
+	if (rel->scans[session] == NULL && scan != NULL)
+	{
+		__atomic_add_fetch(&sessions[session].nscans, 1, __ATOMIC_RELEASE);
+	}
+	else if (rel->scans[session] != NULL && scan == NULL)
+	{
+		__atomic_sub_fetch(&sessions[session].nscans, 1, __ATOMIC_RELEASE);
+	}
+	rel->scans[session] = scan;
+}
+
+/*
+ * Creates the table of rel on a single ORAM, or on HEAP_PARTITIONS ORAMs
+ * when the build asks for more than one.
+ */
+static VRelation
+initHeapRelation(SOERelation rel, const char *tName, int tNBlocks, unsigned int tOid)
+{
+	VRelation	vrel;
+
+#if HEAP_PARTITIONS > 1
+	vrel = InitVRelation(NULL, NULL, tOid, tNBlocks, &heap_pageInit);
+	vrel->parts = initORAMPartitions(tName, tNBlocks, &heap_ofileCreate);
+#else
+	ORAMState	state;
+	HeapPartition hpart = (HeapPartition) malloc(sizeof(HeapPartitionData));
+
+	hpart->partition = 0;
+	hpart->npartitions = 1;
+	hpart->offset = 0;
+	hpart->nblocks = 0;
+	state = initORAMState(tName, tNBlocks, &heap_ofileCreate, &rel->tamgr, ORAM_TREETOP_LEVELS, hpart);
+	vrel = InitVRelation(state, hpart, tOid, tNBlocks, &heap_pageInit);
+#endif
+
+	return vrel;
+}
+
+
+int
 initSOE(const char *tName, const char *iName, int tNBlocks, int* fanouts,
         unsigned int fanout_size, unsigned int nlevels, int iNBlocks,
 		unsigned int tOid, unsigned int iOid, unsigned int functionOid, 
         unsigned int indexOid, char *attrDesc, unsigned int attrDescLength)
 {
 	/* VALGRIND_DO_LEAK_CHECK; */
+	int			handle;
+	SOERelation rel;
+	ORAMState	state;
+	ORAMFile	iofile;
 
+	soe_rwlock_wrlock(&relations_lock);
+	handle = newRelation();
+	if (handle < 0)
+	{
+		soe_rwlock_wrunlock(&relations_lock);
+		return handle;
+	}
+	rel = &relations[handle];
 
 #ifdef SINGLE_ORAM
     /**
@@ -88,37 +330,49 @@ initSOE(const char *tName, const char *iName, int tNBlocks, int* fanouts,
     iNBlocks += tNBlocks;
 #endif
 	selog(DEBUG1, "Initializing SOE for relation %s with %d blocks and index %s with %d blocks", tName, tNBlocks, iName, iNBlocks);
-	stateTable = initORAMState(tName, tNBlocks, &heap_ofileCreate, true);
-	oTable = InitVRelation(stateTable, tOid, tNBlocks, &heap_pageInit);
+	rel->oTable = initHeapRelation(rel, tName, tNBlocks, tOid);
 
 
 	selog(DEBUG1, "going to init nbtree oblivious heap file");
-	stateIndex = initORAMState(iName, iNBlocks, &nbtree_ofileCreate, false);
-	oIndex = InitVRelation(stateIndex, iOid, iNBlocks, &nbtree_pageInit);
-
-	oIndex->foid = functionOid;
-	oIndex->indexOid = indexOid;
-	oIndex->tDesc->natts = 1;
-	oIndex->tDesc->attrs = (FormData_pg_attribute *) malloc(sizeof(struct FormData_pg_attribute));
-	memcpy(oIndex->tDesc->attrs, attrDesc, attrDescLength);
-	btree_fanout_setup(fanouts, fanout_size, nlevels);
+	iofile = (ORAMFile) malloc(sizeof(ORAMFileData));
+	state = initORAMState(iName, iNBlocks, &nbtree_ofileCreate, &rel->iamgr, ORAM_TREETOP_LEVELS, iofile);
+	rel->oIndex = InitVRelation(state, iofile, iOid, iNBlocks, &nbtree_pageInit);
+
+	rel->oIndex->foid = functionOid;
+	rel->oIndex->indexOid = indexOid;
+	rel->oIndex->tDesc->natts = 1;
+	rel->oIndex->tDesc->attrs = (FormData_pg_attribute *) malloc(sizeof(struct FormData_pg_attribute));
+	memcpy(rel->oIndex->tDesc->attrs, attrDesc, attrDescLength);
+	btree_fanout_setup(rel->oIndex, fanouts, fanout_size, nlevels);
 	//oIndex->tDesc->isnbtree = true;
 	
-    scan = NULL;
-    mode = DYNAMIC;
+    rel->mode = DYNAMIC;
+	soe_rwlock_wrunlock(&relations_lock);
+
+	return handle;
 }
 
-void
+int
 initFSOE(const char *tName, const char *iName, int tNBlocks, int *fanouts, 
          unsigned int fanout_size, unsigned int nlevels, unsigned int tOid, 
          unsigned int iOid, char *attrDesc, unsigned int attrDescLength)
 {
+	int			handle;
+	SOERelation rel;
+	OSTreeState ostTable;
 
+	soe_rwlock_wrlock(&relations_lock);
+	handle = newRelation();
+	if (handle < 0)
+	{
+		soe_rwlock_wrunlock(&relations_lock);
+		return handle;
+	}
+	rel = &relations[handle];
 
 	selog(DEBUG1, "Initializing FSOE for relation %s with %d blocks and BKCAP %d", tName, tNBlocks, BKCAP);
 
-    stateTable = initORAMState(tName, tNBlocks, &heap_ofileCreate, true);
-	oTable = InitVRelation(stateTable, tOid, tNBlocks, &heap_pageInit);
+	rel->oTable = initHeapRelation(rel, tName, tNBlocks, tOid);
 
     selog(DEBUG1, "Initializing FSOE for index %s for %d levels", iName, nlevels);
 
@@ -127,14 +381,22 @@ initFSOE(const char *tName, const char *iName, int tNBlocks, int *fanouts,
 
 
 	/* By default a single attribute is used to compare elements in the tree. */
-	ostIndex = InitOSTRelation(ostTable, iOid, attrDesc, attrDescLength);
+	rel->ostIndex = InitOSTRelation(ostTable, iOid, attrDesc, attrDescLength);
 
-	scan = NULL;
-    mode = OST;
+    rel->mode = OST;
+	soe_rwlock_wrunlock(&relations_lock);
+
+	return handle;
 }
 
+/*
+ * Creates the ORAM of relation name. The first treeTopLevels levels of its
+ * bucket tree are kept in the enclave by the oblivious file. appData, which
+ * starts with the ORAMFileData of the ORAM, is given to every ORAM call.
+ */
 ORAMState
-initORAMState(const char *name, int nBlocks, AMOFile * (*ofile) (), bool isHeap)
+initORAMState(const char *name, int nBlocks, AMOFile * (*ofile) (), Amgr **amgrp,
+			  unsigned int treeTopLevels, void *appData)
 {
 
 
@@ -147,17 +409,57 @@ initORAMState(const char *name, int nBlocks, AMOFile * (*ofile) (), bool isHeap)
 	amgr->am_pmap = pmapCreate();
 	amgr->am_ofile = ofile();
 
-	if (isHeap)
+	*amgrp = amgr;
+
+	((ORAMFile) appData)->treetop = treetop_create(name, treeTopLevels);
+	((ORAMFile) appData)->counters = counters_oram_create(nBlocks);
+	((ORAMFile) appData)->cipher = page_cipher_open(name);
+    state = init_oram(name, nBlocks, BLCKSZ, BKCAP, amgr, appData);
+	return state;
+}
+
+/*
+ * Splits a heap of nBlocks blocks in HEAP_PARTITIONS ORAMs placed one after
+ * the other on the relation file.
+ */
+ORAMPartitions
+initORAMPartitions(const char *name, int nBlocks, AMOFile * (*ofile) ())
+{
+	int			i;
+	Amgr	   *amgr;
+	PageCipherFile *cipher = page_cipher_open(name);
+	ORAMPartitions parts = (ORAMPartitions) malloc(sizeof(ORAMPartitionsData));
+
+	parts->npartitions = HEAP_PARTITIONS;
+	parts->nblocks = (nBlocks + HEAP_PARTITIONS - 1) / HEAP_PARTITIONS;
+	parts->orams = (ORAMState *) malloc(sizeof(ORAMState) * HEAP_PARTITIONS);
+	parts->amgrs = (Amgr **) malloc(sizeof(Amgr *) * HEAP_PARTITIONS);
+	parts->partitions = (HeapPartition) malloc(sizeof(HeapPartitionData) * HEAP_PARTITIONS);
+
+	for (i = 0; i < HEAP_PARTITIONS; i++)
 	{
-		tamgr = amgr;
+		parts->partitions[i].ofile.treetop = NULL;
+		parts->partitions[i].ofile.counters = NULL;
+		parts->partitions[i].ofile.cipher = cipher;
+		parts->partitions[i].partition = i;
+		parts->partitions[i].npartitions = HEAP_PARTITIONS;
+		parts->partitions[i].offset = 0;
+		parts->partitions[i].nblocks = 0;
 	}
-	else
+
+	for (i = 0; i < HEAP_PARTITIONS; i++)
 	{
-		iamgr = amgr;
+		amgr = (Amgr *) malloc(sizeof(Amgr));
+		amgr->am_stash = stashCreate();
+		amgr->am_pmap = pmapCreate();
+		amgr->am_ofile = ofile();
+		parts->amgrs[i] = amgr;
+
+		parts->partitions[i].ofile.counters = counters_oram_create(parts->nblocks);
+		parts->orams[i] = init_oram(name, parts->nblocks, BLCKSZ, BKCAP, amgr, &parts->partitions[i]);
 	}
-    
-    state = init_oram(name, nBlocks, BLCKSZ, BKCAP, amgr, NULL);
-	return state;
+
+	return parts;
 }
 
 
@@ -168,6 +470,7 @@ initOSTreeProtocol(const char *name, unsigned int iOid, int *fanouts,
 
 	int			i;
 	int			namelen;
+	PageCipherFile *cipher = page_cipher_open(name);
 
 	OSTreeState ost = (OSTreeState) malloc(sizeof(struct OSTreeState));
 
@@ -181,13 +484,26 @@ initOSTreeProtocol(const char *name, unsigned int iOid, int *fanouts,
 	ost->iname = (char *) malloc(namelen);
 	memcpy(ost->iname, name, namelen);
 
-    init_root(name);
+	ost->levels = (OSTLevel) malloc(sizeof(OSTLevelData) * (nlevels + 1));
+	for (i = 0; i <= nlevels; i++)
+	{
+		ost->levels[i].ofile.treetop = NULL;
+		ost->levels[i].ofile.counters = NULL;
+		ost->levels[i].ofile.cipher = cipher;
+		ost->levels[i].level = i;
+		ost->levels[i].offset = 0;
+		ost->levels[i].nblocks = 0;
+	}
+
+    init_root(name, &ost->levels[0]);
+	ost->levels[0].nblocks = 1;
+	ost->orams = NULL;
+	ost->amgrs = NULL;
     
     if(nlevels > 0){
 
 	    ost->orams = (ORAMState *) malloc(sizeof(ORAMState) * nlevels);
-
-	    ost_status(ost);
+	    ost->amgrs = (Amgr **) malloc(sizeof(Amgr *) * nlevels);
 
 	    for (i = 0; i < nlevels; i++)
 	    {
@@ -200,9 +516,11 @@ initOSTreeProtocol(const char *name, unsigned int iOid, int *fanouts,
 		    amgr->am_stash = stashCreate();
 		    amgr->am_pmap = pmapCreate();
 		    amgr->am_ofile = ofile();
+		    ost->amgrs[i] = amgr;
 			
 		    //selog(DEBUG1, "Initiating ORAM on level %d with filesize %d", i, fileSize);
-		    ost->orams[i] = init_oram(name, fanouts[i], BLCKSZ, BKCAP, amgr, &i);
+		    ost->levels[i + 1].ofile.counters = counters_oram_create(fanouts[i]);
+		    ost->orams[i] = init_oram(name, fanouts[i], BLCKSZ, BKCAP, amgr, &ost->levels[i + 1]);
 	    }
     }
 
@@ -210,13 +528,20 @@ initOSTreeProtocol(const char *name, unsigned int iOid, int *fanouts,
 }
 
 void
-insert(const char *heapTuple, unsigned int tupleSize, char *datum, 
+insert(int handle, const char *heapTuple, unsigned int tupleSize, char *datum, 
        unsigned int datumSize)
 {
+	SOERelation rel = getRelation(handle);
+
+	if (rel == NULL)
+	{
+		return;
+	}
+	COUNTERS_ECALL(SOE_STATS_INSERT);
 
-	HeapTuple	hTuple = (HeapTuple) malloc(sizeof(HeapTupleData));
+	HeapTupleData hTuple;
 	int			trimmedSize = (datumSize + 1) * sizeof(char);
-	char	   *trimedDatum = (char *) malloc(trimmedSize);
+	char	   *trimedDatum = (char *) request_alloc(trimmedSize);
 
 	memcpy(trimedDatum, datum, datumSize);
 	trimedDatum[datumSize] = '\0';
@@ -225,15 +550,21 @@ insert(const char *heapTuple, unsigned int tupleSize, char *datum,
 
 	if (tupleSize <= MAX_TUPLE_SIZE)
 	{
-		heap_insert_s(oTable, tuple, (uint32) tupleSize, hTuple);
-		if (oIndex->indexOid == F_HASHHANDLER)
+		/* The index insertion can read the table. */
+		soe_mutex_lock(&rel->tlock);
+		heap_insert_s(rel->oTable, tuple, (uint32) tupleSize, &hTuple);
+		soe_mutex_lock(&rel->ilock);
+		if (rel->oIndex->indexOid == F_HASHHANDLER)
 		{
-					hashinsert_s(oIndex, &(hTuple->t_self), trimedDatum, datumSize + 1);
+					hashinsert_s(rel->oIndex, &(hTuple.t_self), trimedDatum, datumSize + 1);
 		}
-		else if (oIndex->indexOid == F_BTHANDLER)
+		else if (rel->oIndex->indexOid == F_BTHANDLER)
 		{
-			btinsert_s(oIndex, oTable, &(hTuple->t_self), trimedDatum, datumSize + 1);
+			btinsert_s(rel->oIndex, rel->oTable, &(hTuple.t_self), trimedDatum,
+					   keycmp_is_string(&rel->oIndex->tDesc->attrs[0]) ? datumSize + 1 : datumSize);
 		}
+		soe_mutex_unlock(&rel->ilock);
+		soe_mutex_unlock(&rel->tlock);
 
 	}
 	else
@@ -241,142 +572,679 @@ insert(const char *heapTuple, unsigned int tupleSize, char *datum,
 		selog(WARNING, "Can't insert tuple of size %d", tupleSize);
 	}
 
-	free(hTuple);
-	free(trimedDatum);
+	releaseRelation();
 }
 
 
 
 void
-addIndexBlock(char *block, unsigned int blocksize, unsigned int offset, 
-              unsigned int level)
+addIndexBlock(int handle, char *block, unsigned int blocksize,
+              unsigned int offset, unsigned int level)
 {
+	SOERelation rel = getRelation(handle);
 
 	//selog(DEBUG1, "Going to add index block %d at level %d", offset, level);
+    if(rel == NULL){
+        return;
+    }
+	COUNTERS_ECALL(SOE_STATS_LOAD);
     
-    if(mode == DYNAMIC){
-        btree_load_s(oIndex, block, level, offset);
+    soe_mutex_lock(&rel->ilock);
+    if(rel->mode == DYNAMIC){
+        btree_load_s(rel->oIndex, block, level, offset);
     }else{
-        insert_ost(ostIndex, block, level, offset);
+        insert_ost(rel->ostIndex, block, level, offset);
     }
+    soe_mutex_unlock(&rel->ilock);
+    releaseRelation();
 }
 
+/*
+ * Loads nblocks consecutive pages of a tree level, starting at the level
+ * block offset, in a single call.
+ */
 void
-addHeapBlock(char *block, unsigned int blockSize, unsigned int blkno)
+addIndexLevel(int handle, char *blocks, unsigned int blocksSize,
+              unsigned int nblocks, unsigned int offset, unsigned int level)
 {
-	heap_insert_block_s(oTable, block, blkno);
+	SOERelation rel = getRelation(handle);
+
+    if(rel == NULL){
+        return;
+    }
+	COUNTERS_ECALL(SOE_STATS_LOAD);
+
+    if(blocksSize != nblocks * BLCKSZ){
+        selog(ERROR, "Index blocks size %d does not match %d blocks", blocksSize, nblocks);
+        releaseRelation();
+        return;
+    }
+
+    soe_mutex_lock(&rel->ilock);
+    if(rel->mode == DYNAMIC){
+        btree_load_level_s(rel->oIndex, blocks, nblocks, level, offset);
+    }else{
+        insert_level_ost(rel->ostIndex, blocks, nblocks, level, offset);
+    }
+    soe_mutex_unlock(&rel->ilock);
+    releaseRelation();
 }
 
-int
-getTuple(unsigned int opmode, unsigned int opoid, const char *key, 
-         int scanKeySize, char *tuple, unsigned int tupleLen, 
-         char *tupleData, unsigned int tupleDataLen)
+void
+addHeapBlock(int handle, char *block, unsigned int blockSize,
+             unsigned int blkno)
 {
+	SOERelation rel = getRelation(handle);
 
+	if (rel == NULL)
+	{
+		return;
+	}
+	COUNTERS_ECALL(SOE_STATS_LOAD);
+	soe_mutex_lock(&rel->tlock);
+	heap_insert_block_s(rel->oTable, block, blkno);
+	soe_mutex_unlock(&rel->tlock);
+	releaseRelation();
+}
 
-	HeapTuple	heapTuple;
-	ItemPointerData tid;
-    ItemPointer dtid;
-	int			hasNext;
-	char	   *trimedKey;
-    bool        matchFound  = false;
-
-    heapTuple = (HeapTuple) malloc(sizeof(HeapTupleData));
-	hasNext = 0;
-    
-     /* FOREST_ORAM MODE: Table strings in the index do not have
-      * the \0 terminator*/
+void
+addHeapBlocks(int handle, char *blocks, unsigned int blocksSize,
+              unsigned int nblocks, unsigned int blkno)
+{
+	SOERelation rel = getRelation(handle);
 
-    trimedKey = (char *) malloc(scanKeySize + 1);
-    memcpy(trimedKey, key, scanKeySize);
-	trimedKey[scanKeySize] = '\0';
-    
+    if(rel == NULL){
+        return;
+    }
+	COUNTERS_ECALL(SOE_STATS_LOAD);
 
-    //Stop everything. Resources have to be freed correctly.
-    if(strcmp(key, "HALT")==0){
-        selog(DEBUG1, "Received Halt signal from client");
-        free(trimedKey);
-        return 1;
+    if(blocksSize != nblocks * BLCKSZ){
+        selog(ERROR, "Heap blocks size %d does not match %d blocks", blocksSize, nblocks);
+        releaseRelation();
+        return;
     }
+	soe_mutex_lock(&rel->tlock);
+	heap_insert_blocks_s(rel->oTable, blocks, nblocks, blkno);
+	soe_mutex_unlock(&rel->tlock);
+	releaseRelation();
+}
+
+/* Outcome of fetching the next tuple of the current index scan. */
+#define FETCH_TUPLE 0			/* tuple fetched, scan continues */
+#define FETCH_DUMMY 1			/* dummy tuple read, scan continues */
+#define FETCH_LAST	2			/* dummy tuple read, scan is complete */
+#define FETCH_DONE	3			/* no tuple fetched, scan is complete */
 
+/*
+ * Advances the index scan of session on rel, starting a new one for key if
+ * the session has no scan in progress, and reads the matching heap tuple
+ * into heapTuple. heap_gettuple_s copies the tuple data from the pinned heap
+ * page to data, which holds up to dataLen bytes, and leaves t_data NULL if
+ * the tuple does not fit.
+ *
+ * With DUMMYS, the steps of the scan without a result read tuple (0,1) to
+ * keep the table accesses the same, and return FETCH_DUMMY or FETCH_LAST.
+ * That tuple is read to enclave memory, or to dummyData for a step that
+ * does not end the scan if dummyData is not NULL.
+ *
+ * The index and the table are locked one after the other, so a thread can
+ * read the table while another one advances its scan on the index.
+ */
+static int
+fetchTuple(SOERelation rel, int session, unsigned int opoid, const char *key,
+           int scanKeySize, HeapTuple heapTuple, char *data, Size dataLen,
+           char *dummyData)
+{
+	ItemPointerData tid;
+	char	   *trimedKey;
+	int			keySize;
+    bool        matchFound  = false;
+    IndexScanDesc scan;
+    TupleDesc   iDesc;
+
+    soe_mutex_lock(&rel->ilock);
+    scan = rel->scans[session];
     if(scan == NULL){
+        /* FOREST_ORAM MODE: Table strings in the index do not have
+         * the \0 terminator*/
+        trimedKey = (char *) request_alloc(scanKeySize + 1);
+        memcpy(trimedKey, key, scanKeySize);
+        trimedKey[scanKeySize] = '\0';
+
+        /* Only string keys are compared with their terminator. */
+        iDesc = rel->mode == DYNAMIC ? rel->oIndex->tDesc : rel->ostIndex->tDesc;
+        keySize = keycmp_is_string(&iDesc->attrs[0]) ? scanKeySize + 1 : scanKeySize;
+
+        if(rel->scanArenas[session] == NULL){
+            rel->scanArenas[session] = arena_create();
+        }
+
         /*Old request is complete. Start new input request*/
-        if(mode == DYNAMIC){
-            scan = btbeginscan_s(oIndex, trimedKey, scanKeySize + 1);
+        if(rel->mode == DYNAMIC){
+            scan = btbeginscan_s(rel->oIndex, trimedKey, keySize, rel->scanArenas[session]);
         }else{
-		    scan = btbeginscan_ost(ostIndex, trimedKey, scanKeySize + 1);
+		    scan = btbeginscan_ost(rel->ostIndex, trimedKey, keySize, rel->scanArenas[session]);
         }
-        scan->opoid = opoid;
+        /* The scans work with the operators of bpchar keys. */
+        scan->opoid = keycmp_strategy(opoid);
+        setSessionScan(rel, session, scan);
     }
 
-    matchFound = mode == DYNAMIC? btgettuple_s(scan): btgettuple_ost(scan);
+    matchFound = rel->mode == DYNAMIC? btgettuple_s(scan): btgettuple_ost(scan);
+    if(matchFound){
+        tid = scan->xs_ctup.t_self;
+    }else{
+        rel->mode == DYNAMIC ? btendscan_s(scan) : btendscan_ost(scan);
+        setSessionScan(rel, session, NULL);
+    }
+    soe_mutex_unlock(&rel->ilock);
+
+    soe_mutex_lock(&rel->tlock);
     #ifdef STASH_COUNT
-        counter +=1;
-        if(counter%1000==0){
-            logStashes(oTable->oram);
+        if(__atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED)%1000==0){
+            if(rel->oTable->parts == NULL){
+                logStashes(rel->oTable->oram);
+            }else{
+                for(int p = 0; p < rel->oTable->parts->npartitions; p++){
+                    logStashes(rel->oTable->parts->orams[p]);
+                }
+            }
         }
     #endif
-    if(matchFound){
+    if(matchFound && ItemPointerIsValid_s(&tid)){
         //Normal case
-        if(ItemPointerIsValid_s(&scan->xs_ctup.t_self)){
-             tid = scan->xs_ctup.t_self;
-             heap_gettuple_s(oTable, &tid, heapTuple);
-        }
-         
-     #ifdef DUMMYS
+        heap_gettuple_s(rel->oTable, &tid, heapTuple, data, dataLen);
+        soe_mutex_unlock(&rel->tlock);
+        return FETCH_TUPLE;
+    }
+
+    #ifdef DUMMYS
         //When dummys are being used and current index does not have a result,
-        //but there are still right leafs to iterate.
-        if(!ItemPointerIsValid_s(&scan->xs_ctup.t_self)){
-            dtid = (ItemPointer) malloc(sizeof(struct ItemPointerData));
-            ItemPointerSet_s(dtid, 0, 1);
-            heap_gettuple_s(oTable, dtid, heapTuple);
-            free(dtid);
+        //whether or not there are still right leafs to iterate.
+        ItemPointerSet_s(&tid, 0, 1);
+        if(matchFound && dummyData != NULL){
+            heap_gettuple_s(rel->oTable, &tid, heapTuple, dummyData, dataLen);
+        }else{
+            heap_gettuple_s(rel->oTable, &tid, heapTuple,
+                            (char *) request_alloc(MAX_TUPLE_SIZE), MAX_TUPLE_SIZE);
         }
-     #endif
+        soe_mutex_unlock(&rel->tlock);
+        return matchFound ? FETCH_DUMMY : FETCH_LAST;
+    #else
+        heapTuple->t_data = NULL;
+        soe_mutex_unlock(&rel->tlock);
+        return matchFound ? FETCH_DUMMY : FETCH_DONE;
+    #endif
+}
 
-    }else{
-        mode == DYNAMIC ? btendscan_s(scan) : btendscan_ost(scan);
-        scan = NULL;
-
-        #ifdef DUMMYS
-            dtid = (ItemPointer) malloc(sizeof(struct ItemPointerData));
-            ItemPointerSet_s(dtid, 0, 1);
-            heap_gettuple_s(oTable, dtid, heapTuple);
-            free(dtid);
-        #else
-            free(heapTuple);
-            free(trimedKey);
-            return 1;
-        #endif
-    }
+/* Ends the scan of session on rel, if it has one in progress. */
+static void
+endSessionScan(SOERelation rel, int session)
+{
+	IndexScanDesc scan;
 
+	soe_mutex_lock(&rel->ilock);
+	scan = rel->scans[session];
+	if (scan != NULL)
+	{
+		rel->mode == DYNAMIC ? btendscan_s(scan) : btendscan_ost(scan);
+		setSessionScan(rel, session, NULL);
+	}
+	soe_mutex_unlock(&rel->ilock);
+}
 
-    if (heapTuple->t_len > MAX_TUPLE_SIZE){
-		    selog(ERROR, "Tuple len does not match %d != %d", tupleDataLen, heapTuple->t_len);
-	}else{
-		memcpy(tuple, (char *) heapTuple, sizeof(HeapTupleData));
-		memcpy(tupleData, (char *) (heapTuple->t_data), (heapTuple->t_len));
+/*
+ * Checks that buffer, an output buffer of an ECALL that is passed with
+ * user_check, is not NULL and lies outside of the enclave, so the results
+ * can be written to it without a copy on the trusted side.
+ */
+static bool
+outputBufferValid(const void *buffer, size_t len)
+{
+	if (buffer == NULL)
+	{
+		return false;
 	}
-    
-    free(trimedKey);
-    free(heapTuple->t_data);
-    free(heapTuple);
+#ifndef UNSAFE
+	if (!sgx_is_outside_enclave(buffer, len))
+	{
+		return false;
+	}
+#endif
+	return true;
+}
+
+/*
+ * Fetches the next result of the scan on key. The tuple data is copied once,
+ * from the pinned heap page to tupleData, and its HeapTupleData header, with
+ * t_data pointing at tupleData, is written to tuple.
+ *
+ * Returns 0 with a result, 1 when the scan is complete, and -1 if the tuple
+ * does not fit in tupleData, in which case the scan is ended so that a call
+ * with a larger buffer starts it again.
+ */
+int
+getTuple(int handle, unsigned int opmode, unsigned int opoid, const char *key, 
+         int scanKeySize, char *tuple, unsigned int tupleLen, 
+         char *tupleData, unsigned int tupleDataLen)
+{
+
+	HeapTupleData heapTuple;
+	int			session;
+	int			result;
+	SOERelation rel;
+
+    if(tupleLen < sizeof(HeapTupleData) || !outputBufferValid(tuple, tupleLen)
+       || !outputBufferValid(tupleData, tupleDataLen)){
+        selog(ERROR, "Invalid output buffers for getTuple");
+        return 1;
+    }
+
+	rel = getRelation(handle);
+    if(rel == NULL){
+        return 1;
+    }
+	COUNTERS_ECALL(SOE_STATS_GETTUPLE);
+
+    session = getSession();
+    if(session < 0){
+        releaseRelation();
+        return 1;
+    }
+
+    //Stop everything. Resources have to be freed correctly.
+    if(strcmp(key, "HALT")==0){
+        selog(DEBUG1, "Received Halt signal from client");
+        endSessionScan(rel, session);
+        releaseRelation();
+        return 1;
+    }
+
+    /*
+     * With DUMMYS, the steps without a result in the middle of the scan
+     * return the dummy tuple, as before. Without them such a step has
+     * nothing to return, so the scan moves on to the next one. The step
+     * that ends the scan returns 1.
+     */
+    do{
+        result = fetchTuple(rel, session, opoid, key, scanKeySize, &heapTuple,
+                            tupleData, Min_s(tupleDataLen, MAX_TUPLE_SIZE), tupleData);
+    }while(result == FETCH_DUMMY && heapTuple.t_data == NULL);
+
+    if(result == FETCH_DONE || result == FETCH_LAST){
+        releaseRelation();
+        return 1;
+    }
+
+    if(heapTuple.t_data == NULL){
+        selog(ERROR, "Tuple of %u bytes does not fit in %u bytes", heapTuple.t_len, tupleDataLen);
+        endSessionScan(rel, session);
+        releaseRelation();
+        return -1;
+    }
+
+    memcpy(tuple, (char *) &heapTuple, sizeof(HeapTupleData));
+    releaseRelation();
     return 0;
 }
 
+/*
+ * Ends the scan of the calling thread on handle before all its results
+ * have been fetched, so that the next getTuple or getTuples starts a new
+ * scan.
+ */
+void
+endScan(int handle)
+{
+	int			session;
+	SOERelation rel;
+
+	rel = getRelation(handle);
+	if (rel == NULL)
+	{
+		return;
+	}
+	COUNTERS_ECALL(SOE_STATS_ENDSCAN);
+
+	session = getSession();
+	if (session < 0)
+	{
+		releaseRelation();
+		return;
+	}
+
+	endSessionScan(rel, session);
+	releaseRelation();
+}
+
+/*
+ * Copies the counters of handle, the totals of all relations if handle is
+ * SOE_STATS_ALL, or the counters of an ECALL on all relations if it is
+ * SOE_STATS_ECALL(ecall), to stats as a SOEStats struct, and resets them if
+ * reset is set. Returns 0, or -1 if the handle is not valid or stats is too
+ * small.
+ */
+int
+getStats(int handle, char *stats, unsigned int statsSize, int reset)
+{
+	SOEStats   *counters;
+
+	if (statsSize < sizeof(SOEStats))
+	{
+		selog(ERROR, "Stats buffer of %u bytes is smaller than %zu", statsSize,
+			  sizeof(SOEStats));
+		return -1;
+	}
+
+	if (handle == SOE_STATS_ALL)
+	{
+		counters_copy((SOEStats *) stats, &counters_total);
+		if (reset)
+		{
+			counters_reset(&counters_total);
+		}
+		return 0;
+	}
+
+	if (handle < SOE_STATS_ALL)
+	{
+		if (handle < SOE_STATS_ECALL(SOE_STATS_NECALLS - 1))
+		{
+			selog(ERROR, "Invalid stats handle %d", handle);
+			return -1;
+		}
+		counters = &counters_ecalls[SOE_STATS_ECALL(0) - handle];
+		counters_copy((SOEStats *) stats, counters);
+		if (reset)
+		{
+			counters_reset(counters);
+		}
+		return 0;
+	}
 
+	if (getRelation(handle) == NULL)
+	{
+		return -1;
+	}
+	counters = &relations[handle].stats;
+	counters_copy((SOEStats *) stats, counters);
+	if (reset)
+	{
+		counters_reset(counters);
+	}
+	releaseRelation();
+
+	return 0;
+}
+
+/*
+ * Sets the lowest level of the messages logged by the enclave. Levels under
+ * the LOG_MIN_LEVEL the enclave was built with stay disabled.
+ */
 void
-insertHeap(const char *heapTuple, unsigned int tupleSize)
+setLogLevel(int level)
+{
+	selog_set_level(level);
+}
+
+/*
+ * Batched version of getTuple. Fetches as many results of the scan on key as
+ * fit in the tuples buffer, up to maxTuples, in a single call. Each result is
+ * stored at a MAXALIGN'ed position of the buffer as a HeapTupleData header
+ * immediately followed by the t_len bytes of the tuple data, and its position
+ * is written to offsets. The number of results is written to nTuples. With
+ * DUMMYS, the steps of the scan without a result are taken too, but they
+ * add nothing to the buffer.
+ *
+ * Like getTuple, the tuple data is copied from the pinned heap page straight
+ * to the buffer. It returns 1 when the scan is complete, or ended by a HALT
+ * key, and 0 when there may be more results to fetch with a following call.
+ * It returns -1 if the arguments are not valid, which includes a buffer that
+ * can't hold a tuple of MAX_TUPLE_SIZE bytes and a maxTuples of 0, as no
+ * call would make progress with them.
+ */
+int
+getTuples(int handle, unsigned int opmode, unsigned int opoid,
+          const char *key, int scanKeySize, char *tuples,
+          unsigned int tuplesLen, unsigned int *offsets,
+          unsigned int maxTuples, unsigned int *nTuples)
 {
+	HeapTupleData heapTuple;
+	unsigned int toffset = 0;
+	unsigned int ntuples = 0;
+	int			result = FETCH_TUPLE;
+	int			session;
+	SOERelation rel;
+
+	*nTuples = 0;
+	if (!outputBufferValid(tuples, tuplesLen))
+	{
+		selog(ERROR, "Invalid output buffer for getTuples");
+		return -1;
+	}
+
+	if (tuplesLen < sizeof(HeapTupleData) + MAX_TUPLE_SIZE || maxTuples == 0)
+	{
+		selog(ERROR, "getTuples needs room for a tuple of %d bytes, got %u bytes for %u tuples",
+			  MAX_TUPLE_SIZE, tuplesLen, maxTuples);
+		return -1;
+	}
 
-	HeapTuple	hTuple = (HeapTuple) malloc(sizeof(HeapTupleData));
+	rel = getRelation(handle);
+	if (rel == NULL)
+	{
+		return -1;
+	}
+	COUNTERS_ECALL(SOE_STATS_GETTUPLES);
 
+	session = getSession();
+	if (session < 0)
+	{
+		releaseRelation();
+		return -1;
+	}
 
+	/* As in getTuple, stop the scan in progress. */
+	if (strnlen(key, scanKeySize) == 4 && strncmp(key, "HALT", 4) == 0)
+	{
+		selog(DEBUG1, "Received Halt signal from client");
+		endSessionScan(rel, session);
+		releaseRelation();
+		return 1;
+	}
+
+	/*
+	 * Only fetch a new tuple while the largest possible tuple still fits in
+	 * the buffer, as the scan can't return a tuple once it has been fetched.
+	 */
+	while ((result == FETCH_TUPLE || result == FETCH_DUMMY) && ntuples < maxTuples
+		   && toffset + sizeof(HeapTupleData) + MAX_TUPLE_SIZE <= tuplesLen)
+	{
+		result = fetchTuple(rel, session, opoid, key, scanKeySize, &heapTuple,
+							tuples + toffset + sizeof(HeapTupleData),
+							MAX_TUPLE_SIZE, NULL);
+
+		if (result != FETCH_TUPLE)
+		{
+			continue;
+		}
+
+		if (heapTuple.t_data == NULL)
+		{
+			selog(ERROR, "Tuple len is larger than max tuple size %d", heapTuple.t_len);
+		}
+		else
+		{
+			memcpy(tuples + toffset, (char *) &heapTuple, sizeof(HeapTupleData));
+			offsets[ntuples] = toffset;
+			ntuples++;
+			toffset += MAXALIGN_s(sizeof(HeapTupleData) + heapTuple.t_len);
+		}
+	}
+
+	*nTuples = ntuples;
+	releaseRelation();
+
+	return result == FETCH_TUPLE || result == FETCH_DUMMY ? 0 : 1;
+}
+
+
+/*
+ * Looks up nkeys keys at once, as an equality search of each. The keys are
+ * stored one after the other in keys, the i-th one with keySizes[i] bytes.
+ * The index is searched for all the keys together, so that each tree page
+ * on their paths is read once, see _bt_search_batch_s. Then the tuple of
+ * every key is read from the table.
+ *
+ * The results are stored in tuples as in getTuples, and offsets[i] is set
+ * to the position of the result of the i-th key, to BATCH_NO_TUPLE if the
+ * key has no match, or to BATCH_NO_ROOM if its tuple does not fit in the
+ * buffer. Returns the number of results, or -1 if the arguments are not
+ * valid.
+ */
+int
+getTuplesBatch(int handle, const char *keys, unsigned int keysSize,
+               const unsigned int *keySizes, unsigned int nkeys, char *tuples,
+               unsigned int tuplesLen, unsigned int *offsets)
+{
+	HeapTupleData heapTuple;
+	ItemPointer tids;
+#ifdef DUMMYS
+	/* tuple buffer of the keys without a match */
+	char	   *dummyData = NULL;
+#endif
+	const char **bkeys;
+	int		   *bkeySizes;
+	char	   *bkey;
+	Size		koffset = 0;
+	Size		toffset = 0;
+	Size		dataLen;
+	unsigned int i;
+	int			nfound = 0;
+	bool		isString;
+	bool		matched;
+	bool		fetched;
+	TupleDesc	iDesc;
+	SOERelation rel;
+
+	if (!outputBufferValid(tuples, tuplesLen))
+	{
+		selog(ERROR, "Invalid output buffer for getTuplesBatch");
+		return -1;
+	}
+
+	rel = getRelation(handle);
+	if (rel == NULL)
+	{
+		return -1;
+	}
+	COUNTERS_ECALL(SOE_STATS_GETTUPLESBATCH);
+
+	/*
+	 * As in fetchTuple, the keys are terminated and only string keys are
+	 * compared with their terminator.
+	 */
+	iDesc = rel->mode == DYNAMIC ? rel->oIndex->tDesc : rel->ostIndex->tDesc;
+	isString = keycmp_is_string(&iDesc->attrs[0]);
+	bkeys = (const char **) request_alloc(sizeof(char *) * nkeys);
+	bkeySizes = (int *) request_alloc(sizeof(int) * nkeys);
+	tids = (ItemPointer) request_alloc(sizeof(ItemPointerData) * nkeys);
+
+	for (i = 0; i < nkeys; i++)
+	{
+		if (keySizes[i] > keysSize - koffset)
+		{
+			selog(ERROR, "Keys of getTuplesBatch are larger than %u bytes", keysSize);
+			releaseRelation();
+			return -1;
+		}
+		bkey = (char *) request_alloc(keySizes[i] + 1);
+		memcpy(bkey, keys + koffset, keySizes[i]);
+		bkey[keySizes[i]] = '\0';
+		bkeys[i] = bkey;
+		bkeySizes[i] = isString ? keySizes[i] + 1 : keySizes[i];
+		koffset += keySizes[i];
+		offsets[i] = BATCH_NO_TUPLE;
+	}
+
+	soe_mutex_lock(&rel->ilock);
+	if (rel->mode == DYNAMIC)
+	{
+		btgetbatch_s(rel->oIndex, bkeys, bkeySizes, nkeys, tids);
+	}
+	else
+	{
+		btgetbatch_ost(rel->ostIndex, bkeys, bkeySizes, nkeys, tids);
+	}
+	soe_mutex_unlock(&rel->ilock);
+
+	soe_mutex_lock(&rel->tlock);
+	for (i = 0; i < nkeys; i++)
+	{
+		matched = ItemPointerIsValid_s(&tids[i]);
+		if (!matched)
+		{
+#ifdef DUMMYS
+			/*
+			 * A key without a match reads a tuple too, into enclave memory
+			 * so that it is not seen by the host.
+			 */
+			if (dummyData == NULL)
+			{
+				dummyData = (char *) request_alloc(MAX_TUPLE_SIZE);
+			}
+			ItemPointerSet_s(&tids[i], 0, 1);
+			heap_gettuple_s(rel->oTable, &tids[i], &heapTuple, dummyData, MAX_TUPLE_SIZE);
+#endif
+			continue;
+		}
+
+		/* The table is read even if the tuple does not fit. */
+		dataLen = toffset + sizeof(HeapTupleData) < tuplesLen ?
+			tuplesLen - toffset - sizeof(HeapTupleData) : 0;
+		fetched = heap_gettuple_s(rel->oTable, &tids[i], &heapTuple,
+								  tuples + Min_s(toffset + sizeof(HeapTupleData), tuplesLen),
+								  Min_s(dataLen, MAX_TUPLE_SIZE));
+		if (!fetched)
+		{
+			selog(DEBUG1, "Tuple of %u bytes does not fit in the getTuplesBatch buffer",
+				  heapTuple.t_len);
+			offsets[i] = BATCH_NO_ROOM;
+			continue;
+		}
+
+		memcpy(tuples + toffset, (char *) &heapTuple, sizeof(HeapTupleData));
+		offsets[i] = toffset;
+		toffset += MAXALIGN_s(sizeof(HeapTupleData) + heapTuple.t_len);
+		nfound++;
+	}
+	soe_mutex_unlock(&rel->tlock);
+
+	releaseRelation();
+
+	return nfound;
+}
+
+
+void
+insertHeap(int handle, const char *heapTuple, unsigned int tupleSize)
+{
+	SOERelation rel = getRelation(handle);
+
+	if (rel == NULL)
+	{
+		return;
+	}
+	COUNTERS_ECALL(SOE_STATS_INSERT);
+
+	HeapTupleData hTuple;
 	Item		tuple = (Item) heapTuple;
 
 	if (tupleSize <= MAX_TUPLE_SIZE)
 	{
-		heap_insert_s(oTable, tuple, (uint32) tupleSize, hTuple);
+		soe_mutex_lock(&rel->tlock);
+		heap_insert_s(rel->oTable, tuple, (uint32) tupleSize, &hTuple);
+		soe_mutex_unlock(&rel->tlock);
 
 	}
 	else
@@ -384,29 +1252,123 @@ insertHeap(const char *heapTuple, unsigned int tupleSize)
 		selog(WARNING, "Can't insert tuple of size %d", tupleSize);
 	}
 
-	free(hTuple);
+	releaseRelation();
 
 }
 
 
+/*
+ * Sends the page I/O of the ORAMs through a request ring in untrusted
+ * memory, served by an untrusted thread, instead of one OCALL per block.
+ * The ring must be served by soe_ring_serve until closeSoe returns. In
+ * UNSAFE builds a NULL ring starts a local worker thread.
+ */
 void
-closeSoe()
+initRing(void *ring)
 {
-	selog(DEBUG1, "Going to close soe");
-	closeVRelation(oTable);
-    if(mode == DYNAMIC){
-    	if(scan != NULL){
-			btendscan_s(scan);
-    	}
-	    closeVRelation(oIndex);
+#ifdef UNSAFE
+	if (ring == NULL)
+	{
+		oring = soe_ring_start();
+		ring = oring;
+	}
+#endif
+	vofile_set_ring(ring);
+}
+
+/*
+ * Runs the accesses to the partitions of partitioned heaps requested by
+ * other threads, so that they are done in parallel. Returns when closeSoe
+ * is called.
+ */
+void
+runWorker(void)
+{
+	partition_worker_run();
+}
+
+/*
+ * Closes the table, the index and the scans of rel. The caller holds
+ * relations_lock exclusively, so no other thread is using the relation.
+ */
+static void
+freeRelation(SOERelation rel)
+{
+	int			session;
+
+	closeVRelation(rel->oTable);
+	for (session = 0; session < MAX_SESSIONS; session++)
+	{
+		if (rel->scans[session] != NULL)
+		{
+			rel->mode == DYNAMIC ? btendscan_s(rel->scans[session]) : btendscan_ost(rel->scans[session]);
+			setSessionScan(rel, session, NULL);
+		}
+		if (rel->scanArenas[session] != NULL)
+		{
+			arena_destroy(rel->scanArenas[session]);
+		}
+	}
+    if(rel->mode == DYNAMIC){
+	    closeVRelation(rel->oIndex);
     }else{
-    	if(scan != NULL){
-    		btendscan_ost(scan);
-    	}
-        closeOSTRelation(ostIndex);
+        closeOSTRelation(rel->ostIndex);
     } 
-	free(tamgr);
-	free(iamgr);
+	free(rel->tamgr);
+	free(rel->iamgr);
+	soe_mutex_destroy(&rel->tlock);
+	soe_mutex_destroy(&rel->ilock);
+	rel->inuse = false;
+}
+
+/*
+ * Closes the table and index of handle. The handle can be reused by a later
+ * initSOE or initFSOE.
+ */
+void
+closeRelation(int handle)
+{
+	soe_rwlock_wrlock(&relations_lock);
+	if (handle < 0 || handle >= MAX_RELATIONS || !relations[handle].inuse)
+	{
+		soe_rwlock_wrunlock(&relations_lock);
+		selog(ERROR, "Invalid relation handle %d", handle);
+		return;
+	}
+
+	selog(DEBUG1, "Going to close relation %d", handle);
+	freeRelation(&relations[handle]);
+	vofile_flush();
+	soe_rwlock_wrunlock(&relations_lock);
+	selog_flush();
+}
+
+void
+closeSoe()
+{
+	int			handle;
+
+	selog(DEBUG1, "Going to close soe");
+	soe_rwlock_wrlock(&relations_lock);
+	for (handle = 0; handle < MAX_RELATIONS; handle++)
+	{
+		if (relations[handle].inuse)
+		{
+			freeRelation(&relations[handle]);
+		}
+	}
+	soe_rwlock_wrunlock(&relations_lock);
+	partition_workers_stop();
+	vofile_close();
+#ifdef UNSAFE
+	if (oring != NULL)
+	{
+		soe_ring_stop(oring);
+		oring = NULL;
+	}
+#endif
+	page_crypto_close();
+	selog_flush();
 }
 
 /*
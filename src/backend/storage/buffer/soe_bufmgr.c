@@ -1,10 +1,13 @@
 #include "storage/soe_bufmgr.h"
 #include "access/soe_skey.h"
+#include "access/soe_abbrev.h"
 #include "logger/logger.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_pagepool.h"
+#include "utils/soe_counters.h"
 /* #include "storage/soe_heap_ofile.h" */
 
 #include <stdlib.h>
-#include <collectc/list.h>
 
 
 /* zero index block */
@@ -16,13 +19,278 @@ NumberOfBlocks_s(VRelation rel)
 }
 
 
+/*
+ * Slot of the buffer table where the search for a block number starts.
+ */
+static inline int
+vbuffer_hash(VBufferTable * table, int id)
+{
+	return (int) (((uint32) id * 2654435761U) & (table->nslots - 1));
+}
+
+/* Puts descriptors first to ndescs - 1 on the free list. */
+static void
+vbuffer_init_descs(VBufferTable * table, int first)
+{
+	int			offset;
+
+	for (offset = first; offset < table->ndescs; offset++)
+	{
+		table->descs[offset].id = DUMMY_BLOCK;
+		table->descs[offset].page = NULL;
+		table->descs[offset].refcount = 0;
+		table->descs[offset].freeNext = offset + 1;
+	}
+	table->descs[table->ndescs - 1].freeNext = table->freeList;
+	table->freeList = first;
+}
+
+static VBufferTable *
+vbuffer_create(void)
+{
+	int			offset;
+	VBufferTable *table = (VBufferTable *) malloc(sizeof(VBufferTable));
+
+	table->ndescs = VBUFFER_POOL_SIZE;
+	table->nslots = VBUFFER_SLOTS;
+	table->descs = (struct VBlock *) malloc(sizeof(struct VBlock) * table->ndescs);
+	table->slots = (int *) malloc(sizeof(int) * table->nslots);
+
+	for (offset = 0; offset < table->nslots; offset++)
+	{
+		table->slots[offset] = VBUFFER_NOSLOT;
+	}
+
+	table->freeList = VBUFFER_NOSLOT;
+	table->nused = 0;
+	vbuffer_init_descs(table, 0);
+
+	return table;
+}
+
+static void
+vbuffer_destroy(VBufferTable * table)
+{
+	free(table->descs);
+	free(table->slots);
+	free(table);
+}
+
+/*
+ * Returns the index slot that holds block id or the empty slot that ends its
+ * probe sequence.
+ */
+static inline int
+vbuffer_probe(VBufferTable * table, int id)
+{
+	int			slot = vbuffer_hash(table, id);
+
+	while (table->slots[slot] != VBUFFER_NOSLOT
+		   && table->descs[table->slots[slot]].id != id)
+	{
+		slot = (slot + 1) & (table->nslots - 1);
+	}
+
+	return slot;
+}
+
+static inline VBlock
+vbuffer_lookup(VBufferTable * table, int id)
+{
+	int			slot = vbuffer_probe(table, id);
+
+	if (table->slots[slot] == VBUFFER_NOSLOT)
+	{
+		return NULL;
+	}
+
+	return &table->descs[table->slots[slot]];
+}
+
+/*
+ * Doubles the descriptors and the index of a table whose descriptors are
+ * all pinned, and indexes the pinned blocks again. Returns false, leaving
+ * the table as it was, if the memory can't be allocated. Descriptors move,
+ * so VBlocks looked up before are no longer valid.
+ */
+static bool
+vbuffer_grow(VBufferTable * table)
+{
+	struct VBlock *descs;
+	int		   *slots;
+	int			ndescs = table->ndescs * 2;
+	int			nslots = table->nslots * 2;
+	int			offset;
+
+	descs = (struct VBlock *) realloc(table->descs, sizeof(struct VBlock) * ndescs);
+	if (descs == NULL)
+	{
+		return false;
+	}
+	table->descs = descs;
+
+	slots = (int *) malloc(sizeof(int) * nslots);
+	if (slots == NULL)
+	{
+		return false;
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->nslots = nslots;
+
+	for (offset = 0; offset < nslots; offset++)
+	{
+		table->slots[offset] = VBUFFER_NOSLOT;
+	}
+	for (offset = 0; offset < table->ndescs; offset++)
+	{
+		if (table->descs[offset].refcount > 0)
+		{
+			table->slots[vbuffer_probe(table, table->descs[offset].id)] = offset;
+		}
+	}
+
+	offset = table->ndescs;
+	table->ndescs = ndescs;
+	vbuffer_init_descs(table, offset);
+
+	return true;
+}
+
+/*
+ * Pins block id on page with a new descriptor. Returns NULL if the table is
+ * full and can't grow.
+ */
+static VBlock
+vbuffer_insert(VBufferTable * table, int id, char *page)
+{
+	int			slot;
+	int			desc;
+	VBlock		vblock;
+
+	if (table->freeList == VBUFFER_NOSLOT && !vbuffer_grow(table))
+	{
+		return NULL;
+	}
+
+	desc = table->freeList;
+	vblock = &table->descs[desc];
+	table->freeList = vblock->freeNext;
+
+	vblock->id = id;
+	vblock->page = page;
+	vblock->refcount = 1;
+	vblock->freeNext = VBUFFER_NOSLOT;
+
+	slot = vbuffer_probe(table, id);
+	table->slots[slot] = desc;
+	table->nused++;
+
+	return vblock;
+}
+
+/*
+ * Removes the descriptor of block id from the index and returns it to the
+ * free list. The entries that follow the removed slot on the same probe
+ * sequence are shifted back, so no tombstones are needed.
+ */
+static void
+vbuffer_remove(VBufferTable * table, int id)
+{
+	int			hole = vbuffer_probe(table, id);
+	int			slot;
+	int			home;
+	int			desc = table->slots[hole];
+
+	if (desc == VBUFFER_NOSLOT)
+	{
+		return;
+	}
+
+	slot = hole;
+	for (;;)
+	{
+		slot = (slot + 1) & (table->nslots - 1);
+		if (table->slots[slot] == VBUFFER_NOSLOT)
+		{
+			break;
+		}
+
+		home = vbuffer_hash(table, table->descs[table->slots[slot]].id);
+
+		/* Move the entry back if its home slot is not in (hole, slot]. */
+		if ((slot > hole && (home <= hole || home > slot))
+			|| (slot < hole && (home <= hole && home > slot)))
+		{
+			table->slots[hole] = table->slots[slot];
+			hole = slot;
+		}
+	}
+	table->slots[hole] = VBUFFER_NOSLOT;
+
+	table->descs[desc].id = DUMMY_BLOCK;
+	table->descs[desc].page = NULL;
+	table->descs[desc].refcount = 0;
+	table->descs[desc].freeNext = table->freeList;
+	table->freeList = desc;
+	table->nused--;
+}
+
+
+/*
+ * Reads and writes a block on the ORAM of the relation or on its
+ * partitions.
+ */
+static inline int
+vrelation_read(VRelation relation, char **page, BlockNumber blkno)
+{
+	if (relation->parts != NULL)
+	{
+		return partition_read(relation->parts, page, blkno);
+	}
+	COUNTERS_INC(oramReads);
+	return read_oram(page, blkno, relation->oram, relation->appData);
+}
+
+static inline int
+vrelation_write(VRelation relation, char *page, BlockNumber blkno)
+{
+	if (relation->parts != NULL)
+	{
+		return partition_write(relation->parts, page, blkno);
+	}
+	COUNTERS_INC(oramWrites);
+	return write_oram(page, BLCKSZ, blkno, relation->oram, relation->appData);
+}
+
+/* Updates the cached copy of blkno, if blkno is on a cached level. */
+static void
+vcache_write(VRelation relation, BlockNumber blkno, const char *page)
+{
+	if (blkno >= relation->cachedBlocks)
+	{
+		return;
+	}
+
+	if (relation->cache[blkno] == NULL)
+	{
+		relation->cache[blkno] = (char *) malloc(BLCKSZ);
+	}
+	memcpy(relation->cache[blkno], page, BLCKSZ);
+	free(relation->abbrevs[blkno]);
+	relation->abbrevs[blkno] = NULL;
+}
+
 VRelation
-InitVRelation(ORAMState relstate, unsigned int oid, int total_blocks, pageinit_function pg_f)
+InitVRelation(ORAMState relstate, void *appData, unsigned int oid, int total_blocks,
+			  pageinit_function pg_f)
 {
 	int			offset;
 	VRelation	vrel = (VRelation) malloc(sizeof(struct VRelation));
 
 	vrel->oram = relstate;
+	vrel->appData = appData;
+	vrel->parts = NULL;
 	vrel->rd_id = oid;
 	vrel->currentBlock = 0;
 	vrel->lastFreeBlock = 0;
@@ -34,15 +302,36 @@ InitVRelation(ORAMState relstate, unsigned int oid, int total_blocks, pageinit_f
 	{
 		vrel->fsm[offset] = 0;
 	}
-	list_new(&(vrel->buffer));
+	vrel->buffer = vbuffer_create();
 	vrel->tDesc = (TupleDesc) malloc(sizeof(struct tupleDesc));
 	vrel->tDesc->attrs = NULL;
 
     vrel->tHeight = 0;
     vrel->level = 0;
+    vrel->level_offsets = NULL;
+    vrel->nlevels = 0;
+	vrel->cachedLevels = 0;
+	vrel->cachedBlocks = 0;
+	vrel->cache = NULL;
+	vrel->abbrevs = NULL;
 	return vrel;
 }
 
+/*
+ * Keeps the nlevels upper levels of the tree, stored on the first nblocks
+ * blocks of the relation, in enclave memory. Every lookup reads these
+ * levels, so serving them from the enclave does not change what the ORAM
+ * accesses reveal.
+ */
+void
+CacheLevels_s(VRelation rel, unsigned int nlevels, BlockNumber nblocks)
+{
+	rel->cachedLevels = nlevels;
+	rel->cachedBlocks = nblocks;
+	rel->cache = (char **) calloc(nblocks, sizeof(char *));
+	rel->abbrevs = (PageAbbrevKeys * *) calloc(nblocks, sizeof(PageAbbrevKeys *));
+}
+
 
 Buffer 
 ReadDummyBuffer(VRelation relation, BlockNumber blkno){
@@ -50,7 +339,10 @@ ReadDummyBuffer(VRelation relation, BlockNumber blkno){
     #ifdef DUMMYS
     char    *page = NULL;
 
-    result = read_oram(&page, blkno, relation->oram, NULL);
+    COUNTERS_INC(dummyReads);
+    result = vrelation_read(relation, &page, blkno);
+
+    vofile_flush();
 
     free(page);
     #endif
@@ -58,12 +350,32 @@ ReadDummyBuffer(VRelation relation, BlockNumber blkno){
 }
 
 
-/**
-*
-* TODO: this function should see if the blocknumber is present on the list
-* before searching on the oram.
-*
-*/
+/*
+ * Pins page as blockNum on the relation buffer table. The table only fails
+ * to grow when the enclave is out of memory. A Buffer is its block number,
+ * so there is no value left to report the failure with, and the callers
+ * would go on with a page that is not pinned: the enclave is stopped.
+ */
+static Buffer
+vbuffer_pin(VRelation relation, BlockNumber blockNum, char *page)
+{
+	if (vbuffer_insert(relation->buffer, blockNum, page) == NULL)
+	{
+		selog(ERROR, "No free buffer descriptor to pin block %d of relation %u",
+			  blockNum, relation->rd_id);
+		abort();
+	}
+
+	return blockNum;
+}
+
+/*
+ * Pins blockNum on the relation buffer table. A block that is already
+ * pinned is served from the table and shares the same page, so it is read
+ * from the ORAM only once. Blocks of the cached tree levels are copied from
+ * the cache, and never read from the ORAM. Every block written to them is
+ * cached, so one that is not was never written.
+ */
 Buffer
 ReadBuffer_s(VRelation relation, BlockNumber blockNum)
 {
@@ -72,7 +384,39 @@ ReadBuffer_s(VRelation relation, BlockNumber blockNum)
     VBlock      block;	
 	int			result;
 
-    result = read_oram(&page, blockNum, relation->oram, NULL);
+	COUNTERS_INC(buffersPinned);
+	block = vbuffer_lookup(relation->buffer, blockNum);
+
+	if (block != NULL)
+	{
+		block->refcount++;
+#ifdef DUMMYS
+		/* Keep the number of ORAM accesses independent of the pins. */
+		if (blockNum >= relation->cachedBlocks)
+		{
+			ReadDummyBuffer(relation, blockNum);
+		}
+#endif
+		return blockNum;
+	}
+
+	if (blockNum < relation->cachedBlocks)
+	{
+		page = pagepool_alloc();
+		if (relation->cache[blockNum] != NULL)
+		{
+			memcpy(page, relation->cache[blockNum], BLCKSZ);
+		}
+		else
+		{
+			memset(page, 0, BLCKSZ);
+		}
+		return vbuffer_pin(relation, blockNum, page);
+	}
+
+    result = vrelation_read(relation, &page, blockNum);
+
+    vofile_flush();
 	
 
     /**
@@ -82,41 +426,27 @@ ReadBuffer_s(VRelation relation, BlockNumber blockNum)
      **/
 
     if (result == DUMMY_BLOCK){
-        page = (char *) malloc(BLCKSZ); 
+        page = pagepool_alloc();
         memset(page, 0, BLCKSZ);
-    } 
-
-    block = (VBlock) malloc(sizeof(struct VBlock));
-    
-  
-    block->id = blockNum;
-	block->page = page;
-	list_add(relation->buffer, block);
+    }else{
+		vcache_write(relation, blockNum, page);
+	}
 
-	return blockNum;
+	return vbuffer_pin(relation, blockNum, page);
 }
 
 
 Page
 BufferGetPage_s(VRelation relation, Buffer buffer)
 {
-	ListIter	iter;
-	VBlock		vblock;
-	void	   *element;
-
-	list_iter_init(&iter, relation->buffer);
+	VBlock		vblock = vbuffer_lookup(relation->buffer, buffer);
 
-	while (list_iter_next(&iter, &element) != CC_ITER_END)
+	if (vblock == NULL)
 	{
-		vblock = (VBlock) element;
-		if (vblock->id == buffer)
-		{
-			return vblock->page;
-		}
+		return NULL;
 	}
 
-
-	return NULL;
+	return vblock->page;
 }
 
 
@@ -125,28 +455,18 @@ MarkBufferDirty_s(VRelation relation, Buffer buffer)
 {
 
 	int			result;
-	ListIter	iter;
 	VBlock		vblock;
-	void	   *element;
-	bool		found = false;
 
 	result = 0;
 
-	list_iter_init(&iter, relation->buffer);
-
 	/* Search with virtual block with buffer */
-	while (list_iter_next(&iter, &element) != CC_ITER_END)
-	{
-		vblock = (VBlock) element;
-		if (vblock->id == buffer)
-		{
-			found = true;
-			break;
-		}
-	}
-	if (found)
+	vblock = vbuffer_lookup(relation->buffer, buffer);
+
+	if (vblock != NULL)
 	{	
-		result = write_oram(vblock->page, BLCKSZ, vblock->id, relation->oram, NULL);
+		result = vrelation_write(relation, vblock->page, vblock->id);
+		vofile_flush();
+		vcache_write(relation, vblock->id, vblock->page);
 	}
 	else
 	{
@@ -160,36 +480,54 @@ MarkBufferDirty_s(VRelation relation, Buffer buffer)
 
 }
 
+/*
+ * Writes a complete page as block blockNum of the relation without reading
+ * the block first. Used when loading pages whose previous content is
+ * irrelevant. The copy of a pinned block is also replaced so that readers
+ * see the same content as the ORAM.
+ */
+void
+WriteBlock_s(VRelation relation, BlockNumber blockNum, Page page)
+{
+	int			result;
+	VBlock		vblock;
+
+	vblock = vbuffer_lookup(relation->buffer, blockNum);
+
+	if (vblock != NULL)
+	{
+		memcpy(vblock->page, page, BLCKSZ);
+	}
+
+	result = vrelation_write(relation, page, blockNum);
+
+	vofile_flush();
+	vcache_write(relation, blockNum, page);
+
+	if (result != BLCKSZ)
+	{
+		selog(ERROR, "Write failed to write a complete page");
+	}
+}
+
 void
 ReleaseBuffer_s(VRelation relation, Buffer buffer)
 {
 
-	ListIter	iter;
 	VBlock		vblock;
-	void	   *element;
-	void	   *toFree;
-	bool		found;
-
-	found = false;
-	list_iter_init(&iter, relation->buffer);
 
 	/* Search with virtual block with buffer */
-	while (list_iter_next(&iter, &element) != CC_ITER_END)
+	vblock = vbuffer_lookup(relation->buffer, buffer);
+
+	if (vblock != NULL)
 	{
-		vblock = (VBlock) element;
-		if (vblock->id == buffer)
+		vblock->refcount--;
+		if (vblock->refcount == 0)
 		{
-			found = true;
-			break;
+			pagepool_free(vblock->page);
+			vbuffer_remove(relation->buffer, buffer);
 		}
 	}
-
-	if (found)
-	{
-		list_remove(relation->buffer, vblock, &toFree);
-		free(((VBlock) toFree)->page);
-		free(toFree);
-	}
 	else
 	{
 		selog(DEBUG1, "Could not find buffer %d to release", buffer);
@@ -203,18 +541,37 @@ BufferGetBlockNumber_s(Buffer buffer)
 	return (BlockNumber) buffer;
 }
 
-BlockNumber
-FreeSpaceBlock_s(VRelation rel)
+/*
+ * Returns the abbreviated keys of the cached copy of buffer, NULL until they
+ * are built, or NULL itself if buffer is not on a cached level.
+ */
+PageAbbrevKeys **
+BufferGetAbbrevKeys_s(VRelation relation, Buffer buffer)
 {
+	BlockNumber blkno = BufferGetBlockNumber_s(buffer);
 
-	if (rel->fsm[rel->currentBlock] == 0)
+	if (blkno >= relation->cachedBlocks || relation->cache[blkno] == NULL)
 	{
-		return P_NEW;
+		return NULL;
 	}
-	else
+
+	return &relation->abbrevs[blkno];
+}
+
+/*
+ * Returns the block that receives the next heap tuple. The block may have
+ * never been written, in which case the caller gets a new page and has to
+ * initialize it. P_NEW is returned when the relation is full, as the ORAM
+ * can't grow.
+ */
+BlockNumber
+FreeSpaceBlock_s(VRelation rel)
+{
+	if (rel->currentBlock >= rel->totalBlocks)
 	{
-		return rel->currentBlock;
+		return P_NEW;
 	}
+	return rel->currentBlock;
 }
 
 void
@@ -229,19 +586,45 @@ BufferFull_s(VRelation rel, Buffer buff)
 	rel->currentBlock += 1;
 }
 
+/*
+ * Records that blkno was loaded with tuples, so that the inserts that
+ * follow add their tuples after the loaded blocks.
+ */
 void
-destroyVBlock(void *block)
+LoadedBlock_s(VRelation rel, BlockNumber blkno)
 {
-	free(((VBlock) block)->page);
-	free(block);
+	if (rel->fsm[blkno] == 0)
+	{
+		rel->fsm[blkno] = 1;
+	}
+	if (blkno > rel->currentBlock)
+	{
+		rel->currentBlock = blkno;
+	}
 }
 
 void
 closeVRelation(VRelation rel)
 {
-	close_oram(rel->oram, NULL);
-	list_remove_all_cb(rel->buffer, &destroyVBlock);
-	list_destroy(rel->buffer);
+	int			offset;
+
+	if (rel->parts != NULL)
+	{
+		partition_close(rel->parts);
+	}
+	else
+	{
+		close_oram(rel->oram, rel->appData);
+		free(rel->appData);
+	}
+	for (offset = 0; offset < rel->buffer->ndescs; offset++)
+	{
+		if (rel->buffer->descs[offset].refcount > 0)
+		{
+			pagepool_free(rel->buffer->descs[offset].page);
+		}
+	}
+	vbuffer_destroy(rel->buffer);
 	if (rel->rd_amcache != NULL)
 	{
 		free(rel->rd_amcache);
@@ -251,6 +634,14 @@ closeVRelation(VRelation rel)
 		free(rel->tDesc->attrs);
 	}
 	free(rel->tDesc);
+	for (offset = 0; offset < rel->cachedBlocks; offset++)
+	{
+		free(rel->cache[offset]);
+		free(rel->abbrevs[offset]);
+	}
+	free(rel->cache);
+	free(rel->abbrevs);
 	free(rel->fsm);
+	free(rel->level_offsets);
 	free(rel);
 }
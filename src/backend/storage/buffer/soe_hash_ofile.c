@@ -28,6 +28,9 @@
 #include "common/soe_pe.h"
 #include "logger/logger.h"
 #include "storage/soe_hash_ofile.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_treetop.h"
+#include "utils/soe_counters.h"
 #include "storage/soe_bufpage.h"
 
 #include <oram/plblock.h>
@@ -64,7 +67,6 @@ hash_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 	sgx_status_t status;
 
 	char	   *blocks;
-	char	   *tmpPage;
 
 	Page		destPage;
 
@@ -74,6 +76,7 @@ hash_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 	int			offset;
 	int			allocBlocks = 0;
 	int			boffset = 0;
+	ORAMFile	ofile = (ORAMFile) appData;
 
 	do
 	{
@@ -85,15 +88,14 @@ hash_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 		allocBlocks = Min_s(tnblocks, BATCH_SIZE);
 
 		blocks = (char *) malloc(blocksize * allocBlocks);
-		tmpPage = (char *) malloc(blocksize);
 
 		/* HashPageOpaque oopaque; */
 
 		for (offset = 0; offset < allocBlocks; offset++)
 		{
 			destPage = blocks + (offset * BLCKSZ);
-			hash_pageInit(tmpPage, DUMMY_BLOCK, (Size) blocksize);
-			page_encryption((unsigned char *) tmpPage, (unsigned char *) destPage);
+			hash_pageInit(destPage, DUMMY_BLOCK, (Size) blocksize);
+			page_encryption(ofile->cipher, boffset + offset, (unsigned char *) destPage, (unsigned char *) destPage);
 			/* oopaque = (HashPageOpaque) PageGetSpecialPointer_s(page); */
 
 			/*
@@ -110,7 +112,6 @@ hash_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 		}
 
 		free(blocks);
-		free(tmpPage);
 		tnblocks -= BATCH_SIZE;
 		boffset += BATCH_SIZE;
 	} while (tnblocks > 0);
@@ -122,28 +123,31 @@ hash_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno, v
 {
 	sgx_status_t status;
 	HashPageOpaque oopaque;
+	ORAMFile	ofile = (ORAMFile) appData;
 
 	/* selog(DEBUG1, "hash_fileRead %d", ob_blkno); */
 	status = SGX_SUCCESS;
-	char	   *ciphertexBlock;
 
 	block->block = (void *) malloc(BLCKSZ);
-	ciphertexBlock = (char *) malloc(BLCKSZ);
 
-
-
-	status = outFileRead(ciphertexBlock, filename, ob_blkno, BLCKSZ);
-	page_decryption((unsigned char *) ciphertexBlock, (unsigned char *) block->block);
-
-	if (status != SGX_SUCCESS)
+	if (!treetop_read(ofile->treetop, ob_blkno, block->block))
 	{
-		selog(ERROR, "Could not read %d from relation %s\n", ob_blkno, filename);
+		/* The page is decrypted in place on the block buffer. */
+		status = vofile_read_bucket(block->block, filename, ob_blkno,
+									BKCAP - ob_blkno % BKCAP);
+		page_decryption(ofile->cipher, ob_blkno, (unsigned char *) block->block, (unsigned char *) block->block);
+
+		if (status != SGX_SUCCESS)
+		{
+			selog(ERROR, "Could not read %d from relation %s\n", ob_blkno, filename);
+		}
+		treetop_write(ofile->treetop, ob_blkno, block->block);
 	}
 
 	oopaque = (HashPageOpaque) PageGetSpecialPointer_s((Page) block->block);
 	block->blkno = oopaque->o_blkno;
 	block->size = BLCKSZ;
-	free(ciphertexBlock);
+	counters_block_read(ofile->counters, block->blkno);
 
 	/*
 	 * selog(DEBUG1, "requested %d and block has real blkno %d", ob_blkno,
@@ -155,8 +159,8 @@ hash_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno, v
 void
 hash_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_blkno, void *appData)
 {
-	sgx_status_t status = SGX_SUCCESS;
-	char	   *encPage = (char *) malloc(BLCKSZ);
+	char	   *encPage;
+	ORAMFile	ofile = (ORAMFile) appData;
 
 	/* HashPageOpaque oopaque = NULL; */
 
@@ -174,7 +178,17 @@ hash_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_b
 		/* selog(DEBUG1, "Going to write DUMMY_BLOCK"); */
 		hash_pageInit((Page) block->block, DUMMY_BLOCK, BLCKSZ);
 	}
-	page_encryption((unsigned char *) block->block, (unsigned char *) encPage);
+	counters_block_written(ofile->counters, block->blkno);
+
+	if (treetop_write(ofile->treetop, ob_blkno, block->block))
+	{
+		return;
+	}
+
+	/* The page is encrypted on its slot of the write queue. */
+	encPage = vofile_write_page(filename, ob_blkno);
+
+	page_encryption(ofile->cipher, ob_blkno, (unsigned char *) block->block, (unsigned char *) encPage);
 
 	/*
 	 * oopaque = (HashPageOpaque) PageGetSpecialPointer_s((Page)
@@ -186,14 +200,6 @@ hash_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_b
 	 * ob_blkno, block->blkno, oopaque->o_blkno);
 	 */
 	/* selog(DEBUG1, "hash_fileWrite for file %s", filename); */
-	status = outFileWrite(encPage, filename, ob_blkno, BLCKSZ);
-
-	if (status != SGX_SUCCESS)
-	{
-		selog(ERROR, "Could not write %d on relation %s\n", ob_blkno, filename);
-	}
-
-	free(encPage);
 }
 
 
@@ -201,7 +207,13 @@ void
 hash_fileClose(const char *filename, void *appData)
 {
 	sgx_status_t status = SGX_SUCCESS;
+	ORAMFile	ofile = (ORAMFile) appData;
 
+	vofile_flush();
+	treetop_close(ofile->treetop);
+	ofile->treetop = NULL;
+	counters_oram_close(ofile->counters);
+	ofile->counters = NULL;
 	status = outFileClose(filename);
 
 	if (status != SGX_SUCCESS)
@@ -27,6 +27,9 @@
 
 #include "logger/logger.h"
 #include "storage/soe_heap_ofile.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_treetop.h"
+#include "utils/soe_counters.h"
 #include "common/soe_pe.h"
 
 
@@ -45,6 +48,24 @@ heap_pageInit(Page page, int blkno, Size blocksize)
     *pblkno = blkno;
 }
 
+/* Block of the relation file that holds block ob_blkno of the ORAM. */
+static inline BlockNumber
+heap_file_blkno(HeapPartition hpart, BlockNumber ob_blkno)
+{
+	return hpart->offset + ob_blkno;
+}
+
+/* ORAM block number of the heap page blkno stored on a page. */
+static inline int
+heap_oram_blkno(HeapPartition hpart, int blkno)
+{
+	if (blkno == DUMMY_BLOCK)
+	{
+		return blkno;
+	}
+	return blkno / hpart->npartitions;
+}
+
 /**
  *
  * This function follows a logic similar to the function RelationAddExtraBlocks in hio.c which  pre-extend a
@@ -57,15 +78,19 @@ heap_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 {
 	sgx_status_t status;
 	char	   *blocks;
-	char	   *tmpPage;
 
 	Page		destPage;
 	int			allocBlocks;
 	int			tnblocks = nblocks;
+	HeapPartition hpart = (HeapPartition) appData;
 
 	status = SGX_SUCCESS;
 	int			offset = 0;
 	int			boffset = 0;
+
+	/* The partitions are initialized in order, one after the other. */
+	hpart->offset = hpart->partition == 0 ? 0 : (hpart - 1)->offset + (hpart - 1)->nblocks;
+	boffset = hpart->offset;
 	
     do
 	{
@@ -75,17 +100,13 @@ heap_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 		allocBlocks = Min_s(tnblocks, BATCH_SIZE);
 
 		blocks = (char *) malloc(BLCKSZ * allocBlocks);
-		tmpPage = (char *) malloc(blocksize);
-	
 
 		for (offset = 0; offset < allocBlocks; offset++)
 		{
 			destPage = blocks + (offset * BLCKSZ);
-			heap_pageInit(tmpPage, DUMMY_BLOCK, BLCKSZ);
+			heap_pageInit(destPage, DUMMY_BLOCK, BLCKSZ);
 			#ifndef CPAGES
-				page_encryption((unsigned char *) tmpPage, (unsigned char *) destPage);
-			#else
-				memcpy(destPage, tmpPage, BLCKSZ);
+				page_encryption(hpart->ofile.cipher, boffset + offset, (unsigned char *) destPage, (unsigned char *) destPage);
 			#endif
 		}
 
@@ -97,12 +118,12 @@ heap_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize
 		}
 
 		free(blocks);
-		free(tmpPage);
         
 		tnblocks -= BATCH_SIZE;
 		boffset += BATCH_SIZE;
 	} while (tnblocks > 0);
 
+	hpart->nblocks = nblocks;
 }
 
 
@@ -112,33 +133,36 @@ heap_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno, v
 {
 
 	sgx_status_t status;
-	char	   *ciphertexBlock;
 	int*    r_blkno;
+	HeapPartition hpart = (HeapPartition) appData;
+	BlockNumber f_blkno = heap_file_blkno(hpart, ob_blkno);
 
 	status = SGX_SUCCESS;
 
 	block->block = (void *) malloc(BLCKSZ);
-	ciphertexBlock = (char *) malloc(BLCKSZ);
 
-	
-    status = outFileRead(ciphertexBlock, filename, ob_blkno, BLCKSZ);
+	if (!treetop_read(hpart->ofile.treetop, f_blkno, block->block))
+	{
+		/* The page is decrypted in place on the block buffer. */
+		status = vofile_read_bucket(block->block, filename, f_blkno,
+									BKCAP - ob_blkno % BKCAP);
 
-	#ifndef CPAGES
-		page_decryption((unsigned char *) ciphertexBlock, (unsigned char *) block->block);
-	#else
-    	memcpy(block->block, ciphertexBlock, BLCKSZ);
-	#endif
+		#ifndef CPAGES
+			page_decryption(hpart->ofile.cipher, f_blkno, (unsigned char *) block->block, (unsigned char *) block->block);
+		#endif
 
-	if (status != SGX_SUCCESS)
-	{
-		selog(ERROR, "Could not read %d from relation %s\n", ob_blkno, filename);
+		if (status != SGX_SUCCESS)
+		{
+			selog(ERROR, "Could not read %d from relation %s\n", f_blkno, filename);
+		}
+		treetop_write(hpart->ofile.treetop, f_blkno, block->block);
 	}
    
 	r_blkno = (int*) PageGetSpecialPointer_s((Page) block->block);
 
-   	block->blkno = *r_blkno;
+   	block->blkno = heap_oram_blkno(hpart, *r_blkno);
 	block->size = BLCKSZ;
-	free(ciphertexBlock);
+	counters_block_read(hpart->ofile.counters, block->blkno);
     //selog(DEBUG1, "Requested read oblivious block %d that has real block %d", ob_blkno, block->blkno);
 
 }
@@ -147,15 +171,16 @@ heap_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno, v
 void
 heap_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_blkno, void *appData)
 {
-	sgx_status_t status = SGX_SUCCESS;
-	char	   *encPage = (char *) malloc(BLCKSZ);
+	char	   *encPage;
     int        *r_blkno;
+	HeapPartition hpart = (HeapPartition) appData;
+	BlockNumber f_blkno = heap_file_blkno(hpart, ob_blkno);
     
     r_blkno = (int*) PageGetSpecialPointer_s((Page) block->block);
     
     //selog(DEBUG1, "Requested write  oblivious block %d that has real block %d", ob_blkno, *r_blkno);
 
-    if(block->blkno != *r_blkno){
+    if(block->blkno != heap_oram_blkno(hpart, *r_blkno)){
         selog(ERROR, "Block blkno %d and page blkno %d do not match", block->blkno, *r_blkno);
     }
     
@@ -171,20 +196,21 @@ heap_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_b
 		*/
 		heap_pageInit((Page) block->block, DUMMY_BLOCK, BLCKSZ);
 	}
-	#ifndef CPAGES
-		page_encryption((unsigned char *) block->block, (unsigned char *) encPage);
-	#else
-		memcpy(encPage, block->block, BLCKSZ);
- 	#endif
-	
-	status = outFileWrite(encPage, filename, ob_blkno, BLCKSZ);
+	counters_block_written(hpart->ofile.counters, block->blkno);
 
-	if (status != SGX_SUCCESS)
+	if (treetop_write(hpart->ofile.treetop, f_blkno, block->block))
 	{
-		selog(ERROR, "Could not write %d on relation %s\n", ob_blkno, filename);
+		return;
 	}
 
-	free(encPage);
+	/* The page is encrypted on its slot of the write queue. */
+	encPage = vofile_write_page(filename, f_blkno);
+
+	#ifndef CPAGES
+		page_encryption(hpart->ofile.cipher, f_blkno, (unsigned char *) block->block, (unsigned char *) encPage);
+	#else
+		memcpy(encPage, block->block, BLCKSZ);
+ 	#endif
 }
 
 
@@ -192,7 +218,20 @@ void
 heap_fileClose(const char *filename, void *appData)
 {
 	sgx_status_t status = SGX_SUCCESS;
+	HeapPartition hpart = (HeapPartition) appData;
+
+	treetop_close(hpart->ofile.treetop);
+	hpart->ofile.treetop = NULL;
+	counters_oram_close(hpart->ofile.counters);
+	hpart->ofile.counters = NULL;
+
+	/* The partitions share the file, which is closed with the last one. */
+	if (hpart->partition != hpart->npartitions - 1)
+	{
+		return;
+	}
 
+	vofile_flush();
 	status = outFileClose(filename);
 
 	if (status != SGX_SUCCESS)
@@ -27,6 +27,9 @@
 #include "access/soe_nbtree.h"
 #include "logger/logger.h"
 #include "storage/soe_nbtree_ofile.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_treetop.h"
+#include "utils/soe_counters.h"
 #include "storage/soe_bufpage.h"
 #include "common/soe_pe.h"
 
@@ -35,7 +38,6 @@
 #include <stdlib.h>
 
 
-
 void
 nbtree_pageInit(Page page, int blkno, Size blocksize)
 {
@@ -63,7 +65,6 @@ nbtree_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksi
 	sgx_status_t status;
 	char	   *blocks;
 	char	   *destPage;
-	char	   *tmpPage;
 	int			tnblocks = nblocks;
 	int			offset;
 	int			allocBlocks = 0;
@@ -78,16 +79,13 @@ nbtree_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksi
 		allocBlocks = Min_s(tnblocks, BATCH_SIZE);
 
 		blocks = (char *) malloc(BLCKSZ * nblocks);
-		tmpPage = malloc(blocksize);
 
 		for (offset = 0; offset < allocBlocks; offset++)
 		{
 			destPage = blocks + (offset * BLCKSZ);
-			nbtree_pageInit(tmpPage, DUMMY_BLOCK, BLCKSZ);
+			nbtree_pageInit(destPage, DUMMY_BLOCK, BLCKSZ);
 			#ifndef CPAGES
-				page_encryption((unsigned char *) tmpPage, (unsigned char *) destPage);
-			#else
-				memcpy(destPage, tmpPage, BLCKSZ);
+				page_encryption(((ORAMFile) appData)->cipher, boffset + offset, (unsigned char *) destPage, (unsigned char *) destPage);
 			#endif
 		}
 
@@ -99,7 +97,6 @@ nbtree_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksi
 		}
         
 		free(blocks);
-		free(tmpPage);
 
 		tnblocks -= BATCH_SIZE;
 		boffset += BATCH_SIZE;
@@ -112,45 +109,61 @@ nbtree_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno,
 {
 	sgx_status_t status;
 	BTPageOpaque oopaque;
+	ORAMFile	ofile = (ORAMFile) appData;
 
 	/* selog(DEBUG1, "nbtree_fileRead %d", ob_blkno); */
 	status = SGX_SUCCESS;
-	char	   *ciphertextBlock;
 
 	block->block = (void *) malloc(BLCKSZ);
-	ciphertextBlock = (char *) malloc(BLCKSZ);
 
-	status = outFileRead(ciphertextBlock, filename, ob_blkno, BLCKSZ);
+	if (treetop_read(ofile->treetop, ob_blkno, block->block))
+	{
+		oopaque = (BTPageOpaque) PageGetSpecialPointer_s((Page) block->block);
+		block->blkno = oopaque->o_blkno;
+		block->size = BLCKSZ;
+		counters_block_read(ofile->counters, block->blkno);
+		return;
+	}
+
+	/* The page is decrypted in place on the block buffer. */
+	status = vofile_read_bucket(block->block, filename, ob_blkno,
+								BKCAP - ob_blkno % BKCAP);
+
+#ifdef READ_AHEAD
+	/*
+	 * The path of an ORAM access reads the blocks of a bucket one after the
+	 * other. The rest of the bucket is fetched while this block is
+	 * decrypted. The ORAM file holds whole buckets.
+	 */
+	vofile_read_ahead(filename, ob_blkno, BKCAP - 1 - ob_blkno % BKCAP);
+#endif
+
 	#ifndef CPAGES
-		page_decryption((unsigned char *) ciphertextBlock, (unsigned char *) block->block);
-	#else
-    	memcpy(block->block, ciphertextBlock, BLCKSZ);
+		page_decryption(ofile->cipher, ob_blkno, (unsigned char *) block->block, (unsigned char *) block->block);
 	#endif
 
 	if (status != SGX_SUCCESS)
 	{
 		selog(ERROR, "Could not read %d from relation %s\n", ob_blkno, filename);
 	}
+	treetop_write(ofile->treetop, ob_blkno, block->block);
 
 	oopaque = (BTPageOpaque) PageGetSpecialPointer_s((Page) block->block);
 	block->blkno = oopaque->o_blkno;
 	block->size = BLCKSZ;
-	free(ciphertextBlock);
-
+	counters_block_read(ofile->counters, block->blkno);
 }
 
 
 void
 nbtree_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_blkno, void *appData)
 {
-	sgx_status_t status = SGX_SUCCESS;
     BTPageOpaque oopaque;
+	ORAMFile	ofile = (ORAMFile) appData;
 
 	/* BTPageOpaque oopaque = NULL; */
 	char	   *encpage;
 
-	encpage = (char *) malloc(BLCKSZ);
-
 	if (block->blkno == DUMMY_BLOCK)
 	{
 		/* selog(DEBUG1, "Requested write of DUMMY_BLOCK"); */
@@ -167,19 +180,21 @@ nbtree_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob
 
     oopaque = (BTPageOpaque) PageGetSpecialPointer_s((Page)block->block);
     oopaque->o_blkno = block->blkno;
+	counters_block_written(ofile->counters, block->blkno);
+
+	if (treetop_write(ofile->treetop, ob_blkno, block->block))
+	{
+		return;
+	}
+
+	/* The page is encrypted on its slot of the write queue. */
+	encpage = vofile_write_page(filename, ob_blkno);
      
 	#ifndef CPAGES
-		page_encryption((unsigned char *) block->block, (unsigned char *) encpage);
+		page_encryption(ofile->cipher, ob_blkno, (unsigned char *) block->block, (unsigned char *) encpage);
 	#else
 		 memcpy(encpage, block->block, BLCKSZ);
 	#endif
-	status = outFileWrite(encpage, filename, ob_blkno, BLCKSZ);
-
-	if (status != SGX_SUCCESS)
-	{
-		selog(ERROR, "Could not write %d on relation %s\n", ob_blkno, filename);
-	}
-	free(encpage);
 }
 
 
@@ -187,7 +202,13 @@ void
 nbtree_fileClose(const char *filename, void *appData)
 {
 	sgx_status_t status = SGX_SUCCESS;
+	ORAMFile	ofile = (ORAMFile) appData;
 
+	vofile_flush();
+	treetop_close(ofile->treetop);
+	ofile->treetop = NULL;
+	counters_oram_close(ofile->counters);
+	ofile->counters = NULL;
 	status = outFileClose(filename);
 
 	if (status != SGX_SUCCESS)
@@ -1,18 +1,73 @@
 
 #include "storage/soe_ost_bufmgr.h"
 #include "access/soe_skey.h"
+#include "access/soe_abbrev.h"
 #include "logger/logger.h"
 #include "storage/soe_heap_ofile.h"
 #include "storage/soe_ost_ofile.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_pagepool.h"
+#include "utils/soe_counters.h"
 
 #include <stdlib.h>
 
+/* Number of blocks of a tree level. Level 0 is the root block. */
+static inline int
+ost_level_blocks(OSTreeState osts, int level)
+{
+	return level == 0 ? 1 : osts->fanouts[level - 1];
+}
+
+/* Returns whether block blkno of the current level is kept in the cache. */
+static inline bool
+ost_cache_level(OSTRelation relation, BlockNumber blkno)
+{
+	int			clevel = relation->level;
+
+	return clevel < relation->cachedLevels && blkno < ost_level_blocks(relation->osts, clevel);
+}
+
+/*
+ * Returns the cached copy of block blkno of the current level, or NULL if
+ * the level is not cached or the block was not written yet.
+ */
+static inline char *
+ost_cache_block(OSTRelation relation, BlockNumber blkno)
+{
+	if (!ost_cache_level(relation, blkno))
+	{
+		return NULL;
+	}
+
+	return relation->cache[relation->level][blkno];
+}
+
+/* Updates the cached copy of block blkno of the current level. */
+static void
+ost_cache_write(OSTRelation relation, BlockNumber blkno, const char *page)
+{
+	int			clevel = relation->level;
+
+	if (!ost_cache_level(relation, blkno))
+	{
+		return;
+	}
+
+	if (relation->cache[clevel][blkno] == NULL)
+	{
+		relation->cache[clevel][blkno] = (char *) malloc(BLCKSZ);
+	}
+	memcpy(relation->cache[clevel][blkno], page, BLCKSZ);
+	free(relation->abbrevs[clevel][blkno]);
+	relation->abbrevs[clevel][blkno] = NULL;
+}
 
 OSTRelation
 InitOSTRelation(OSTreeState relstate, unsigned int oid, char *attrDesc, unsigned int attrDescLength)
 {
 
 	int			loffset;
+	unsigned int cblocks;
 
 	OSTRelation rel = (OSTRelation) malloc(sizeof(struct OSTRelation));
 
@@ -37,6 +92,28 @@ InitOSTRelation(OSTreeState relstate, unsigned int oid, char *attrDesc, unsigned
 	rel->tDesc->attrs = (FormData_pg_attribute *) malloc(sizeof(struct FormData_pg_attribute));
 	memcpy(rel->tDesc->attrs, attrDesc, attrDescLength);
 
+	/*
+	 * Every lookup reads one block of each level, so the levels above the
+	 * leaves that fit in INDEX_CACHE_SIZE are kept in enclave memory.
+	 */
+	cblocks = 0;
+	for (loffset = 0; loffset < relstate->nlevels; loffset++)
+	{
+		cblocks += ost_level_blocks(relstate, loffset);
+		if ((Size) cblocks * BLCKSZ > INDEX_CACHE_SIZE)
+		{
+			break;
+		}
+	}
+	rel->cachedLevels = loffset;
+	rel->cache = (char ***) malloc(sizeof(char **) * (rel->cachedLevels + 1));
+	rel->abbrevs = (PageAbbrevKeys * **) malloc(sizeof(PageAbbrevKeys **) * (rel->cachedLevels + 1));
+	for (loffset = 0; loffset < rel->cachedLevels; loffset++)
+	{
+		rel->cache[loffset] = (char **) calloc(ost_level_blocks(relstate, loffset), sizeof(char *));
+		rel->abbrevs[loffset] = (PageAbbrevKeys * *) calloc(ost_level_blocks(relstate, loffset), sizeof(PageAbbrevKeys *));
+	}
+
 	return rel;
 }
 
@@ -50,6 +127,11 @@ Buffer ReadDummyBuffer_ost(OSTRelation relation, int treeLevel,
 
     int clevel = treeLevel;
 
+    /* The lookups read the cached levels without any access. */
+    if(clevel < relation->cachedLevels){
+        return result;
+    }
+
     if(clevel == 0){
         plblock = createEmptyBlock();
 
@@ -57,11 +139,14 @@ Buffer ReadDummyBuffer_ost(OSTRelation relation, int treeLevel,
 		 * The OST fileRead always allocates and writes the content of the
 		 * file page, even if the content is a dummy page.
 		 */
-		ost_fileRead(plblock, relation->osts->iname, blkno, &clevel);
+		ost_fileRead(plblock, relation->osts->iname, blkno, &relation->osts->levels[clevel]);
 	    free(plblock);
         result = plblock->size;
     }else{
-        result = read_oram(&page, blkno, relation->osts->orams[clevel - 1], &clevel);
+        COUNTERS_INC(oramReads);
+        COUNTERS_INC(dummyReads);
+        result = read_oram(&page, blkno, relation->osts->orams[clevel - 1], &relation->osts->levels[clevel]);
+        vofile_flush();
         free(page); 
     }
     #endif
@@ -81,6 +166,8 @@ ReadBuffer_ost(OSTRelation relation, BlockNumber blockNum)
 	int			clevel = relation->level;
 	PLBlock		plblock = NULL;
 
+	COUNTERS_INC(buffersPinned);
+
 	/*
 	 * This code assumes that there are no consecutive accesses to read the
 	 * same buffer from the same level. Otherwise, if this is not true, we can
@@ -88,7 +175,29 @@ ReadBuffer_ost(OSTRelation relation, BlockNumber blockNum)
 	 * buffer before accessing the file.
 	 */
 
-	if (clevel == 0)
+	/*
+	 * The blocks of the cached levels are never read from the file or the
+	 * ORAM, as the lookups do not access them with DUMMYS either. Every
+	 * block written to them is cached, so one that is not was never written
+	 * and has the content set up by init_root or the ORAM.
+	 */
+	if (ost_cache_level(relation, blockNum))
+	{
+		page = pagepool_alloc();
+		if (ost_cache_block(relation, blockNum) != NULL)
+		{
+			memcpy(page, ost_cache_block(relation, blockNum), BLCKSZ);
+		}
+		else if (clevel == 0)
+		{
+			ost_pageInit(page, DUMMY_BLOCK, BLCKSZ);
+		}
+		else
+		{
+			memset(page, 0, BLCKSZ);
+		}
+	}
+	else if (clevel == 0)
 	{
 		plblock = createEmptyBlock();
 
@@ -96,14 +205,17 @@ ReadBuffer_ost(OSTRelation relation, BlockNumber blockNum)
 		 * The OST fileRead always allocates and writes the content of the
 		 * file page, even if the content is a dummy page.
 		 */
-		ost_fileRead(plblock, relation->osts->iname, blockNum, &clevel);
+		ost_fileRead(plblock, relation->osts->iname, blockNum, &relation->osts->levels[clevel]);
 		page = plblock->block;
 		free(plblock);
+		ost_cache_write(relation, blockNum, page);
 	}
 	else
 	{
         //selog(DEBUG1, "Read oram ost block %d at level %d", blockNum, clevel);
-		result = read_oram(&page, blockNum, relation->osts->orams[clevel - 1], &clevel);
+		COUNTERS_INC(oramReads);
+		result = read_oram(&page, blockNum, relation->osts->orams[clevel - 1], &relation->osts->levels[clevel]);
+		vofile_flush();
 
 		/**
          *  When the read returns a DUMMY_BLOCK page  it means its the
@@ -113,12 +225,16 @@ ReadBuffer_ost(OSTRelation relation, BlockNumber blockNum)
          **/
 		if (result == DUMMY_BLOCK)
 		{
-			page = (char *) malloc(BLCKSZ);
+			page = pagepool_alloc();
 			memset(page, 0, BLCKSZ);
 		}
+		else
+		{
+			ost_cache_write(relation, blockNum, page);
+		}
 	}
 
-	OSTVBlock	block = (OSTVBlock) malloc(sizeof(struct OSTVBlock));
+	OSTVBlock	block = (OSTVBlock) pagepool_desc_alloc(sizeof(struct OSTVBlock));
 
 	block->id = blockNum;
 	block->page = page;
@@ -189,13 +305,17 @@ MarkBufferDirty_ost(OSTRelation relation, Buffer buffer)
 			block->blkno = vblock->id;
 			block->block = vblock->page;
 			block->size = BLCKSZ;
-			ost_fileWrite(block, relation->osts->iname, vblock->id, &clevel);
+			ost_fileWrite(block, relation->osts->iname, vblock->id, &relation->osts->levels[clevel]);
+			vofile_flush();
 			free(block);
 		}
 		else
 		{
-			result = write_oram(vblock->page, BLCKSZ, vblock->id, relation->osts->orams[clevel - 1], &clevel);
+			COUNTERS_INC(oramWrites);
+			result = write_oram(vblock->page, BLCKSZ, vblock->id, relation->osts->orams[clevel - 1], &relation->osts->levels[clevel]);
+			vofile_flush();
 		}
+		ost_cache_write(relation, vblock->id, vblock->page);
 	}
 	else
 	{
@@ -210,6 +330,44 @@ MarkBufferDirty_ost(OSTRelation relation, Buffer buffer)
 }
 
 
+/*
+ * Writes a complete page as block blockNum of the current tree level without
+ * reading the block first. Used to load pages whose previous content is
+ * irrelevant.
+ */
+void
+WriteBlock_ost(OSTRelation relation, BlockNumber blockNum, Page page)
+{
+	int			result;
+	int			clevel = relation->level;
+	PLBlock		block;
+
+	if (clevel == 0)
+	{
+		block = createEmptyBlock();
+		block->blkno = blockNum;
+		block->block = page;
+		block->size = BLCKSZ;
+		ost_fileWrite(block, relation->osts->iname, blockNum, &relation->osts->levels[clevel]);
+		vofile_flush();
+		free(block);
+		result = BLCKSZ;
+	}
+	else
+	{
+		COUNTERS_INC(oramWrites);
+		result = write_oram(page, BLCKSZ, blockNum, relation->osts->orams[clevel - 1], &relation->osts->levels[clevel]);
+		vofile_flush();
+	}
+	ost_cache_write(relation, blockNum, page);
+
+	if (result != BLCKSZ)
+	{
+		selog(ERROR, "Write failed to write a complete page");
+	}
+}
+
+
 void
 ReleaseBuffer_ost(OSTRelation relation, Buffer buffer)
 {
@@ -238,8 +396,8 @@ ReleaseBuffer_ost(OSTRelation relation, Buffer buffer)
 	if (found)
 	{
 		list_remove(relation->buffers[clevel], vblock, &toFree);
-		free(((VBlock) toFree)->page);
-		free(toFree);
+		pagepool_free(((OSTVBlock) toFree)->page);
+		pagepool_desc_free(toFree);
 	}
 	else
 	{
@@ -253,24 +411,58 @@ BufferGetBlockNumber_ost(Buffer buffer)
 	return (BlockNumber) buffer;
 }
 
+/*
+ * Returns the abbreviated keys of the cached copy of buffer, on the current
+ * level, NULL until they are built, or NULL itself if buffer is not cached.
+ */
+PageAbbrevKeys **
+BufferGetAbbrevKeys_ost(OSTRelation relation, Buffer buffer)
+{
+	BlockNumber blkno = BufferGetBlockNumber_ost(buffer);
+
+	if (ost_cache_block(relation, blkno) == NULL)
+	{
+		return NULL;
+	}
+
+	return &relation->abbrevs[relation->level][blkno];
+}
+
 void
 destroyOSTVBlock(void *block)
 {
-	free(((OSTVBlock) block)->page);
-	free(block);
+	pagepool_free(((OSTVBlock) block)->page);
+	pagepool_desc_free(block);
 }
 
 void
 closeOSTRelation(OSTRelation rel)
 {
 	int			l;
+	int			blkno;
+
+	for (l = 0; l < rel->cachedLevels; l++)
+	{
+		for (blkno = 0; blkno < ost_level_blocks(rel->osts, l); blkno++)
+		{
+			free(rel->cache[l][blkno]);
+			free(rel->abbrevs[l][blkno]);
+		}
+		free(rel->cache[l]);
+		free(rel->abbrevs[l]);
+	}
+	free(rel->cache);
+	free(rel->abbrevs);
 
 
 	for (l = 0; l < rel->osts->nlevels; l++)
 	{
-		close_oram(rel->osts->orams[l], NULL);
+		close_oram(rel->osts->orams[l], &rel->osts->levels[l + 1]);
+		free(rel->osts->amgrs[l]);
 	}
 	free(rel->osts->orams);
+	free(rel->osts->amgrs);
+	free(rel->osts->levels);
 	free(rel->osts->fanouts);
 	free(rel->osts->iname);
 
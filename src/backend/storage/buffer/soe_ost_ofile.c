@@ -26,44 +26,31 @@
 
 #include "logger/logger.h"
 #include "storage/soe_ost_ofile.h"
+#include "storage/soe_vofile.h"
 #include "storage/soe_bufpage.h"
 #include "common/soe_pe.h"
 #include "access/soe_ost.h"
+#include "utils/soe_counters.h"
 
 #include <oram/plblock.h>
 #include <string.h>
 #include <stdlib.h>
 
 
-OSTreeState ostate;
 
-unsigned int init_offset;
+void init_root(const char* filename, OSTLevel root){
 
-/* number of blocks requested to be allocated for each oram level. */
-int		   *o_nblocks;
-
-
-
-void init_root(const char* filename){
-
-    char	    *tmpPage;
-    char        *destPage;
+    char        destPage[BLCKSZ];
     sgx_status_t status;
     
 
     status = SGX_SUCCESS;
 
 
-    tmpPage = malloc(BLCKSZ);
-    destPage = malloc(BLCKSZ);
-
-
-    ost_pageInit(tmpPage, DUMMY_BLOCK, BLCKSZ);
+    ost_pageInit(destPage, DUMMY_BLOCK, BLCKSZ);
 
 #ifndef CPAGES
-    page_encryption((unsigned char *) tmpPage, (unsigned char *) destPage);
-#else
-    memcpy(destPage, tmpPage, BLCKSZ);
+    page_encryption(root->ofile.cipher, 0, (unsigned char *) destPage, (unsigned char *) destPage);
 #endif
 
     status = outFileInit(filename, destPage, 1, BLCKSZ, BLCKSZ, 0);
@@ -72,17 +59,6 @@ void init_root(const char* filename){
         selog(ERROR, "Could not initialize relation %s\n", filename);
 	}
 
-    free(tmpPage);
-    free(destPage);
-    init_offset++;
-
-}
-
-void
-ost_status(OSTreeState state)
-{
-	ostate = state;
-   o_nblocks = (int *) malloc(sizeof(int) * ostate->nlevels); 
 }
 
 void
@@ -111,7 +87,6 @@ ost_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize,
 	sgx_status_t status;
 	char	   *blocks;
 	char	   *destPage;
-	char	   *tmpPage;
 
 	status = SGX_SUCCESS;
 
@@ -121,9 +96,16 @@ ost_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize,
 
 	int         offset;
 	int			allocBlocks = 0;
-	int			boffset = init_offset;
-	int			clevel = *((int *) appData);
-    
+	int			boffset;
+	OSTLevel	olevel = (OSTLevel) appData;
+
+	/*
+	 * The levels are initialized top-down and each one is placed after the
+	 * level above it, starting with the root block.
+	 */
+	olevel->offset = (olevel - 1)->offset + (olevel - 1)->nblocks;
+	boffset = olevel->offset;
+
 
     selog(DEBUG1, "request ost_fileInit of %d nblocks\n", nblocks);
 
@@ -132,17 +114,14 @@ ost_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize,
 	    allocBlocks = Min_s(tnblocks, BATCH_SIZE);
         
         blocks = (char *) malloc(BLCKSZ * allocBlocks);
-		tmpPage = malloc(blocksize);
 
         for (offset = 0; offset < allocBlocks; offset++)
         {
             destPage = blocks + (offset * BLCKSZ);
-			ost_pageInit(tmpPage, DUMMY_BLOCK, (Size) blocksize);
+			ost_pageInit(destPage, DUMMY_BLOCK, (Size) blocksize);
 
         #ifndef CPAGES
-			page_encryption((unsigned char *) tmpPage, (unsigned char *) destPage);
-		#else
-			memcpy(destPage, tmpPage, BLCKSZ);
+			page_encryption(olevel->ofile.cipher, boffset + offset, (unsigned char *) destPage, (unsigned char *) destPage);
 		#endif
         }
 
@@ -153,15 +132,13 @@ ost_fileInit(const char *filename, unsigned int nblocks, unsigned int blocksize,
 				selog(ERROR, "Could not initialize relation %s\n", filename);
 			}
 			free(blocks);
-			free(tmpPage);
 
 			tnblocks -= BATCH_SIZE;
 			boffset += BATCH_SIZE;
 	} while (tnblocks > 0);
 
-    init_offset += nblocks;
-    selog(DEBUG1, "Init offset is at %d\n", init_offset);
-	o_nblocks[clevel] = nblocks;
+	olevel->nblocks = nblocks;
+    selog(DEBUG1, "Level %d placed at offset %d\n", olevel->level, olevel->offset);
 
 }
 
@@ -171,35 +148,38 @@ ost_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno, vo
 {
 	sgx_status_t status;
 	BTPageOpaqueOST oopaque;
-	int			clevel = *((int *) appData);
+	OSTLevel	olevel = (OSTLevel) appData;
+	unsigned int l_ob_blkno = olevel->offset + ob_blkno;
 
 	status = SGX_SUCCESS;
-	char	   *ciphertextBlock;
-	unsigned int l_offset = 0;
-	unsigned int l_index;
-	unsigned int l_ob_blkno = 0;
 
-	if (clevel > 0)
+	block->block = (void *) malloc(BLCKSZ);
+
+	/*
+	 * The page is decrypted in place on the block buffer. The root level is
+	 * not an ORAM and has no buckets.
+	 */
+	if (olevel->level > 0)
 	{
-		l_offset = 1;
-		/* Fanout of previous levels */
-		for (l_index = 0; l_index < clevel - 1; l_index++)
-		{
-			l_offset += o_nblocks[l_index];
-		}
+		status = vofile_read_bucket(block->block, filename, l_ob_blkno,
+									Min_s(BKCAP - ob_blkno % BKCAP, olevel->nblocks - ob_blkno));
+	}
+	else
+	{
+		status = vofile_read(block->block, filename, l_ob_blkno);
 	}
 
-	l_ob_blkno = ob_blkno + l_offset;
-
-	block->block = (void *) malloc(BLCKSZ);
-	ciphertextBlock = (char *) malloc(BLCKSZ);
-
-	status = outFileRead(ciphertextBlock, filename, l_ob_blkno, BLCKSZ);
+#ifdef READ_AHEAD
+	/* The root level is not an ORAM and has no buckets. */
+	if (olevel->level > 0)
+	{
+		vofile_read_ahead(filename, l_ob_blkno,
+						  Min_s(BKCAP - 1 - ob_blkno % BKCAP, olevel->nblocks - 1 - ob_blkno));
+	}
+#endif
 
 	#ifndef CPAGES
-		page_decryption((unsigned char *) ciphertextBlock, (unsigned char *) block->block);
-	#else
-    	memcpy(block->block, ciphertextBlock, BLCKSZ);
+		page_decryption(olevel->ofile.cipher, l_ob_blkno, (unsigned char *) block->block, (unsigned char *) block->block);
 	#endif
     
 	if (status != SGX_SUCCESS)
@@ -210,8 +190,7 @@ ost_fileRead(PLBlock block, const char *filename, const BlockNumber ob_blkno, vo
 	oopaque = (BTPageOpaqueOST) PageGetSpecialPointer_s((Page) block->block);
 	block->blkno = oopaque->o_blkno;
 	block->size = BLCKSZ;
-	free(ciphertextBlock);
-
+	counters_block_read(olevel->ofile.counters, block->blkno);
 }
 
 
@@ -219,28 +198,10 @@ void
 ost_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_blkno, void *appData)
 {
 
-	sgx_status_t status = SGX_SUCCESS;
 	BTPageOpaqueOST oopaque = NULL;
 	char	   *encpage;
-	unsigned int l_offset = 0;
-	unsigned int l_index;
-	unsigned int l_ob_blkno = 0;
-	int			clevel = *((int *) appData);
-
-	if (clevel > 0)
-	{
-		l_offset = 1;
-
-		/* Fanout of previous levels */
-		for (l_index = 0; l_index < clevel - 1; l_index++)
-		{
-			l_offset += o_nblocks[l_index];
-		}
-	}
-
-	l_ob_blkno = ob_blkno + l_offset;
-
-	encpage = (char *) malloc(BLCKSZ);
+	OSTLevel	olevel = (OSTLevel) appData;
+	unsigned int l_ob_blkno = olevel->offset + ob_blkno;
 
 	if (block->blkno == DUMMY_BLOCK)
 	{
@@ -256,20 +217,16 @@ ost_fileWrite(const PLBlock block, const char *filename, const BlockNumber ob_bl
 	}
 	oopaque = (BTPageOpaqueOST) PageGetSpecialPointer_s((Page) block->block);
 	oopaque->o_blkno = block->blkno;
+	counters_block_written(olevel->ofile.counters, block->blkno);
+
+	/* The page is encrypted on its slot of the write queue. */
+	encpage = vofile_write_page(filename, l_ob_blkno);
 
 	#ifndef CPAGES
-		page_encryption((unsigned char *) block->block, (unsigned char *) encpage);
+		page_encryption(olevel->ofile.cipher, l_ob_blkno, (unsigned char *) block->block, (unsigned char *) encpage);
 	#else
  		memcpy(encpage, block->block, BLCKSZ);
 	#endif
-
-    status = outFileWrite(encpage, filename, l_ob_blkno, BLCKSZ);
-
-	if (status != SGX_SUCCESS)
-	{
-		selog(ERROR, "Could not write %d on relation %s\n", ob_blkno, filename);
-	}
-	free(encpage);
 }
 
 
@@ -277,10 +234,15 @@ void
 ost_fileClose(const char *filename, void *appData)
 {
 	sgx_status_t status = SGX_SUCCESS;
-    if(o_nblocks != NULL){
+	OSTLevel	olevel = (OSTLevel) appData;
+
+	counters_oram_close(olevel->ofile.counters);
+	olevel->ofile.counters = NULL;
+
+	/* The ORAMs of all levels share the file, which is closed once. */
+    if(olevel->level == 1){
+	    vofile_flush();
 	    status = outFileClose(filename);
-        free(o_nblocks);
-        o_nblocks = NULL;
 	    if (status != SGX_SUCCESS)
 	    {
 		    selog(ERROR, "Could not close relation %s\n", filename);
@@ -0,0 +1,195 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_pagepool.c
+ *	  Slab pool of the pages and buffer descriptors of the buffer managers.
+ *
+ * Each kind of object has a pool with a reserve of PAGE_POOL_SIZE objects,
+ * allocated by the first thread that needs it. The free objects of the
+ * reserve are linked through their first bytes. A thread takes them from
+ * the shared list of the pool PAGE_POOL_BATCH at a time and returns them
+ * when its own list holds twice as many, so the pool lock is only taken
+ * once every PAGE_POOL_BATCH allocations.
+ *
+ * The reserve lives as long as the enclave, so the objects on the lists of
+ * the threads stay valid after closeSoe.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/storage/buffer/soe_pagepool.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "storage/soe_pagepool.h"
+#include "storage/soe_lock.h"
+#include "logger/logger.h"
+
+#include <stdlib.h>
+
+/* Objects moved at once between the list of a thread and the pool */
+#define PAGE_POOL_BATCH 16
+
+typedef struct PoolObject
+{
+	struct PoolObject *next;
+}			PoolObject;
+
+typedef struct PagePool
+{
+	Size		objsize;
+	Size		align;
+	/* reserve of the pool, NULL until its first allocation */
+	char	   *reserve;
+	char	   *reserveEnd;
+	PoolObject *freeList;
+	SOEMutex	lock;
+}			PagePool;
+
+typedef enum PagePoolKind
+{
+	POOL_PAGES,
+	POOL_DESCS,
+	NPOOLS
+}			PagePoolKind;
+
+static PagePool pools[NPOOLS] = {
+	{BLCKSZ, BLCKSZ, NULL, NULL, NULL, SOE_MUTEX_INITIALIZER},
+	{PAGE_POOL_DESC_SIZE, MAXIMUM_ALIGNOF, NULL, NULL, NULL, SOE_MUTEX_INITIALIZER}
+};
+
+static __thread PoolObject *local_free[NPOOLS];
+static __thread int local_count[NPOOLS];
+
+/* Allocates the reserve of pool. The caller holds the pool lock. */
+static void
+pagepool_reserve(PagePool * pool)
+{
+	char	   *memory = (char *) malloc(PAGE_POOL_SIZE * pool->objsize + pool->align);
+	char	   *object;
+
+	if (memory == NULL)
+	{
+		selog(ERROR, "Could not allocate a pool of %d objects of %zu bytes",
+			  PAGE_POOL_SIZE, pool->objsize);
+		return;
+	}
+
+	pool->reserve = (char *) TYPEALIGN_s(pool->align, memory);
+	pool->reserveEnd = pool->reserve + PAGE_POOL_SIZE * pool->objsize;
+
+	for (object = pool->reserveEnd - pool->objsize; object >= pool->reserve;
+		 object -= pool->objsize)
+	{
+		((PoolObject *) object)->next = pool->freeList;
+		pool->freeList = (PoolObject *) object;
+	}
+}
+
+static void *
+pagepool_get(PagePoolKind kind)
+{
+	PagePool   *pool = &pools[kind];
+	PoolObject *object;
+
+	if (local_free[kind] == NULL)
+	{
+		soe_mutex_lock(&pool->lock);
+		if (pool->reserve == NULL)
+		{
+			pagepool_reserve(pool);
+		}
+		while (pool->freeList != NULL && local_count[kind] < PAGE_POOL_BATCH)
+		{
+			object = pool->freeList;
+			pool->freeList = object->next;
+			object->next = local_free[kind];
+			local_free[kind] = object;
+			local_count[kind]++;
+		}
+		soe_mutex_unlock(&pool->lock);
+	}
+
+	object = local_free[kind];
+	if (object == NULL)
+	{
+		/* The reserve is exhausted. */
+		return malloc(pool->objsize);
+	}
+
+	local_free[kind] = object->next;
+	local_count[kind]--;
+
+	return object;
+}
+
+static void
+pagepool_put(PagePoolKind kind, void *ptr)
+{
+	PagePool   *pool = &pools[kind];
+	PoolObject *object = (PoolObject *) ptr;
+
+	if (ptr == NULL)
+	{
+		return;
+	}
+
+	if ((char *) ptr < pool->reserve || (char *) ptr >= pool->reserveEnd)
+	{
+		free(ptr);
+		return;
+	}
+
+	object->next = local_free[kind];
+	local_free[kind] = object;
+	local_count[kind]++;
+
+	if (local_count[kind] < 2 * PAGE_POOL_BATCH)
+	{
+		return;
+	}
+
+	soe_mutex_lock(&pool->lock);
+	while (local_count[kind] > PAGE_POOL_BATCH)
+	{
+		object = local_free[kind];
+		local_free[kind] = object->next;
+		local_count[kind]--;
+		object->next = pool->freeList;
+		pool->freeList = object;
+	}
+	soe_mutex_unlock(&pool->lock);
+}
+
+/* Returns an uninitialized page. */
+char *
+pagepool_alloc(void)
+{
+	return (char *) pagepool_get(POOL_PAGES);
+}
+
+/* Releases a page of the pool or a page allocated with malloc. */
+void
+pagepool_free(void *page)
+{
+	pagepool_put(POOL_PAGES, page);
+}
+
+void *
+pagepool_desc_alloc(Size size)
+{
+	if (size > PAGE_POOL_DESC_SIZE)
+	{
+		selog(ERROR, "Buffer descriptor of %zu bytes is larger than %d",
+			  size, PAGE_POOL_DESC_SIZE);
+		return NULL;
+	}
+
+	return pagepool_get(POOL_DESCS);
+}
+
+void
+pagepool_desc_free(void *desc)
+{
+	pagepool_put(POOL_DESCS, desc);
+}
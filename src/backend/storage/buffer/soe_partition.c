@@ -0,0 +1,293 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_partition.c
+ *	  Accesses to the partitions of a partitioned heap ORAM.
+ *
+ * An access to a partitioned heap is split in one job per partition: the
+ * job of the partition that holds the block reads or writes it, and every
+ * other job reads a random block of its partition. The jobs are queued and
+ * run by the worker threads and by the requesting thread, which takes jobs
+ * from the queue until all the jobs of its access are done. Without
+ * workers, the requesting thread runs every job itself.
+ *
+ * The jobs of an access touch different partitions and the relation lock
+ * of the requesting thread keeps other accesses away from them, so a
+ * partition ORAM is never used by two jobs at the same time.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/storage/buffer/soe_partition.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "storage/soe_partition.h"
+#include "storage/soe_vofile.h"
+#include "storage/soe_lock.h"
+#include "common/soe_pe.h"
+#include "utils/soe_counters.h"
+#include "logger/logger.h"
+
+#include <oram/orandom.h>
+#include <stdlib.h>
+
+typedef struct PartitionJob
+{
+	ORAMPartitions parts;
+	int			partition;
+	/* block of the partition ORAM */
+	BlockNumber blkno;
+	/* page to write, or NULL to read the block */
+	char	   *wpage;
+	/* page read */
+	char	   *rpage;
+	int			result;
+	/* number of jobs of the access that are not done */
+	int		   *pending;
+	struct PartitionJob *next;
+}			PartitionJob;
+
+/* Queue of the jobs that no thread has taken yet. */
+static PartitionJob *jobs_head = NULL;
+static PartitionJob *jobs_tail = NULL;
+static SOEMutex jobs_lock = SOE_MUTEX_INITIALIZER;
+static SOECond jobs_posted = SOE_COND_INITIALIZER;
+static SOECond jobs_done = SOE_COND_INITIALIZER;
+static int	nworkers = 0;
+static bool stopping = false;
+
+static void
+partition_job_run(PartitionJob * job)
+{
+	ORAMState	oram = job->parts->orams[job->partition];
+	HeapPartition hpart = &job->parts->partitions[job->partition];
+
+	if (job->wpage != NULL)
+	{
+		job->result = write_oram(job->wpage, BLCKSZ, job->blkno, oram, hpart);
+	}
+	else
+	{
+		job->result = read_oram(&job->rpage, job->blkno, oram, hpart);
+	}
+
+	/* The writes queued by this thread must be sent before the job is done. */
+	vofile_flush();
+}
+
+/* Removes the first job of the queue. The caller holds jobs_lock. */
+static PartitionJob *
+partition_job_next(void)
+{
+	PartitionJob *job = jobs_head;
+
+	if (job != NULL)
+	{
+		jobs_head = job->next;
+		if (jobs_head == NULL)
+		{
+			jobs_tail = NULL;
+		}
+	}
+
+	return job;
+}
+
+/* Runs job without holding jobs_lock, which the caller holds. */
+static void
+partition_job_complete(PartitionJob * job)
+{
+	soe_mutex_unlock(&jobs_lock);
+	partition_job_run(job);
+	soe_mutex_lock(&jobs_lock);
+
+	(*job->pending)--;
+	soe_cond_broadcast(&jobs_done);
+}
+
+/*
+ * Accesses heap block blkno, writing wpage to it if it is not NULL, and
+ * reads a random block of every other partition.
+ */
+static int
+partition_access(ORAMPartitions parts, char **page, char *wpage, BlockNumber blkno)
+{
+	int			partition;
+	int			target = blkno % parts->npartitions;
+	int			pending = parts->npartitions;
+	int			result;
+	PartitionJob *job;
+	PartitionJob *pjobs;
+
+	pjobs = (PartitionJob *) malloc(sizeof(PartitionJob) * parts->npartitions);
+
+	/*
+	 * Counted here rather than by the jobs, so that the accesses are charged
+	 * to the relation of the requesting thread.
+	 */
+	if (wpage != NULL)
+	{
+		COUNTERS_INC(oramWrites);
+	}
+	else
+	{
+		COUNTERS_INC(oramReads);
+	}
+	COUNTERS_ADD(oramReads, parts->npartitions - 1);
+	COUNTERS_ADD(dummyReads, parts->npartitions - 1);
+
+	for (partition = 0; partition < parts->npartitions; partition++)
+	{
+		job = &pjobs[partition];
+		job->parts = parts;
+		job->partition = partition;
+		if (partition == target)
+		{
+			job->blkno = blkno / parts->npartitions;
+			job->wpage = wpage;
+		}
+		else
+		{
+			job->blkno = getRandomInt() % parts->nblocks;
+			job->wpage = NULL;
+		}
+		job->rpage = NULL;
+		job->result = 0;
+		job->pending = &pending;
+		job->next = NULL;
+	}
+
+	soe_mutex_lock(&jobs_lock);
+	for (partition = 0; partition < parts->npartitions; partition++)
+	{
+		if (jobs_tail == NULL)
+		{
+			jobs_head = &pjobs[partition];
+		}
+		else
+		{
+			jobs_tail->next = &pjobs[partition];
+		}
+		jobs_tail = &pjobs[partition];
+	}
+	soe_cond_broadcast(&jobs_posted);
+
+	while (pending > 0)
+	{
+		job = partition_job_next();
+		if (job != NULL)
+		{
+			partition_job_complete(job);
+		}
+		else
+		{
+			soe_cond_wait(&jobs_done, &jobs_lock);
+		}
+	}
+	soe_mutex_unlock(&jobs_lock);
+
+	for (partition = 0; partition < parts->npartitions; partition++)
+	{
+		if (partition != target)
+		{
+			free(pjobs[partition].rpage);
+		}
+	}
+
+	if (page != NULL)
+	{
+		*page = pjobs[target].rpage;
+	}
+	else
+	{
+		free(pjobs[target].rpage);
+	}
+	result = pjobs[target].result;
+	free(pjobs);
+
+	return result;
+}
+
+/* Same as read_oram on the partition that holds blkno. */
+int
+partition_read(ORAMPartitions parts, char **page, BlockNumber blkno)
+{
+	return partition_access(parts, page, NULL, blkno);
+}
+
+/* Same as write_oram on the partition that holds blkno. */
+int
+partition_write(ORAMPartitions parts, char *page, BlockNumber blkno)
+{
+	return partition_access(parts, NULL, page, blkno);
+}
+
+void
+partition_close(ORAMPartitions parts)
+{
+	int			partition;
+
+	for (partition = 0; partition < parts->npartitions; partition++)
+	{
+		close_oram(parts->orams[partition], &parts->partitions[partition]);
+		free(parts->amgrs[partition]);
+	}
+	free(parts->orams);
+	free(parts->amgrs);
+	free(parts->partitions);
+	free(parts);
+}
+
+/*
+ * Runs the jobs of the partitioned heaps until partition_workers_stop is
+ * called.
+ */
+void
+partition_worker_run(void)
+{
+	PartitionJob *job;
+
+	soe_mutex_lock(&jobs_lock);
+	nworkers++;
+	while (!stopping)
+	{
+		job = partition_job_next();
+		if (job != NULL)
+		{
+			partition_job_complete(job);
+		}
+		else
+		{
+			soe_cond_wait(&jobs_posted, &jobs_lock);
+		}
+	}
+	soe_mutex_unlock(&jobs_lock);
+
+	/*
+	 * The state of the thread is freed before partition_workers_stop
+	 * returns, as closeSoe frees that of every thread after it.
+	 */
+	vofile_thread_close();
+	page_crypto_thread_close();
+
+	soe_mutex_lock(&jobs_lock);
+	nworkers--;
+	soe_cond_broadcast(&jobs_done);
+	soe_mutex_unlock(&jobs_lock);
+}
+
+/* Makes the workers return and waits for them. */
+void
+partition_workers_stop(void)
+{
+	soe_mutex_lock(&jobs_lock);
+	stopping = true;
+	soe_cond_broadcast(&jobs_posted);
+	while (nworkers > 0)
+	{
+		soe_cond_wait(&jobs_done, &jobs_lock);
+	}
+	stopping = false;
+	soe_mutex_unlock(&jobs_lock);
+}
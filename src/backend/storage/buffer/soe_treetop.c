@@ -0,0 +1,136 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_treetop.c
+ *	  Enclave copy of the top levels of the ORAM bucket trees.
+ *
+ * Each ORAM that asked for the cache has the plaintext of the first
+ * blocks of its file. A block is copied in on the first read, which goes
+ * to the file, or on any write. From then on the file copy is stale and
+ * never read again; the file is discarded with the ORAM state when the
+ * relation is closed, so the cached blocks are not written back. The cache
+ * of an ORAM is only used by the thread that holds the lock of its
+ * relation.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/storage/buffer/soe_treetop.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "storage/soe_treetop.h"
+#include "storage/soe_vofile.h"
+#include "logger/logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Deepest tree top that can be asked for. */
+#define TREETOP_MAX_LEVELS 16
+
+struct TreeTopFile
+{
+	/* number of file blocks cached */
+	BlockNumber nblocks;
+	char	  **pages;
+};
+
+/* Returns the cache slot of blkno, or NULL if the block is not cached. */
+static inline char **
+treetop_slot(TreeTopFile *tfile, BlockNumber blkno)
+{
+	if (tfile == NULL || blkno >= tfile->nblocks)
+	{
+		return NULL;
+	}
+
+	return &tfile->pages[blkno];
+}
+
+/*
+ * Caches the first nlevels levels of the ORAM tree stored on filename, or
+ * returns NULL if no level is cached. Must be called before the ORAM is
+ * initialized, as the initialization already goes through the oblivious
+ * file.
+ */
+TreeTopFile *
+treetop_create(const char *filename, unsigned int nlevels)
+{
+	TreeTopFile *tfile;
+
+	if (nlevels == 0)
+	{
+		return NULL;
+	}
+
+	if (nlevels > TREETOP_MAX_LEVELS)
+	{
+		selog(ERROR, "Can't cache more than %d ORAM levels of relation %s", TREETOP_MAX_LEVELS, filename);
+		nlevels = TREETOP_MAX_LEVELS;
+	}
+
+	tfile = (TreeTopFile *) malloc(sizeof(TreeTopFile));
+	tfile->nblocks = ((1 << nlevels) - 1) * BKCAP;
+	tfile->pages = (char **) calloc(tfile->nblocks, sizeof(char *));
+
+	return tfile;
+}
+
+/*
+ * Copies the cached block blkno of tfile to page. Returns false when the
+ * block has to be read from the file.
+ */
+bool
+treetop_read(TreeTopFile *tfile, BlockNumber blkno, char *page)
+{
+	char	  **slot = treetop_slot(tfile, blkno);
+
+	if (slot == NULL || *slot == NULL)
+	{
+		return false;
+	}
+
+	memcpy(page, *slot, BLCKSZ);
+	return true;
+}
+
+/*
+ * Stores page as block blkno of tfile if it is on the cached levels.
+ * Returns false when the block has to be written to the file.
+ */
+bool
+treetop_write(TreeTopFile *tfile, BlockNumber blkno, const char *page)
+{
+	char	  **slot = treetop_slot(tfile, blkno);
+
+	if (slot == NULL)
+	{
+		return false;
+	}
+
+	if (*slot == NULL)
+	{
+		*slot = (char *) malloc(BLCKSZ);
+	}
+	memcpy(*slot, page, BLCKSZ);
+	return true;
+}
+
+void
+treetop_close(TreeTopFile *tfile)
+{
+	BlockNumber blkno;
+
+	if (tfile == NULL)
+	{
+		return;
+	}
+
+	for (blkno = 0; blkno < tfile->nblocks; blkno++)
+	{
+		free(tfile->pages[blkno]);
+	}
+	free(tfile->pages);
+	free(tfile);
+}
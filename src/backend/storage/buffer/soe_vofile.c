@@ -0,0 +1,618 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_vofile.c
+ *	  Vectored I/O on the relation files used by the oblivious files.
+ *
+ * Writes are queued per file and sent in a single OCALL. A read of a block
+ * that is still queued is served from the queue, so the queue can be
+ * flushed at any point without changing the content read by the ORAM.
+ *
+ * The ORAM reads the blocks of a bucket one after the other, so the first
+ * read of a bucket fetches the whole bucket with a single outFileReadv, and
+ * the following reads are served from the enclave copy. The copy is only
+ * kept until the end of the ORAM access, when the write queue is flushed.
+ *
+ * With a request ring, reads of the blocks expected next can be posted
+ * ahead of time instead. A prefetched block is dropped when it is written
+ * before being read.
+ *
+ * Each enclave thread has its own write queue. The buffer layer flushes the
+ * queue at the end of every ORAM access, while the caller still holds the
+ * lock of the relation, so no thread reads a block queued by another one.
+ * The queues of all threads are freed by vofile_close.
+ * The ring is shared by all threads and protected by ring_lock.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/storage/buffer/soe_vofile.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "soe_c.h"
+#include "storage/soe_vofile.h"
+#include "logger/logger.h"
+#include "soe_ring.h"
+#include "storage/soe_lock.h"
+#include "utils/soe_counters.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * Blocks of the last bucket read that were not yet read by the ORAM, or
+ * VOFILE_NO_BLOCK.
+ */
+#define VOFILE_NO_BLOCK (-1)
+
+/* Write queue and bucket copy of an enclave thread. */
+typedef struct VOFileThread
+{
+	/* Queued writes of a single file. */
+	char	   *wfilename;
+	int			wblknos[VOFILE_BATCH_BLOCKS];
+	char	   *wpages;
+	int			wnblocks;
+
+	char	   *rfilename;
+	int			rblknos[BKCAP];
+	char	   *rpages;
+	int			rnblocks;
+	struct VOFileThread *next;
+}			VOFileThread;
+
+/*
+ * The state of every thread is kept on a list, so that vofile_close frees
+ * it for all the threads that used the SOE and not only for the one that
+ * closes it. A thread whose state was freed has an old generation and
+ * starts a new one.
+ */
+static __thread VOFileThread *vthread = NULL;
+static __thread uint32 vthread_generation = 0;
+static VOFileThread *vthreads = NULL;
+static uint32 vthreads_generation = 0;
+static SOEMutex vthreads_lock = SOE_MUTEX_INITIALIZER;
+
+/* Request ring in untrusted memory, if the switchless transport is used. */
+static SOERing *ring = NULL;
+static int	ring_next = 0;
+static SOEMutex ring_lock = SOE_MUTEX_INITIALIZER;
+
+/*
+ * Enclave copy of the request posted on each ring slot. The copy on the
+ * ring is not trusted to find prefetched blocks.
+ */
+typedef struct VOFileRequest
+{
+	/* SOE_RING_READ, SOE_RING_WRITE or VOFILE_NO_REQUEST */
+	int			op;
+	int			blkno;
+	char		filename[SOE_RING_NAMELEN];
+
+	/*
+	 * A thread waits for the read outside of ring_lock, so the slot can't
+	 * be reused until it has copied the page. There are fewer threads than
+	 * slots, so there is always a slot that can be reused.
+	 */
+	bool		waiting;
+}			VOFileRequest;
+
+#define VOFILE_NO_REQUEST (-1)
+
+static VOFileRequest requests[SOE_RING_SLOTS];
+
+static void
+vofile_ring_wait(SOERingSlot * slot)
+{
+	while (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SOE_RING_DONE)
+	{
+		__builtin_ia32_pause();
+	}
+}
+
+/*
+ * Returns the index of the next ring slot, waiting for the request it
+ * holds to be served. A prefetched block that was not read is dropped.
+ * The caller holds ring_lock.
+ */
+static int
+vofile_ring_slot(void)
+{
+	int			offset;
+	SOERingSlot *slot;
+
+	do
+	{
+		offset = ring_next;
+		ring_next = (ring_next + 1) % SOE_RING_SLOTS;
+	} while (requests[offset].waiting);
+
+	slot = &ring->slots[offset];
+
+	if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == SOE_RING_POSTED)
+	{
+		vofile_ring_wait(slot);
+	}
+	slot->state = SOE_RING_FREE;
+	requests[offset].op = VOFILE_NO_REQUEST;
+
+	return offset;
+}
+
+static void
+vofile_ring_post(int offset, int op, const char *filename, int blkno)
+{
+	SOERingSlot *slot = &ring->slots[offset];
+
+	requests[offset].op = op;
+	requests[offset].blkno = blkno;
+	strcpy(requests[offset].filename, filename);
+
+	slot->op = op;
+	slot->blkno = blkno;
+	strcpy(slot->filename, filename);
+	__atomic_store_n(&slot->state, SOE_RING_POSTED, __ATOMIC_RELEASE);
+}
+
+/*
+ * Returns the slot with a pending read of blkno that no thread is waiting
+ * for, or -1. The caller holds ring_lock.
+ */
+static int
+vofile_ring_prefetched(const char *filename, int blkno)
+{
+	int			offset;
+
+	for (offset = 0; offset < SOE_RING_SLOTS; offset++)
+	{
+		if (requests[offset].op == SOE_RING_READ
+			&& !requests[offset].waiting
+			&& requests[offset].blkno == blkno
+			&& strcmp(requests[offset].filename, filename) == 0)
+		{
+			return offset;
+		}
+	}
+
+	return -1;
+}
+
+static void
+vofile_ring_reset(void)
+{
+	int			offset;
+
+	for (offset = 0; offset < SOE_RING_SLOTS; offset++)
+	{
+		requests[offset].op = VOFILE_NO_REQUEST;
+		requests[offset].waiting = false;
+	}
+	ring_next = 0;
+}
+
+/*
+ * Uses ring for the following page I/O. Requests on files with names that
+ * do not fit in a ring slot are still sent with OCALLs.
+ */
+void
+vofile_set_ring(void *uring)
+{
+#ifndef UNSAFE
+	if (uring != NULL && !sgx_is_outside_enclave(uring, sizeof(SOERing)))
+	{
+		selog(ERROR, "Request ring must be outside of the enclave");
+		return;
+	}
+#endif
+	vofile_flush();
+	soe_mutex_lock(&ring_lock);
+	ring = (SOERing *) uring;
+	vofile_ring_reset();
+	soe_mutex_unlock(&ring_lock);
+}
+
+/* Returns the state of the calling thread, creating it on first use. */
+static VOFileThread *
+vofile_thread(void)
+{
+	if (vthread != NULL
+		&& vthread_generation == __atomic_load_n(&vthreads_generation, __ATOMIC_ACQUIRE))
+	{
+		return vthread;
+	}
+
+	vthread = (VOFileThread *) calloc(1, sizeof(VOFileThread));
+	soe_mutex_lock(&vthreads_lock);
+	vthread->next = vthreads;
+	vthreads = vthread;
+	vthread_generation = vthreads_generation;
+	soe_mutex_unlock(&vthreads_lock);
+
+	return vthread;
+}
+
+static void
+vofile_thread_free(VOFileThread * vt)
+{
+	free(vt->wpages);
+	free(vt->wfilename);
+	free(vt->rpages);
+	free(vt->rfilename);
+	free(vt);
+}
+
+static int
+vofile_queued(const char *filename, int blkno)
+{
+	VOFileThread *vt = vofile_thread();
+	int			offset;
+
+	if (vt->wnblocks == 0 || strcmp(vt->wfilename, filename) != 0)
+	{
+		return -1;
+	}
+
+	for (offset = 0; offset < vt->wnblocks; offset++)
+	{
+		if (vt->wblknos[offset] == blkno)
+		{
+			return offset;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Returns the position of blkno among the blocks read with its bucket, or
+ * -1 if it is not there.
+ */
+static int
+vofile_bucket_cached(const char *filename, int blkno)
+{
+	VOFileThread *vt = vofile_thread();
+	int			offset;
+
+	if (vt->rnblocks == 0 || strcmp(vt->rfilename, filename) != 0)
+	{
+		return -1;
+	}
+
+	for (offset = 0; offset < vt->rnblocks; offset++)
+	{
+		if (vt->rblknos[offset] == blkno)
+		{
+			return offset;
+		}
+	}
+
+	return -1;
+}
+
+sgx_status_t
+vofile_read(char *page, const char *filename, int blkno)
+{
+	VOFileThread *vt = vofile_thread();
+	int			offset = vofile_queued(filename, blkno);
+	SOERingSlot *slot;
+
+	if (offset >= 0)
+	{
+		memcpy(page, vt->wpages + offset * BLCKSZ, BLCKSZ);
+		return SGX_SUCCESS;
+	}
+
+	offset = vofile_bucket_cached(filename, blkno);
+	if (offset >= 0)
+	{
+		memcpy(page, vt->rpages + offset * BLCKSZ, BLCKSZ);
+		/* Each block is read once per access. */
+		vt->rblknos[offset] = VOFILE_NO_BLOCK;
+		return SGX_SUCCESS;
+	}
+
+	if (ring != NULL && strlen(filename) < SOE_RING_NAMELEN)
+	{
+		soe_mutex_lock(&ring_lock);
+		offset = vofile_ring_prefetched(filename, blkno);
+		if (offset < 0)
+		{
+			offset = vofile_ring_slot();
+			vofile_ring_post(offset, SOE_RING_READ, filename, blkno);
+			COUNTERS_INC(ringReads);
+		}
+		requests[offset].waiting = true;
+		soe_mutex_unlock(&ring_lock);
+
+		slot = &ring->slots[offset];
+		vofile_ring_wait(slot);
+		memcpy(page, slot->page, BLCKSZ);
+
+		soe_mutex_lock(&ring_lock);
+		slot->state = SOE_RING_FREE;
+		requests[offset].op = VOFILE_NO_REQUEST;
+		requests[offset].waiting = false;
+		soe_mutex_unlock(&ring_lock);
+		return SGX_SUCCESS;
+	}
+
+	COUNTERS_INC(ocallReads);
+	COUNTERS_ADD(bytesRead, BLCKSZ);
+	return outFileRead(page, filename, blkno, BLCKSZ);
+}
+
+/*
+ * Posts reads of the nblocks blocks that follow blkno on the request ring
+ * without waiting for them, so that the untrusted side fetches them while
+ * the enclave decrypts the block it has just read. Does nothing without a
+ * ring.
+ */
+void
+vofile_read_ahead(const char *filename, int blkno, int nblocks)
+{
+	int			cblkno;
+
+	if (ring == NULL || strlen(filename) >= SOE_RING_NAMELEN)
+	{
+		return;
+	}
+
+	/* Keep slots free for the reads and writes of the current access. */
+	nblocks = Min_s(nblocks, SOE_RING_SLOTS / 4);
+
+	soe_mutex_lock(&ring_lock);
+	for (cblkno = blkno + 1; cblkno <= blkno + nblocks; cblkno++)
+	{
+		if (vofile_queued(filename, cblkno) >= 0
+			|| vofile_ring_prefetched(filename, cblkno) >= 0)
+		{
+			continue;
+		}
+		vofile_ring_post(vofile_ring_slot(), SOE_RING_READ, filename, cblkno);
+		COUNTERS_INC(ringReads);
+	}
+	soe_mutex_unlock(&ring_lock);
+}
+
+/*
+ * Reads nblocks blocks of a file into consecutive pages with a single OCALL.
+ * The queued writes of the file are sent first.
+ */
+sgx_status_t
+vofile_readv(char *pages, const char *filename, const int *blknos, int nblocks)
+{
+	VOFileThread *vt = vofile_thread();
+	if (vt->wnblocks > 0 && strcmp(vt->wfilename, filename) == 0)
+	{
+		vofile_flush();
+	}
+
+	COUNTERS_INC(ocallReads);
+	COUNTERS_ADD(bytesRead, nblocks * BLCKSZ);
+	return outFileReadv(pages, filename, blknos, nblocks, BLCKSZ, nblocks * BLCKSZ);
+}
+
+/*
+ * Reads block blkno, followed on the file by the other nblocks - 1 blocks
+ * of its bucket, which the ORAM reads next. The bucket is read with
+ * vofile_readv and the other blocks are kept for the following vofile_read
+ * calls. Reads on a request ring, or of a block already in the enclave,
+ * are left to vofile_read.
+ */
+sgx_status_t
+vofile_read_bucket(char *page, const char *filename, int blkno, int nblocks)
+{
+	VOFileThread *vt = vofile_thread();
+	int			blknos[BKCAP];
+	int			offset;
+	int			namelen;
+	sgx_status_t status;
+
+	if (nblocks <= 1 || ring != NULL
+		|| vofile_queued(filename, blkno) >= 0
+		|| vofile_bucket_cached(filename, blkno) >= 0)
+	{
+		return vofile_read(page, filename, blkno);
+	}
+
+	nblocks = Min_s(nblocks, BKCAP);
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		blknos[offset] = blkno + offset;
+	}
+
+	if (vt->rpages == NULL)
+	{
+		vt->rpages = (char *) malloc(BKCAP * BLCKSZ);
+	}
+
+	vt->rnblocks = 0;
+	status = vofile_readv(vt->rpages, filename, blknos, nblocks);
+	if (status != SGX_SUCCESS)
+	{
+		return status;
+	}
+	memcpy(page, vt->rpages, BLCKSZ);
+
+	free(vt->rfilename);
+	namelen = strlen(filename) + 1;
+	vt->rfilename = (char *) malloc(namelen);
+	memcpy(vt->rfilename, filename, namelen);
+
+	/*
+	 * blkno is read now. A block of the bucket that is written before it is
+	 * read is then served from the write queue, which is looked up first.
+	 */
+	vt->rblknos[0] = VOFILE_NO_BLOCK;
+	for (offset = 1; offset < nblocks; offset++)
+	{
+		vt->rblknos[offset] = blknos[offset];
+	}
+	vt->rnblocks = nblocks;
+
+	return SGX_SUCCESS;
+}
+
+/*
+ * Returns the queue page where the caller writes the content of block
+ * blkno. A block that is already queued is overwritten in place.
+ */
+char *
+vofile_write_page(const char *filename, int blkno)
+{
+	VOFileThread *vt = vofile_thread();
+	int			offset;
+	int			namelen;
+
+	offset = vofile_queued(filename, blkno);
+	if (offset >= 0)
+	{
+		return vt->wpages + offset * BLCKSZ;
+	}
+
+	/* A block prefetched before this write would be read stale. */
+	if (ring != NULL)
+	{
+		soe_mutex_lock(&ring_lock);
+		offset = vofile_ring_prefetched(filename, blkno);
+		if (offset >= 0)
+		{
+			requests[offset].op = VOFILE_NO_REQUEST;
+		}
+		soe_mutex_unlock(&ring_lock);
+	}
+
+	if (vt->wnblocks == VOFILE_BATCH_BLOCKS
+		|| (vt->wnblocks > 0 && strcmp(vt->wfilename, filename) != 0))
+	{
+		vofile_flush();
+	}
+
+	if (vt->wpages == NULL)
+	{
+		vt->wpages = (char *) malloc(VOFILE_BATCH_BLOCKS * BLCKSZ);
+	}
+
+	if (vt->wnblocks == 0)
+	{
+		free(vt->wfilename);
+		namelen = strlen(filename) + 1;
+		vt->wfilename = (char *) malloc(namelen);
+		memcpy(vt->wfilename, filename, namelen);
+	}
+
+	vt->wblknos[vt->wnblocks] = blkno;
+	return vt->wpages + (vt->wnblocks++) * BLCKSZ;
+}
+
+void
+vofile_flush(void)
+{
+	VOFileThread *vt = vofile_thread();
+	sgx_status_t status;
+	int			sindex;
+	int			offset;
+
+	/* The next access may write the blocks of the bucket before it. */
+	vt->rnblocks = 0;
+
+	if (vt->wnblocks == 0)
+	{
+		return;
+	}
+
+	if (ring != NULL && strlen(vt->wfilename) < SOE_RING_NAMELEN)
+	{
+		soe_mutex_lock(&ring_lock);
+		for (offset = 0; offset < vt->wnblocks; offset++)
+		{
+			sindex = vofile_ring_slot();
+			memcpy(ring->slots[sindex].page, vt->wpages + offset * BLCKSZ, BLCKSZ);
+			vofile_ring_post(sindex, SOE_RING_WRITE, vt->wfilename, vt->wblknos[offset]);
+		}
+		COUNTERS_ADD(ringWrites, vt->wnblocks);
+
+		/*
+		 * Wait for every write before the blocks can be read again. Pending
+		 * prefetches are left to complete.
+		 */
+		for (sindex = 0; sindex < SOE_RING_SLOTS; sindex++)
+		{
+			if (requests[sindex].op == SOE_RING_WRITE)
+			{
+				vofile_ring_wait(&ring->slots[sindex]);
+				requests[sindex].op = VOFILE_NO_REQUEST;
+			}
+		}
+		soe_mutex_unlock(&ring_lock);
+		vt->wnblocks = 0;
+		return;
+	}
+
+	COUNTERS_INC(ocallWrites);
+	COUNTERS_ADD(bytesWritten, vt->wnblocks * BLCKSZ);
+	status = outFileWritev(vt->wpages, vt->wfilename, vt->wblknos, vt->wnblocks,
+						   BLCKSZ, vt->wnblocks * BLCKSZ);
+
+	if (status != SGX_SUCCESS)
+	{
+		selog(ERROR, "Could not write %d blocks on relation %s\n", vt->wnblocks, vt->wfilename);
+	}
+
+	vt->wnblocks = 0;
+}
+
+/* Flushes and frees the write queue of the calling thread. */
+void
+vofile_thread_close(void)
+{
+	VOFileThread **prev;
+
+	if (vthread == NULL
+		|| vthread_generation != __atomic_load_n(&vthreads_generation, __ATOMIC_ACQUIRE))
+	{
+		vthread = NULL;
+		return;
+	}
+
+	vofile_flush();
+	soe_mutex_lock(&vthreads_lock);
+	for (prev = &vthreads; *prev != vthread; prev = &(*prev)->next)
+	{
+		/* vthread is on the list */
+	}
+	*prev = vthread->next;
+	soe_mutex_unlock(&vthreads_lock);
+
+	vofile_thread_free(vthread);
+	vthread = NULL;
+}
+
+/*
+ * Stops using the ring and frees the write queues of all threads. The
+ * queue of the calling thread is flushed first; no other thread may be
+ * running in the SOE.
+ */
+void
+vofile_close(void)
+{
+	VOFileThread *vt;
+
+	vofile_thread_close();
+
+	soe_mutex_lock(&vthreads_lock);
+	while (vthreads != NULL)
+	{
+		vt = vthreads;
+		vthreads = vt->next;
+		vofile_thread_free(vt);
+	}
+	__atomic_add_fetch(&vthreads_generation, 1, __ATOMIC_RELEASE);
+	soe_mutex_unlock(&vthreads_lock);
+
+	soe_mutex_lock(&ring_lock);
+	ring = NULL;
+	vofile_ring_reset();
+	soe_mutex_unlock(&ring_lock);
+}
@@ -1,5 +1,6 @@
 #include "access/soe_htup_details.h"
 #include "storage/soe_bufpage.h"
+#include "storage/soe_pagepool.h"
 #include "logger/logger.h"
 #include "utils/soe_qsort.h"
 
@@ -527,7 +528,7 @@ PageRestoreTempPage_s(Page tempPage, Page oldPage)
 	pageSize = PageGetPageSize_s(tempPage);
 	memcpy((char *) oldPage, (char *) tempPage, pageSize);
 
-	free(tempPage);
+	pagepool_free(tempPage);
 }
 
 
@@ -535,15 +536,10 @@ PageRestoreTempPage_s(Page tempPage, Page oldPage)
  * PageGetTempPage
  *		Get a temporary page in local memory for special processing.
  *		The returned page is not initialized at all; caller must do that.
+ *		Pages are BLCKSZ long, so the page comes from the page pool.
  */
 Page
 PageGetTempPage_s(Page page)
 {
-	Size		pageSize;
-	Page		temp;
-
-	pageSize = PageGetPageSize_s(page);
-	temp = (Page) malloc(pageSize);
-
-	return temp;
+	return (Page) pagepool_alloc();
 }
@@ -0,0 +1,151 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_arena.c
+ *	  Bump-pointer arenas for the temporaries of the requests.
+ *
+ * The chunks of an arena are kept on a list. An allocation that does not
+ * fit on the current chunk moves to the next one, allocating it if it is
+ * the last. arena_reset rewinds to the first chunk and frees the chunks of
+ * the allocations larger than ARENA_CHUNK_SIZE, so the steady state of the
+ * requests makes no malloc calls and the enclave heap only holds chunks of
+ * the same size.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/utils/soe_arena.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "utils/soe_arena.h"
+#include "logger/logger.h"
+
+#include <stdlib.h>
+
+typedef struct ArenaChunk
+{
+	struct ArenaChunk *next;
+	Size		size;
+	Size		used;
+}			ArenaChunk;
+
+#define ARENA_CHUNK_HEADER MAXALIGN_s(sizeof(ArenaChunk))
+#define ArenaChunkData(chunk) ((char *) (chunk) + ARENA_CHUNK_HEADER)
+
+typedef struct SOEArenaData
+{
+	ArenaChunk *chunks;
+	ArenaChunk *current;
+}			SOEArenaData;
+
+static __thread SOEArena request_arena = NULL;
+
+static ArenaChunk *
+arena_chunk(Size size)
+{
+	ArenaChunk *chunk = (ArenaChunk *) malloc(ARENA_CHUNK_HEADER + size);
+
+	if (chunk == NULL)
+	{
+		selog(ERROR, "Could not allocate an arena chunk of %zu bytes", size);
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+SOEArena
+arena_create(void)
+{
+	SOEArena	arena = (SOEArena) malloc(sizeof(SOEArenaData));
+
+	arena->chunks = arena_chunk(ARENA_CHUNK_SIZE);
+	arena->current = arena->chunks;
+
+	return arena;
+}
+
+void *
+arena_alloc(SOEArena arena, Size size)
+{
+	ArenaChunk *chunk = arena->current;
+	char	   *ptr;
+
+	size = MAXALIGN_s(size);
+	while (chunk->used + size > chunk->size)
+	{
+		if (chunk->next == NULL)
+		{
+			chunk->next = arena_chunk(Max_s(size, ARENA_CHUNK_SIZE));
+		}
+		chunk = chunk->next;
+	}
+	arena->current = chunk;
+
+	ptr = ArenaChunkData(chunk) + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+/* Releases all the memory allocated on arena. */
+void
+arena_reset(SOEArena arena)
+{
+	ArenaChunk **prev = &arena->chunks->next;
+	ArenaChunk *chunk;
+
+	arena->chunks->used = 0;
+	while (*prev != NULL)
+	{
+		chunk = *prev;
+		if (chunk->size > ARENA_CHUNK_SIZE)
+		{
+			*prev = chunk->next;
+			free(chunk);
+			continue;
+		}
+		chunk->used = 0;
+		prev = &chunk->next;
+	}
+	arena->current = arena->chunks;
+}
+
+void
+arena_destroy(SOEArena arena)
+{
+	ArenaChunk *chunk;
+
+	while (arena->chunks != NULL)
+	{
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+	free(arena);
+}
+
+/* Allocates size bytes that are released at the end of the ECALL. */
+void *
+request_alloc(Size size)
+{
+	if (request_arena == NULL)
+	{
+		request_arena = arena_create();
+	}
+
+	return arena_alloc(request_arena, size);
+}
+
+void
+request_reset(void)
+{
+	if (request_arena != NULL)
+	{
+		arena_reset(request_arena);
+	}
+}
@@ -0,0 +1,180 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_counters.c
+ *	  Runtime counters of the SOE and the stash size of its ORAMs.
+ *
+ * Each ORAM with a stash tracker has two bits per block: whether the block
+ * was ever written to the tree, and whether it is in the tree now. A real
+ * block read by the oblivious file leaves the tree for the stash, and it
+ * is back when the oblivious file writes it. Blocks that were never in the
+ * tree, the new blocks of write_oram, are only counted from their first
+ * eviction.
+ *
+ * The oblivious file of an ORAM is only used by the thread that holds the
+ * lock of its relation, or of its partition, so the tracker of an ORAM
+ * needs no lock of its own. Its fields are still updated with relaxed
+ * atomics, like the counters, as the partition ORAMs of a heap move
+ * between the enclave threads.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/utils/soe_counters.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "utils/soe_counters.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(UNSAFE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define COUNTERS_TSC
+#endif
+
+struct CountersORAM
+{
+	unsigned int nblocks;
+	uint8	   *written;
+	uint8	   *intree;
+	/* blocks in the stash */
+	uint64		stash;
+};
+
+SOEStats	counters_total = {SOE_STATS_VERSION, sizeof(SOEStats)};
+SOEStats	counters_ecalls[SOE_STATS_NECALLS];
+__thread SOEStats *counters_relation = NULL;
+__thread SOEStats *counters_ecall = NULL;
+
+#define COUNTERS_BIT(bits, blkno) \
+	(__atomic_load_n(&(bits)[(blkno) / 8], __ATOMIC_RELAXED) & (1 << ((blkno) % 8)))
+#define COUNTERS_SET(bits, blkno) \
+	__atomic_or_fetch(&(bits)[(blkno) / 8], 1 << ((blkno) % 8), __ATOMIC_RELAXED)
+#define COUNTERS_CLEAR(bits, blkno) \
+	__atomic_and_fetch(&(bits)[(blkno) / 8], ~(1 << ((blkno) % 8)), __ATOMIC_RELAXED)
+
+/* Setting no relation also ends the ECALL set by COUNTERS_ECALL. */
+void
+counters_set_relation(SOEStats * stats)
+{
+	counters_relation = stats;
+	if (stats == NULL)
+	{
+		counters_ecall = NULL;
+	}
+}
+
+void
+counters_reset(SOEStats * stats)
+{
+	memset(stats, 0, sizeof(SOEStats));
+	stats->version = SOE_STATS_VERSION;
+	stats->size = sizeof(SOEStats);
+}
+
+void
+counters_copy(SOEStats * dest, const SOEStats * stats)
+{
+	memcpy(dest, stats, sizeof(SOEStats));
+	dest->version = SOE_STATS_VERSION;
+	dest->size = sizeof(SOEStats);
+}
+
+uint64
+counters_cycles(void)
+{
+#ifdef COUNTERS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void
+counters_max(uint64_t *counter, uint64 value)
+{
+	uint64_t	current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+	while (current < value
+		   && !__atomic_compare_exchange_n(counter, &current, value, false,
+										   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		/* current was reloaded by the failed exchange */
+	}
+}
+
+/*
+ * Follows the stash of an ORAM of nblocks blocks. Must be called before the
+ * ORAM is initialized.
+ */
+CountersORAM *
+counters_oram_create(unsigned int nblocks)
+{
+	CountersORAM *coram = (CountersORAM *) malloc(sizeof(CountersORAM));
+
+	coram->nblocks = nblocks;
+	coram->written = (uint8 *) calloc(nblocks / 8 + 1, sizeof(uint8));
+	coram->intree = (uint8 *) calloc(nblocks / 8 + 1, sizeof(uint8));
+	coram->stash = 0;
+
+	return coram;
+}
+
+/* Block blkno was read from the tree; dummy blocks are ignored. */
+void
+counters_block_read(CountersORAM * coram, int blkno)
+{
+	uint64		stash;
+
+	if (coram == NULL || blkno < 0 || blkno >= coram->nblocks
+		|| !COUNTERS_BIT(coram->intree, blkno))
+	{
+		return;
+	}
+
+	COUNTERS_CLEAR(coram->intree, blkno);
+	stash = __atomic_add_fetch(&coram->stash, 1, __ATOMIC_RELAXED);
+
+	counters_max(&counters_total.stashHighWater, stash);
+	if (counters_ecall != NULL)
+	{
+		counters_max(&counters_ecall->stashHighWater, stash);
+	}
+	if (counters_relation != NULL)
+	{
+		counters_max(&counters_relation->stashHighWater, stash);
+	}
+}
+
+/* Block blkno was written to the tree; dummy blocks are ignored. */
+void
+counters_block_written(CountersORAM * coram, int blkno)
+{
+	if (coram == NULL || blkno < 0 || blkno >= coram->nblocks)
+	{
+		return;
+	}
+
+	if (COUNTERS_BIT(coram->written, blkno) && !COUNTERS_BIT(coram->intree, blkno)
+		&& __atomic_load_n(&coram->stash, __ATOMIC_RELAXED) > 0)
+	{
+		__atomic_sub_fetch(&coram->stash, 1, __ATOMIC_RELAXED);
+	}
+	COUNTERS_SET(coram->written, blkno);
+	COUNTERS_SET(coram->intree, blkno);
+}
+
+void
+counters_oram_close(CountersORAM * coram)
+{
+	if (coram == NULL)
+	{
+		return;
+	}
+
+	free(coram->written);
+	free(coram->intree);
+	free(coram);
+}
@@ -0,0 +1,347 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_keycmp.c
+ *	  Comparators of the index keys by the type of the indexed column.
+ *
+ * The fixed-width comparators copy both values to locals, as the scan key
+ * and the index tuple attribute are not necessarily aligned for their type.
+ * Floats are ordered as in postgres, with NaN equal to itself and greater
+ * than any other value.
+ *
+ * Abbreviated keys flip the sign bit of integers, and also the other bits
+ * of negative floats, so that they order as unsigned integers. Strings and
+ * bytea are abbreviated by up to 8 bytes after a prefix, big-endian and zero
+ * padded.
+ *
+ * The scans only know the bpchar operators, so keycmp_strategy maps the
+ * comparison operators of the other types to the bpchar operator of the
+ * same strategy.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/utils/soe_keycmp.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "utils/soe_keycmp.h"
+
+#include <string.h>
+#include <math.h>
+
+#define KEYCMP_FIXED(name, type) \
+static int32 \
+name(const char *key, int keySize, const char *datum) \
+{ \
+	type		a; \
+	type		b; \
+\
+	memcpy(&a, key, sizeof(type)); \
+	memcpy(&b, datum, sizeof(type)); \
+	return a < b ? -1 : a > b; \
+}
+
+#define KEYCMP_FLOAT(name, type) \
+static int32 \
+name(const char *key, int keySize, const char *datum) \
+{ \
+	type		a; \
+	type		b; \
+\
+	memcpy(&a, key, sizeof(type)); \
+	memcpy(&b, datum, sizeof(type)); \
+	if (isnan(a)) \
+		return isnan(b) ? 0 : 1; \
+	if (isnan(b)) \
+		return -1; \
+	return a < b ? -1 : a > b; \
+}
+
+KEYCMP_FIXED(keycmp_int2, int16)
+KEYCMP_FIXED(keycmp_int4, int32)
+KEYCMP_FIXED(keycmp_int8, int64)
+KEYCMP_FIXED(keycmp_oid, Oid)
+KEYCMP_FLOAT(keycmp_float4, float4)
+KEYCMP_FLOAT(keycmp_float8, float8)
+
+/*
+ * Bytes of the varlena datum, then the shorter value first. Index keys are
+ * never toasted, so the datum has a short or a 4-byte header.
+ */
+static int32
+keycmp_bytea(const char *key, int keySize, const char *datum)
+{
+	int			len;
+	int32		result;
+
+	len = VARATT_IS_1B_S(datum) ? VARSIZE_1B_S(datum) - VARHDRSZ_SHORT
+		: VARSIZE_4B_S(datum) - VARHDRSZ;
+
+	result = memcmp(key, VARDATA_ANY_S(datum), Min_s(keySize, len));
+	if (result != 0)
+		return result;
+
+	return keySize < len ? -1 : keySize > len;
+}
+
+/*
+ * bpchar keys are compared as strings, without the last character of the
+ * index key.
+ */
+static int32
+keycmp_string(const char *key, int keySize, const char *datum)
+{
+	char	   *value = VARDATA_ANY_S(DatumGetBpCharPP_S(datum));
+
+	return (int32) strncmp(key, value, strlen(value) - 1);
+}
+
+SOEKeyCompare
+keycmp_lookup(Form_pg_attribute att)
+{
+	switch (att->atttypid)
+	{
+		case INT2OID:
+			return &keycmp_int2;
+		case INT4OID:
+		case DATEOID:
+			return &keycmp_int4;
+		case INT8OID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return &keycmp_int8;
+		case OIDOID:
+			return &keycmp_oid;
+		case FLOAT4OID:
+			return &keycmp_float4;
+		case FLOAT8OID:
+			return &keycmp_float8;
+		case BYTEAOID:
+			return &keycmp_bytea;
+		default:
+			return &keycmp_string;
+	}
+}
+
+/*
+ * Whether keys of att are compared as strings, which soe.c stores and scans
+ * with a terminator.
+ */
+bool
+keycmp_is_string(Form_pg_attribute att)
+{
+	return keycmp_lookup(att) == &keycmp_string;
+}
+
+/* Comparison operators of a type, by strategy */
+typedef struct KeyOperators
+{
+	unsigned int lt;
+	unsigned int le;
+	unsigned int eq;
+	unsigned int ge;
+	unsigned int gt;
+}			KeyOperators;
+
+static const KeyOperators key_operators[] = {
+	{1058, 1059, 1054, 1061, 1060},	/* bpchar */
+	{95, 522, 94, 524, 520},	/* int2 */
+	{97, 523, 96, 525, 521},	/* int4 */
+	{412, 414, 410, 415, 413},	/* int8 */
+	{609, 611, 607, 612, 610},	/* oid */
+	{622, 624, 620, 625, 623},	/* float4 */
+	{672, 673, 670, 675, 674},	/* float8 */
+	{1095, 1096, 1093, 1098, 1097},	/* date */
+	{2062, 2063, 2060, 2065, 2064},	/* timestamp */
+	{1322, 1323, 1320, 1325, 1324},	/* timestamptz */
+	{1957, 1958, 1955, 1960, 1959}	/* bytea */
+};
+
+/*
+ * Returns the bpchar operator of the strategy of opoid, the operators the
+ * scans work with, or opoid itself if it is not a known operator.
+ */
+unsigned int
+keycmp_strategy(unsigned int opoid)
+{
+	int			i;
+
+	for (i = 0; i < sizeof(key_operators) / sizeof(KeyOperators); i++)
+	{
+		if (opoid == key_operators[i].lt)
+			return key_operators[0].lt;
+		if (opoid == key_operators[i].le)
+			return key_operators[0].le;
+		if (opoid == key_operators[i].eq)
+			return key_operators[0].eq;
+		if (opoid == key_operators[i].ge)
+			return key_operators[0].ge;
+		if (opoid == key_operators[i].gt)
+			return key_operators[0].gt;
+	}
+
+	return opoid;
+}
+
+/* width bytes of data, zero padded to 8, as a big-endian integer. */
+static uint64
+abbrev_bytes(const char *data, int width)
+{
+	uint64		abbrev = 0;
+	int			i;
+
+	for (i = 0; i < 8; i++)
+	{
+		abbrev <<= 8;
+		if (i < width)
+			abbrev |= (unsigned char) data[i];
+	}
+
+	return abbrev;
+}
+
+static uint64
+abbrev_int(int64 value)
+{
+	return (uint64) value ^ (UINT64CONST_s(1) << 63);
+}
+
+static uint64
+abbrev_float(float8 value)
+{
+	uint64		bits;
+
+	if (isnan(value))
+		return ~UINT64CONST_s(0);
+	/* -0 is equal to 0 */
+	if (value == 0)
+		value = 0;
+
+	memcpy(&bits, &value, sizeof(float8));
+	if (bits & (UINT64CONST_s(1) << 63))
+		return ~bits;
+	return bits ^ (UINT64CONST_s(1) << 63);
+}
+
+/* Abbreviated key of the value of a fixed-width type at data. */
+static uint64
+abbrev_fixed(Form_pg_attribute att, const char *data)
+{
+	int16		i2;
+	int32		i4;
+	int64		i8;
+	Oid			oid;
+	float4		f4;
+	float8		f8;
+
+	switch (att->atttypid)
+	{
+		case INT2OID:
+			memcpy(&i2, data, sizeof(int16));
+			return abbrev_int(i2);
+		case INT4OID:
+		case DATEOID:
+			memcpy(&i4, data, sizeof(int32));
+			return abbrev_int(i4);
+		case OIDOID:
+			memcpy(&oid, data, sizeof(Oid));
+			return oid;
+		case FLOAT4OID:
+			memcpy(&f4, data, sizeof(float4));
+			return abbrev_float(f4);
+		case FLOAT8OID:
+			memcpy(&f8, data, sizeof(float8));
+			return abbrev_float(f8);
+		default:
+			memcpy(&i8, data, sizeof(int64));
+			return abbrev_int(i8);
+	}
+}
+
+/*
+ * Returns the bytes of datum, the key attribute of an index tuple, that a
+ * key is compared with, and sets len to their number. Strings compare
+ * without their last character. Returns NULL for fixed-width types.
+ */
+const char *
+keycmp_datum_bytes(Form_pg_attribute att, const char *datum, int *len)
+{
+	SOEKeyCompare compare = keycmp_lookup(att);
+	const char *value;
+
+	if (compare == &keycmp_string)
+	{
+		value = VARDATA_ANY_S(DatumGetBpCharPP_S(datum));
+		*len = strlen(value) > 0 ? strlen(value) - 1 : 0;
+		return value;
+	}
+
+	if (compare == &keycmp_bytea)
+	{
+		*len = VARATT_IS_1B_S(datum) ? VARSIZE_1B_S(datum) - VARHDRSZ_SHORT
+			: VARSIZE_4B_S(datum) - VARHDRSZ;
+		return VARDATA_ANY_S(datum);
+	}
+
+	return NULL;
+}
+
+/*
+ * Abbreviated key of datum. The bytes of strings and bytea are taken after
+ * the first skip, and width must not be larger than the number of them
+ * left, so that the same bytes of the key decide the comparison.
+ */
+uint64
+keycmp_abbrev_datum(Form_pg_attribute att, const char *datum, int skip,
+					int width)
+{
+	const char *bytes;
+	int			len;
+
+	bytes = keycmp_datum_bytes(att, datum, &len);
+	if (bytes == NULL)
+		return abbrev_fixed(att, datum);
+
+	return abbrev_bytes(bytes + skip, width);
+}
+
+/*
+ * Compares key, of keySize bytes, with prefix, the skip bytes that all the
+ * datums of a page start with. Returns <0 or >0 if the key is less or
+ * greater than all those datums, or 0 and sets abbrev to its abbreviated
+ * key, as keycmp_abbrev_datum, if the key starts with prefix too.
+ */
+int
+keycmp_abbrev_key(Form_pg_attribute att, const char *key, int keySize,
+				  const char *prefix, int skip, int width, uint64 *abbrev)
+{
+	SOEKeyCompare compare = keycmp_lookup(att);
+	int			result;
+	int			len;
+
+	if (compare == &keycmp_string)
+	{
+		/* prefix holds no terminator, so a shorter key compares less */
+		result = strncmp(key, prefix, skip);
+		if (result != 0)
+			return result;
+		len = strnlen(key + skip, keySize - skip);
+		*abbrev = abbrev_bytes(key + skip, Min_s(len, width));
+		return 0;
+	}
+
+	if (compare == &keycmp_bytea)
+	{
+		result = memcmp(key, prefix, Min_s(keySize, skip));
+		if (result != 0)
+			return result;
+		if (keySize < skip)
+			return -1;
+		*abbrev = abbrev_bytes(key + skip, Min_s(keySize - skip, width));
+		return 0;
+	}
+
+	*abbrev = abbrev_fixed(att, key);
+	return 0;
+}
@@ -0,0 +1,998 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_bench.c
+ *	  YCSB-style benchmark of the SOE lookups and inserts.
+ *
+ * The benchmark bulk loads a table of nrows rows and a B+-tree on its key
+ * through addHeapBlocks and addIndexLevel, on a DYNAMIC (initSOE) or an OST
+ * (initFSOE) relation, and then runs a mix of reads and inserts from
+ * several client threads. Reads pick a loaded key with a uniform, zipfian
+ * or sequential distribution and fetch one row with an equality scan, or
+ * range rows with a >= scan. The index key is the char(n) key of the rows,
+ * or their key number as an int8 with -k int8.
+ *
+ * The loaded B+-tree can't split its pages, as every level has the number
+ * of blocks given to initSOE. Inserts are thus spread round-robin over the
+ * leaves and fill the room the fillfactor left on them; an insert that
+ * finds no room left is counted as an error.
+ *
+ * The relation files are kept by the page store of soe_pagestore.h, so it
+ * runs on the UNSAFE build without a database. The ORAM library is the one
+ * the SOE was built with (ORAM_LIB).
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "soe_c.h"
+#include "Enclave_dt.h"
+#include "ops.h"
+#include "soe_pagestore.h"
+#include "soe_stats.h"
+#include "access/soe_nbtree.h"
+#include "access/soe_ost.h"
+#include "access/soe_htup_details.h"
+#include "catalog/soe_pg_attribute.h"
+#include "storage/soe_bufpage.h"
+#include "storage/soe_heap_ofile.h"
+#include "storage/soe_nbtree_ofile.h"
+#include "storage/soe_ost_ofile.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* types of the index key and their operators */
+#define BENCH_BPCHAR_OID	1042
+#define BENCH_EQUAL			1054
+#define BENCH_INT8_OID		20
+#define BENCH_INT8_EQUAL	410
+#define BENCH_INT8_GE		415
+
+/*
+ * Keys are "user" and ten digits, padded with a blank as char(n) values.
+ * The index scans compare keys without their last character. Row r is
+ * loaded with key r * BENCH_KEY_GAP and the inserts take the keys between.
+ */
+#define BENCH_KEY_FORMAT	"user%010ld "
+#define BENCH_KEY_GAP		1000
+#define BENCH_ROW_KEY(row)	((row) * BENCH_KEY_GAP)
+#define BENCH_MAX_ROWS		(9999999999L / BENCH_KEY_GAP)
+#define BENCH_KEY_LEN		15
+#define BENCH_KEY_SIZE		(BENCH_KEY_LEN + 1)
+/* Largest tuple returned by getTuple, as MAX_TUPLE_SIZE of soe.c. */
+#define BENCH_MAX_TUPLE		1400
+/* Pages sent on each addHeapBlocks and addIndexLevel call. */
+#define BENCH_LOAD_BATCH	64
+#define BENCH_MAX_LEVELS	16
+
+typedef enum BenchDistribution
+{
+	DIST_UNIFORM,
+	DIST_ZIPFIAN,
+	DIST_SEQUENTIAL
+}			BenchDistribution;
+
+typedef struct BenchOptions
+{
+	bool		ost;
+	bool		int8Keys;
+	long		nrows;
+	long		nops;
+	int			nclients;
+	int			nworkers;
+	bool		ring;
+	BenchDistribution dist;
+	double		theta;
+	double		readProportion;
+	int			range;
+	int			batch;
+	int			fieldSize;
+	int			fillfactor;
+	const char *dir;
+	SOEPageStoreBackend backend;
+	SOEPageStoreSync sync;
+}			BenchOptions;
+
+typedef struct BenchClient
+{
+	pthread_t	thread;
+	int			id;
+	uint64		seed;
+	long		nops;
+	/* latency of each operation, in nanoseconds */
+	uint64	   *latencies;
+	long		reads;
+	long		inserts;
+	long		tuples;
+	long		errors;
+}			BenchClient;
+
+static BenchOptions opts = {
+	false, false, 100000, 100000, 1, 0, false, DIST_ZIPFIAN, 0.99, 1.0, 1, 0, 100, 90,
+	".", SOE_PAGESTORE_MMAP, SOE_PAGESTORE_SYNC_NONE
+};
+
+static int	handle;
+/* number of inserts issued */
+static long next_insert;
+/* first row of each leaf, and the entries each leaf can still take */
+static long *leaf_rows;
+static long nleaves;
+static long leaf_room;
+/* sequential key of the next read */
+static long next_read;
+
+/* zipfian constants over the loaded keys */
+static double zipf_zetan;
+static double zipf_alpha;
+static double zipf_eta;
+
+
+static uint64
+bench_random(uint64 *seed)
+{
+	uint64		z;
+
+	/* splitmix64 */
+	z = (*seed += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static double
+bench_random_double(uint64 *seed)
+{
+	return (bench_random(seed) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double
+bench_zeta(long n, double theta)
+{
+	double		sum = 0;
+	long		i;
+
+	for (i = 1; i <= n; i++)
+	{
+		sum += 1 / pow((double) i, theta);
+	}
+
+	return sum;
+}
+
+/* Zipfian generator of Gray et al., as used by YCSB. */
+static void
+bench_zipf_setup(long n, double theta)
+{
+	double		zeta2 = bench_zeta(2, theta);
+
+	zipf_zetan = bench_zeta(n, theta);
+	zipf_alpha = 1 / (1 - theta);
+	zipf_eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zipf_zetan);
+}
+
+static long
+bench_zipf_next(uint64 *seed, long n)
+{
+	double		u = bench_random_double(seed);
+	double		uz = u * zipf_zetan;
+	long		rank;
+	uint64		hash;
+	int			byte;
+
+	if (uz < 1)
+	{
+		rank = 0;
+	}
+	else if (uz < 1 + pow(0.5, opts.theta))
+	{
+		rank = 1;
+	}
+	else
+	{
+		rank = (long) (n * pow(zipf_eta * u - zipf_eta + 1, zipf_alpha));
+	}
+
+	/* Scatter the popular keys over the key space with FNV-1a. */
+	hash = 0xCBF29CE484222325ULL;
+	for (byte = 0; byte < 8; byte++)
+	{
+		hash ^= (rank >> (byte * 8)) & 0xFF;
+		hash *= 0x100000001B3ULL;
+	}
+
+	return (long) (hash % n);
+}
+
+static long
+bench_next_key(BenchClient * client)
+{
+	switch (opts.dist)
+	{
+		case DIST_UNIFORM:
+			return (long) (bench_random(&client->seed) % opts.nrows);
+		case DIST_ZIPFIAN:
+			return bench_zipf_next(&client->seed, opts.nrows);
+		case DIST_SEQUENTIAL:
+		default:
+			return __atomic_fetch_add(&next_read, 1, __ATOMIC_RELAXED) % opts.nrows;
+	}
+}
+
+static void
+bench_key(char *buf, long key)
+{
+	snprintf(buf, BENCH_KEY_SIZE, BENCH_KEY_FORMAT, key);
+}
+
+/* Scan or insertion key of the index, returns its size. */
+static int
+bench_index_key(char *buf, long key)
+{
+	int64		value = key;
+
+	if (opts.int8Keys)
+	{
+		memcpy(buf, &value, sizeof(int64));
+		return sizeof(int64);
+	}
+	bench_key(buf, key);
+	return strlen(buf);
+}
+
+static uint64
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Heap tuple of key: a zeroed header followed by the key and filler. */
+static Size
+bench_heap_tuple(char *buf, long key)
+{
+	Size		size = SizeofHeapTupleHeader + opts.fieldSize;
+
+	memset(buf, 0, SizeofHeapTupleHeader);
+	memset(buf + SizeofHeapTupleHeader, 'x', opts.fieldSize);
+	bench_key(buf + SizeofHeapTupleHeader, key);
+
+	return size;
+}
+
+/* Index tuple pointing to (blkno, offnum), without a key when key < 0. */
+static Size
+bench_index_tuple(char *buf, long key, BlockNumber blkno, OffsetNumber offnum)
+{
+	IndexTuple	itup = (IndexTuple) buf;
+	char	   *datum = buf + sizeof(IndexTupleData);
+	Size		keylen = 0;
+	Size		size;
+
+	if (key >= 0)
+	{
+		keylen = opts.int8Keys ? sizeof(int64) : VARHDRSZ + BENCH_KEY_SIZE;
+	}
+	size = MAXALIGN_s(sizeof(IndexTupleData) + keylen);
+
+	memset(buf, 0, size);
+	ItemPointerSet_s(&itup->t_tid, blkno, offnum);
+	itup->t_info = size;
+	if (key >= 0 && opts.int8Keys)
+	{
+		bench_index_key(datum, key);
+	}
+	else if (key >= 0)
+	{
+		SET_VARSIZE_S(datum, keylen);
+		bench_key(datum + VARHDRSZ, key);
+	}
+
+	return size;
+}
+
+static void
+bench_index_add(Page page, char *itup, Size size)
+{
+	if (PageAddItem_s(page, itup, size, InvalidOffsetNumber, false, false) == InvalidOffsetNumber)
+	{
+		fprintf(stderr, "index page is full\n");
+		exit(1);
+	}
+}
+
+/*
+ * Loads the table and returns the position of each row, rows[key], in
+ * heap block and offset.
+ */
+static ItemPointerData *
+bench_load_heap(BlockNumber *nblocks)
+{
+	ItemPointerData *rows = (ItemPointerData *) malloc(sizeof(ItemPointerData) * opts.nrows);
+	char	   *pages = (char *) malloc(BENCH_LOAD_BATCH * BLCKSZ);
+	char		tuple[BENCH_MAX_TUPLE];
+	Size		size;
+	BlockNumber blkno = 0;
+	BlockNumber boffset = 0;
+	OffsetNumber offnum;
+	Page		page;
+	long		key = 0;
+
+	while (key < opts.nrows)
+	{
+		page = pages + boffset * BLCKSZ;
+		heap_pageInit(page, blkno + boffset, BLCKSZ);
+		for (; key < opts.nrows; key++)
+		{
+			size = bench_heap_tuple(tuple, BENCH_ROW_KEY(key));
+			offnum = PageAddItem_s(page, tuple, size, InvalidOffsetNumber, false, true);
+			if (offnum == InvalidOffsetNumber)
+			{
+				break;
+			}
+			ItemPointerSet_s(&rows[key], blkno + boffset, offnum);
+		}
+
+		boffset++;
+		if (boffset == BENCH_LOAD_BATCH || key == opts.nrows)
+		{
+			addHeapBlocks(handle, pages, boffset * BLCKSZ, boffset, blkno);
+			blkno += boffset;
+			boffset = 0;
+		}
+	}
+
+	free(pages);
+	*nblocks = blkno;
+	return rows;
+}
+
+/* Entries of an index page filled up to fillfactor, besides its high key. */
+static long
+bench_page_entries(int fillfactor)
+{
+	char		itup[64];
+	Size		itupsz = bench_index_tuple(itup, 0, 0, 0);
+	Size		space = BLCKSZ - SizeOfPageHeaderData - MAXALIGN_s(sizeof(BTPageOpaqueData));
+
+	return space * fillfactor / 100 / (itupsz + sizeof(ItemIdData)) - 1;
+}
+
+/*
+ * Builds the B+-tree on the keys from the leaves up, filling each page up
+ * to the fillfactor. Level 0 is the root. The pages of each level are in
+ * levels[level] and the first row under each page in lowrows[level].
+ */
+static int
+bench_build_index(ItemPointerData * rows, char **levels, long **lowrows,
+				  int *nblocks)
+{
+	void		(*pageInit) (Page, int, Size) = opts.ost ? &ost_pageInit : &nbtree_pageInit;
+	char		itup[64];
+	Size		itupsz = bench_index_tuple(itup, 0, 0, 0);
+	long		capacity = bench_page_entries(opts.fillfactor);
+	char	   *pages[BENCH_MAX_LEVELS];
+	long	   *firsts[BENCH_MAX_LEVELS];
+	long		npages[BENCH_MAX_LEVELS];
+	long		nchildren = opts.nrows;
+	long		page;
+	long		item;
+	long		last;
+	int			height = 0;
+	int			level;
+	Page		p;
+	BTPageOpaque opaque;
+
+	if (capacity < 2)
+	{
+		fprintf(stderr, "fillfactor %d is too low\n", opts.fillfactor);
+		exit(1);
+	}
+
+	/* Height 0 are the leaves; each loop builds the level above. */
+	do
+	{
+		if (height == BENCH_MAX_LEVELS)
+		{
+			fprintf(stderr, "index is too tall\n");
+			exit(1);
+		}
+
+		npages[height] = (nchildren + capacity - 1) / capacity;
+		pages[height] = (char *) malloc(npages[height] * BLCKSZ);
+		firsts[height] = (long *) malloc(npages[height] * sizeof(long));
+
+		for (page = 0; page < npages[height]; page++)
+		{
+			p = pages[height] + page * BLCKSZ;
+			pageInit(p, page, BLCKSZ);
+			opaque = (BTPageOpaque) PageGetSpecialPointer_s(p);
+			opaque->btpo_flags = height == 0 ? BTP_LEAF : 0;
+			opaque->btpo_prev = page == 0 ? P_NONE : page - 1;
+			opaque->btpo_next = page == npages[height] - 1 ? P_NONE : page + 1;
+			opaque->btpo.level = height;
+
+			item = page * capacity;
+			last = item + capacity < nchildren ? item + capacity : nchildren;
+			firsts[height][page] = height == 0 ? item : firsts[height - 1][item];
+
+			/* The high key is the first key of the right sibling. */
+			if (last < nchildren)
+			{
+				bench_index_tuple(itup, BENCH_ROW_KEY(height == 0 ? last : firsts[height - 1][last]), 0, 0);
+				bench_index_add(p, itup, itupsz);
+			}
+
+			for (; item < last; item++)
+			{
+				if (height == 0)
+				{
+					bench_index_tuple(itup, BENCH_ROW_KEY(item), ItemPointerGetBlockNumber_s(&rows[item]),
+									  ItemPointerGetOffsetNumber_s(&rows[item]));
+					bench_index_add(p, itup, itupsz);
+				}
+				else if (item == page * capacity)
+				{
+					/* The first downlink of an internal page is minus infinity. */
+					bench_index_add(p, itup, bench_index_tuple(itup, -1, item, 1));
+				}
+				else
+				{
+					bench_index_tuple(itup, BENCH_ROW_KEY(firsts[height - 1][item]), item, 1);
+					bench_index_add(p, itup, itupsz);
+				}
+			}
+		}
+
+		nchildren = npages[height];
+		height++;
+	} while (nchildren > 1);
+
+	opaque = (BTPageOpaque) PageGetSpecialPointer_s(pages[height - 1]);
+	opaque->btpo_flags |= BTP_ROOT;
+
+	/* Number the levels from the root down. */
+	for (level = 0; level < height; level++)
+	{
+		levels[level] = pages[height - 1 - level];
+		lowrows[level] = firsts[height - 1 - level];
+		nblocks[level] = npages[height - 1 - level];
+	}
+
+	return height;
+}
+
+static void
+bench_load_index(char **levels, int *nblocks, int height)
+{
+	int			level;
+	int			offset;
+	int			count;
+
+	for (level = 0; level < height; level++)
+	{
+		for (offset = 0; offset < nblocks[level]; offset += BENCH_LOAD_BATCH)
+		{
+			count = nblocks[level] - offset < BENCH_LOAD_BATCH ? nblocks[level] - offset : BENCH_LOAD_BATCH;
+			addIndexLevel(handle, levels[level] + (Size) offset * BLCKSZ, count * BLCKSZ,
+						  count, offset, level);
+		}
+	}
+}
+
+static void
+bench_load(void)
+{
+	FormData_pg_attribute attr;
+	ItemPointerData *rows;
+	char	   *levels[BENCH_MAX_LEVELS];
+	long	   *lowrows[BENCH_MAX_LEVELS];
+	int			nblocks[BENCH_MAX_LEVELS];
+	int			fanouts[BENCH_MAX_LEVELS] = {0};
+	int			height;
+	int			level;
+	int			iNBlocks = 0;
+	int			tNBlocks;
+	int			perPage;
+	long		ninserts = (long) (opts.nops * (1 - opts.readProportion)) + 1;
+	BlockNumber heapBlocks;
+	char		tuple[BENCH_MAX_TUPLE];
+	char		page[BLCKSZ];
+
+	memset(&attr, 0, sizeof(attr));
+	if (opts.int8Keys)
+	{
+		attr.attlen = sizeof(int64);
+		attr.attbyval = true;
+		attr.attalign = 'd';
+		attr.atttypid = BENCH_INT8_OID;
+	}
+	else
+	{
+		attr.attlen = -1;
+		attr.attalign = 'i';
+		attr.atttypid = BENCH_BPCHAR_OID;
+	}
+
+	/*
+	 * The relation is created before its pages are loaded, so the sizes
+	 * come first: the rows of a full heap page, and the levels of an index
+	 * built on dummy row positions.
+	 */
+	heap_pageInit(page, 0, BLCKSZ);
+	for (perPage = 0;; perPage++)
+	{
+		if (PageAddItem_s(page, tuple, bench_heap_tuple(tuple, 0), InvalidOffsetNumber, false, true) == InvalidOffsetNumber)
+		{
+			break;
+		}
+	}
+	tNBlocks = (opts.nrows + perPage - 1) / perPage + (ninserts + perPage - 1) / perPage + 1;
+
+	rows = (ItemPointerData *) calloc(opts.nrows, sizeof(ItemPointerData));
+	height = bench_build_index(rows, levels, lowrows, nblocks);
+	for (level = 0; level < height; level++)
+	{
+		iNBlocks += nblocks[level];
+		if (level > 0)
+		{
+			fanouts[level - 1] = nblocks[level];
+		}
+		free(levels[level]);
+		free(lowrows[level]);
+	}
+	free(rows);
+
+	if (opts.ost)
+	{
+		handle = initFSOE("bench_heap", "bench_index", tNBlocks, fanouts,
+						  sizeof(int) * (height - 1), height - 1, 1, 2,
+						  (char *) &attr, sizeof(attr));
+	}
+	else
+	{
+		handle = initSOE("bench_heap", "bench_index", tNBlocks, fanouts,
+						 sizeof(int) * (height > 1 ? height - 1 : 1), height, iNBlocks,
+						 1, 2, 0, F_BTHANDLER, (char *) &attr, sizeof(attr));
+	}
+	if (handle < 0)
+	{
+		fprintf(stderr, "could not create the relation\n");
+		exit(1);
+	}
+
+	rows = bench_load_heap(&heapBlocks);
+	height = bench_build_index(rows, levels, lowrows, nblocks);
+	bench_load_index(levels, nblocks, height);
+
+	for (level = 0; level < height; level++)
+	{
+		free(levels[level]);
+		if (level < height - 1)
+		{
+			free(lowrows[level]);
+		}
+	}
+	free(rows);
+
+	leaf_rows = lowrows[height - 1];
+	nleaves = nblocks[height - 1];
+	leaf_room = bench_page_entries(100) - bench_page_entries(opts.fillfactor);
+	if (leaf_room > BENCH_KEY_GAP - 1)
+	{
+		leaf_room = BENCH_KEY_GAP - 1;
+	}
+
+	printf("loaded %ld rows on %u heap blocks, index of %d levels with room for %ld inserts\n",
+		   opts.nrows, heapBlocks, height, nleaves * leaf_room);
+}
+
+/*
+ * Fetches the rows from row on. Counts an error if the first one is not
+ * row or the keys are out of order. Returns false if no row was found.
+ */
+static bool
+bench_read(BenchClient * client, long row)
+{
+	char		skey[BENCH_KEY_SIZE];
+	char		ikey[BENCH_KEY_SIZE];
+	char		tuple[sizeof(HeapTupleData)];
+	char		data[BENCH_MAX_TUPLE];
+	char		previous[BENCH_KEY_SIZE];
+	char	   *found = data + SizeofHeapTupleHeader;
+	unsigned int opoid;
+	int			ikeySize = bench_index_key(ikey, BENCH_ROW_KEY(row));
+	int			ntuples = 0;
+
+	if (opts.int8Keys)
+		opoid = opts.range > 1 ? BENCH_INT8_GE : BENCH_INT8_EQUAL;
+	else
+		opoid = opts.range > 1 ? STR_GREATER_THAN_OR_EQUAL : BENCH_EQUAL;
+
+	bench_key(skey, BENCH_ROW_KEY(row));
+	memcpy(previous, skey, BENCH_KEY_SIZE);
+	while (getTuple(handle, 0, opoid, ikey, ikeySize, tuple, sizeof(tuple), data, sizeof(data)) == 0)
+	{
+		if ((ntuples == 0 && strncmp(found, skey, BENCH_KEY_LEN) != 0)
+			|| strncmp(found, previous, BENCH_KEY_LEN) < 0)
+		{
+			client->errors++;
+		}
+		memcpy(previous, found, BENCH_KEY_LEN);
+		ntuples++;
+		if (ntuples == opts.range)
+		{
+			endScan(handle);
+			break;
+		}
+	}
+
+	client->tuples += ntuples;
+	return ntuples > 0;
+}
+
+/*
+ * Looks up opts.batch rows with a single getTuplesBatch call. Counts an
+ * error for each row that is not found. Returns false if none was found.
+ */
+static bool
+bench_read_batch(BenchClient * client)
+{
+	char	   *keys = (char *) malloc(opts.batch * BENCH_KEY_SIZE);
+	unsigned int *keySizes = (unsigned int *) malloc(opts.batch * sizeof(unsigned int));
+	unsigned int *offsets = (unsigned int *) malloc(opts.batch * sizeof(unsigned int));
+	long	   *rows = (long *) malloc(opts.batch * sizeof(long));
+	unsigned int tuplesLen = opts.batch * MAXALIGN_s(sizeof(HeapTupleData) + BENCH_MAX_TUPLE);
+	char	   *tuples = (char *) malloc(tuplesLen);
+	char		skey[BENCH_KEY_SIZE];
+	unsigned int keysSize = 0;
+	int			nfound;
+	int			i;
+
+	for (i = 0; i < opts.batch; i++)
+	{
+		rows[i] = bench_next_key(client);
+		keySizes[i] = bench_index_key(keys + keysSize, BENCH_ROW_KEY(rows[i]));
+		keysSize += keySizes[i];
+	}
+
+	nfound = getTuplesBatch(handle, keys, keysSize, keySizes, opts.batch, tuples,
+							tuplesLen, offsets);
+
+	/* The offsets are not set if the call failed. */
+	for (i = 0; nfound >= 0 && i < opts.batch; i++)
+	{
+		bench_key(skey, BENCH_ROW_KEY(rows[i]));
+		if (offsets[i] == BATCH_NO_TUPLE || offsets[i] == BATCH_NO_ROOM
+			|| strncmp(tuples + offsets[i] + sizeof(HeapTupleData) + SizeofHeapTupleHeader,
+					   skey, BENCH_KEY_LEN) != 0)
+		{
+			client->errors++;
+		}
+	}
+
+	client->tuples += nfound > 0 ? nfound : 0;
+	free(tuples);
+	free(rows);
+	free(offsets);
+	free(keySizes);
+	free(keys);
+	return nfound > 0;
+}
+
+/*
+ * Inserts a row in the next leaf, after the rows inserted there before.
+ * Returns false if the leaves are full.
+ */
+static bool
+bench_insert(void)
+{
+	char		tuple[BENCH_MAX_TUPLE];
+	char		ikey[BENCH_KEY_SIZE];
+	long		n = __atomic_fetch_add(&next_insert, 1, __ATOMIC_RELAXED);
+	long		key;
+	Size		size;
+
+	if (n >= nleaves * leaf_room)
+	{
+		return false;
+	}
+	key = BENCH_ROW_KEY(leaf_rows[n % nleaves]) + 1 + n / nleaves;
+	size = bench_heap_tuple(tuple, key);
+
+	insert(handle, tuple, size, ikey, bench_index_key(ikey, key));
+	return true;
+}
+
+static void *
+bench_client(void *arg)
+{
+	BenchClient *client = (BenchClient *) arg;
+	long		op;
+	uint64		start;
+
+	for (op = 0; op < client->nops; op++)
+	{
+		start = bench_now();
+		if (bench_random_double(&client->seed) < opts.readProportion)
+		{
+			if (opts.batch > 0 ? !bench_read_batch(client)
+				: !bench_read(client, bench_next_key(client)))
+			{
+				client->errors++;
+			}
+			client->reads++;
+		}
+		else
+		{
+			if (!bench_insert())
+			{
+				client->errors++;
+			}
+			client->inserts++;
+		}
+		client->latencies[op] = bench_now() - start;
+	}
+
+	return NULL;
+}
+
+static void *
+bench_worker(void *arg)
+{
+	runWorker();
+	return NULL;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+	uint64		la = *(const uint64 *) a;
+	uint64		lb = *(const uint64 *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static double
+bench_percentile(uint64 *latencies, long n, double p)
+{
+	long		i = (long) (p * n);
+
+	return (i < n ? latencies[i] : latencies[n - 1]) / 1000.0;
+}
+
+static void
+bench_run(void)
+{
+	BenchClient *clients = (BenchClient *) calloc(opts.nclients, sizeof(BenchClient));
+	pthread_t  *workers = (pthread_t *) malloc(sizeof(pthread_t) * (opts.nworkers + 1));
+	uint64	   *latencies = (uint64 *) malloc(sizeof(uint64) * opts.nops);
+	long		nops = 0;
+	long		reads = 0;
+	long		inserts = 0;
+	long		tuples = 0;
+	long		errors = 0;
+	uint64		start;
+	double		elapsed;
+	SOEStats	stats;
+	int			c;
+
+	for (c = 0; c < opts.nworkers; c++)
+	{
+		pthread_create(&workers[c], NULL, &bench_worker, NULL);
+	}
+
+	/* Leave the load out of the counters. */
+	getStats(SOE_STATS_ALL, (char *) &stats, sizeof(SOEStats), 1);
+
+	start = bench_now();
+	for (c = 0; c < opts.nclients; c++)
+	{
+		clients[c].id = c;
+		clients[c].seed = 0x5DEECE66DULL * (c + 1);
+		clients[c].nops = opts.nops / opts.nclients + (c < opts.nops % opts.nclients);
+		clients[c].latencies = latencies + nops;
+		nops += clients[c].nops;
+		pthread_create(&clients[c].thread, NULL, &bench_client, &clients[c]);
+	}
+	for (c = 0; c < opts.nclients; c++)
+	{
+		pthread_join(clients[c].thread, NULL);
+		reads += clients[c].reads;
+		inserts += clients[c].inserts;
+		tuples += clients[c].tuples;
+		errors += clients[c].errors;
+	}
+	elapsed = (bench_now() - start) / 1e9;
+
+	getStats(SOE_STATS_ALL, (char *) &stats, sizeof(SOEStats), 0);
+	closeSoe();
+	for (c = 0; c < opts.nworkers; c++)
+	{
+		pthread_join(workers[c], NULL);
+	}
+
+	qsort(latencies, nops, sizeof(uint64), &bench_compare);
+
+	printf("mode %s, oram %s, %ld rows, %d clients\n",
+		   opts.ost ? "OST" : "DYNAMIC",
+#if defined(PATHORAM)
+		   "PATHORAM",
+#elif defined(FORESTORAM)
+		   "FORESTORAM",
+#else
+		   "default",
+#endif
+		   opts.nrows, opts.nclients);
+	printf("%ld operations (%ld reads, %ld inserts) in %.3f s: %.1f ops/s\n",
+		   nops, reads, inserts, elapsed, nops / elapsed);
+	printf("%ld tuples read, %ld errors\n", tuples, errors);
+	printf("latency (us): p50 %.1f p99 %.1f p999 %.1f max %.1f\n",
+		   bench_percentile(latencies, nops, 0.50),
+		   bench_percentile(latencies, nops, 0.99),
+		   bench_percentile(latencies, nops, 0.999),
+		   latencies[nops - 1] / 1000.0);
+	printf("per operation: %.1f oram reads (%.1f dummy), %.1f oram writes, %.1f file reads, %.1f file writes, %.1f decryptions\n",
+		   (double) stats.oramReads / nops, (double) stats.dummyReads / nops,
+		   (double) stats.oramWrites / nops,
+		   (double) (stats.ocallReads + stats.ringReads) / nops,
+		   (double) (stats.ocallWrites + stats.ringWrites) / nops,
+		   (double) stats.decryptions / nops);
+	printf("stash high-water %lu blocks, %lu page splits\n",
+		   (unsigned long) stats.stashHighWater, (unsigned long) stats.pageSplits);
+
+	free(latencies);
+	free(workers);
+	free(clients);
+}
+
+static void
+bench_usage(const char *progname)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"  -m dynamic|ost       index protocol (default dynamic)\n"
+			"  -k bpchar|int8       type of the index key (default bpchar)\n"
+			"  -n rows              rows loaded (default 100000)\n"
+			"  -o operations        operations run (default 100000)\n"
+			"  -c clients           client threads (default 1)\n"
+			"  -w workers           partition worker threads (default 0)\n"
+			"  -R                   send the page I/O through the request ring\n"
+			"  -d uniform|zipfian|sequential\n"
+			"                       key distribution of the reads (default zipfian)\n"
+			"  -z theta             zipfian constant (default 0.99)\n"
+			"  -r proportion        reads among the operations, the rest are inserts\n"
+			"                       (default 1.0)\n"
+			"  -l length            rows fetched by each read (default 1)\n"
+			"  -B keys              look up this many rows on each read with one\n"
+			"                       getTuplesBatch call, instead of a scan\n"
+			"  -f bytes             row size after the tuple header (default 100)\n"
+			"  -F fillfactor        fill of the loaded index pages (default 90)\n"
+			"  -D directory         directory of the relation files (default .)\n"
+			"  -b mmap|pread|direct page store backend (default mmap)\n"
+			"  -s none|close|write  page store sync policy (default none)\n",
+			progname);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	int			c;
+
+	while ((c = getopt(argc, argv, "m:k:n:o:c:w:Rd:z:r:l:B:f:F:D:b:s:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'm':
+				opts.ost = strcmp(optarg, "ost") == 0;
+				break;
+			case 'k':
+				opts.int8Keys = strcmp(optarg, "int8") == 0;
+				break;
+			case 'n':
+				opts.nrows = atol(optarg);
+				break;
+			case 'o':
+				opts.nops = atol(optarg);
+				break;
+			case 'c':
+				opts.nclients = atoi(optarg);
+				break;
+			case 'w':
+				opts.nworkers = atoi(optarg);
+				break;
+			case 'R':
+				opts.ring = true;
+				break;
+			case 'd':
+				if (strcmp(optarg, "uniform") == 0)
+					opts.dist = DIST_UNIFORM;
+				else if (strcmp(optarg, "sequential") == 0)
+					opts.dist = DIST_SEQUENTIAL;
+				else
+					opts.dist = DIST_ZIPFIAN;
+				break;
+			case 'z':
+				opts.theta = atof(optarg);
+				break;
+			case 'r':
+				opts.readProportion = atof(optarg);
+				break;
+			case 'l':
+				opts.range = atoi(optarg);
+				break;
+			case 'B':
+				opts.batch = atoi(optarg);
+				break;
+			case 'f':
+				opts.fieldSize = atoi(optarg);
+				break;
+			case 'F':
+				opts.fillfactor = atoi(optarg);
+				break;
+			case 'D':
+				opts.dir = optarg;
+				break;
+			case 'b':
+				if (strcmp(optarg, "pread") == 0)
+					opts.backend = SOE_PAGESTORE_PREAD;
+				else if (strcmp(optarg, "direct") == 0)
+					opts.backend = SOE_PAGESTORE_DIRECT;
+				else
+					opts.backend = SOE_PAGESTORE_MMAP;
+				break;
+			case 's':
+				if (strcmp(optarg, "close") == 0)
+					opts.sync = SOE_PAGESTORE_SYNC_CLOSE;
+				else if (strcmp(optarg, "write") == 0)
+					opts.sync = SOE_PAGESTORE_SYNC_WRITE;
+				else
+					opts.sync = SOE_PAGESTORE_SYNC_NONE;
+				break;
+			default:
+				bench_usage(argv[0]);
+		}
+	}
+
+	if (opts.nrows < 1 || opts.nrows > BENCH_MAX_ROWS || opts.nops < 1 || opts.nclients < 1 || opts.range < 1
+		|| opts.fieldSize < BENCH_KEY_SIZE
+		|| SizeofHeapTupleHeader + opts.fieldSize > BENCH_MAX_TUPLE)
+	{
+		bench_usage(argv[0]);
+	}
+	if (opts.ost && opts.readProportion < 1)
+	{
+		fprintf(stderr, "inserts are not supported on OST relations\n");
+		exit(1);
+	}
+
+	if (soe_pagestore_configure(opts.dir, opts.backend, opts.sync) != 0)
+	{
+		exit(1);
+	}
+	if (opts.ring)
+	{
+		initRing(NULL);
+	}
+	if (opts.dist == DIST_ZIPFIAN)
+	{
+		bench_zipf_setup(opts.nrows, opts.theta);
+	}
+
+	bench_load();
+	bench_run();
+	soe_pagestore_close();
+	free(leaf_rows);
+
+	return 0;
+}
@@ -0,0 +1,394 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_pe.c
+ *	  Page encryption/decryption on top of the cipher primitives of the
+ *	  crypto library used by the build.
+ *
+ * With the CTR and GCM page ciphers each file keeps the number of times
+ * each of its blocks was written, and the GCM tag of the last write. The
+ * counter is part of the nonce so that no two writes of a session share a
+ * nonce, and the session salt keeps nonces from repeating across sessions.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "soe_c.h"
+#include "common/soe_pe.h"
+#include "logger/logger.h"
+#include "storage/soe_lock.h"
+#include "utils/soe_counters.h"
+
+#include <oram/orandom.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAGE_CIPHER_NONCE
+
+struct PageCipherFile
+{
+	char	   *filename;
+	uint32		fileid;
+	/* number of blocks with a write counter */
+	uint32		nblocks;
+	uint32	   *versions;
+	unsigned char *tags;
+
+	/*
+	 * Protects the counters and tags, which grow as blocks are written. The
+	 * partitions of a table share its file and are encrypted by different
+	 * threads, so the state of a block is copied in and out under the lock
+	 * and the cipher runs without it.
+	 */
+	SOEMutex	lock;
+	struct PageCipherFile *next;
+};
+
+static PageCipherFile *cfiles = NULL;
+static uint32 ncfiles = 0;
+static uint32 salt = 0;
+
+/* Protects the list of files, which is only walked when a file is opened. */
+static SOEMutex cfiles_lock = SOE_MUTEX_INITIALIZER;
+
+/*
+ * Makes room for the counter of block blkno of cfile. The caller holds the
+ * lock of cfile.
+ */
+static void
+page_cipher_grow(PageCipherFile *cfile, unsigned int blkno)
+{
+	uint32		nblocks;
+
+	if (blkno < cfile->nblocks)
+	{
+		return;
+	}
+
+	nblocks = cfile->nblocks == 0 ? 64 : cfile->nblocks;
+	while (nblocks <= blkno)
+	{
+		nblocks *= 2;
+	}
+
+	cfile->versions = (uint32 *) realloc(cfile->versions, sizeof(uint32) * nblocks);
+	memset(cfile->versions + cfile->nblocks, 0, sizeof(uint32) * (nblocks - cfile->nblocks));
+#ifdef PAGE_CIPHER_GCM
+	cfile->tags = (unsigned char *) realloc(cfile->tags, PAGE_TAG_SIZE * nblocks);
+	memset(cfile->tags + cfile->nblocks * PAGE_TAG_SIZE, 0, PAGE_TAG_SIZE * (nblocks - cfile->nblocks));
+#endif
+	cfile->nblocks = nblocks;
+}
+
+static void
+page_iv(PageCipherFile *cfile, unsigned int blkno, unsigned char *iv)
+{
+	uint32		fsalt = salt ^ cfile->fileid;
+
+	memset(iv, 0, PAGE_IV_SIZE);
+	memcpy(iv, &fsalt, sizeof(uint32));
+	memcpy(iv + sizeof(uint32), &blkno, sizeof(uint32));
+	memcpy(iv + 2 * sizeof(uint32), &cfile->versions[blkno], sizeof(uint32));
+}
+
+#ifdef PAGE_CIPHER_GCM
+static unsigned char *
+page_tag(PageCipherFile *cfile, unsigned int blkno)
+{
+	return cfile->tags + blkno * PAGE_TAG_SIZE;
+}
+#endif
+
+/*
+ * Sets the nonce of the next write of block blkno of cfile in iv. The tag
+ * of the write is stored by page_store_tag.
+ */
+static void
+page_write_iv(PageCipherFile *cfile, unsigned int blkno, unsigned char *iv)
+{
+	soe_mutex_lock(&cfile->lock);
+	page_cipher_grow(cfile, blkno);
+	cfile->versions[blkno]++;
+	page_iv(cfile, blkno, iv);
+	soe_mutex_unlock(&cfile->lock);
+}
+
+static void
+page_store_tag(PageCipherFile *cfile, unsigned int blkno, const unsigned char *tag)
+{
+#ifdef PAGE_CIPHER_GCM
+	soe_mutex_lock(&cfile->lock);
+	memcpy(page_tag(cfile, blkno), tag, PAGE_TAG_SIZE);
+	soe_mutex_unlock(&cfile->lock);
+#endif
+}
+
+/*
+ * Sets the nonce of the last write of block blkno of cfile in iv, and
+ * copies its tag to tag.
+ */
+static void
+page_read_iv(PageCipherFile *cfile, unsigned int blkno, unsigned char *iv,
+			 unsigned char *tag)
+{
+	soe_mutex_lock(&cfile->lock);
+	page_cipher_grow(cfile, blkno);
+	page_iv(cfile, blkno, iv);
+#ifdef PAGE_CIPHER_GCM
+	memcpy(tag, page_tag(cfile, blkno), PAGE_TAG_SIZE);
+#endif
+	soe_mutex_unlock(&cfile->lock);
+}
+
+#endif							/* PAGE_CIPHER_NONCE */
+
+/*
+ * Returns the cipher state of filename, creating it on the first call for
+ * the file. The ORAMs of a file keep it for all their page encryptions.
+ */
+PageCipherFile *
+page_cipher_open(const char *filename)
+{
+#ifdef PAGE_CIPHER_NONCE
+	PageCipherFile *cfile;
+	int			namelen;
+
+	soe_mutex_lock(&cfiles_lock);
+	for (cfile = cfiles; cfile != NULL; cfile = cfile->next)
+	{
+		if (strcmp(cfile->filename, filename) == 0)
+		{
+			break;
+		}
+	}
+
+	if (cfile == NULL)
+	{
+		if (cfiles == NULL)
+		{
+			salt = getRandomInt();
+		}
+		cfile = (PageCipherFile *) malloc(sizeof(PageCipherFile));
+		namelen = strlen(filename) + 1;
+		cfile->filename = (char *) malloc(namelen);
+		memcpy(cfile->filename, filename, namelen);
+		cfile->fileid = ncfiles++;
+		cfile->nblocks = 0;
+		cfile->versions = NULL;
+		cfile->tags = NULL;
+		soe_mutex_init(&cfile->lock);
+		cfile->next = cfiles;
+		cfiles = cfile;
+	}
+	soe_mutex_unlock(&cfiles_lock);
+
+	return cfile;
+#else
+	return NULL;
+#endif
+}
+
+#ifndef CPAGES
+
+/* Cipher context of an enclave thread. */
+typedef struct PageCryptoThread
+{
+	PageCipherContext *ctx;
+	struct PageCryptoThread *next;
+} PageCryptoThread;
+
+/*
+ * The contexts of all threads are kept on a list so that page_crypto_close
+ * frees those of the threads that never call page_crypto_thread_close. A
+ * thread whose context is from an older generation creates a new one.
+ */
+static __thread PageCryptoThread *cthread = NULL;
+static __thread uint32 cthread_generation = 0;
+static PageCryptoThread *cthreads = NULL;
+static uint32 cthreads_generation = 0;
+static SOEMutex cthreads_lock = SOE_MUTEX_INITIALIZER;
+
+static PageCipherContext *
+page_crypto_context(void)
+{
+	uint32		generation = __atomic_load_n(&cthreads_generation, __ATOMIC_ACQUIRE);
+
+	if (cthread != NULL && cthread_generation == generation)
+	{
+		return cthread->ctx;
+	}
+
+	cthread = (PageCryptoThread *) malloc(sizeof(PageCryptoThread));
+	cthread->ctx = page_cipher_context();
+	cthread_generation = generation;
+
+	soe_mutex_lock(&cthreads_lock);
+	cthread->next = cthreads;
+	cthreads = cthread;
+	soe_mutex_unlock(&cthreads_lock);
+
+	return cthread->ctx;
+}
+
+#endif							/* CPAGES */
+
+
+void
+page_encryption(PageCipherFile *cfile, unsigned int blkno,
+				unsigned char *plaintext, unsigned char *ciphertext)
+{
+	uint64		start = counters_cycles();
+
+#ifdef CPAGES
+	if (plaintext != ciphertext)
+	{
+		memcpy(ciphertext, plaintext, BLCKSZ);
+	}
+#elif defined(PAGE_CIPHER_NONCE)
+	unsigned char iv[PAGE_IV_SIZE];
+	unsigned char tag[PAGE_TAG_SIZE];
+
+	page_write_iv(cfile, blkno, iv);
+	page_cipher_encrypt(page_crypto_context(), iv, plaintext, ciphertext, tag);
+	page_store_tag(cfile, blkno, tag);
+#else
+	page_cipher_encrypt(page_crypto_context(), NULL, plaintext, ciphertext, NULL);
+#endif
+	COUNTERS_INC(encryptions);
+	COUNTERS_ADD(cryptoCycles, counters_cycles() - start);
+}
+
+void
+page_decryption(PageCipherFile *cfile, unsigned int blkno,
+				unsigned char *ciphertext, unsigned char *plaintext)
+{
+	uint64		start = counters_cycles();
+
+#ifdef CPAGES
+	if (plaintext != ciphertext)
+	{
+		memcpy(plaintext, ciphertext, BLCKSZ);
+	}
+#elif defined(PAGE_CIPHER_NONCE)
+	unsigned char iv[PAGE_IV_SIZE];
+	unsigned char tag[PAGE_TAG_SIZE];
+
+	page_read_iv(cfile, blkno, iv, tag);
+	if (!page_cipher_decrypt(page_crypto_context(), iv, ciphertext, plaintext, tag))
+	{
+		/*
+		 * The ORAM read callbacks can't fail, so the enclave is stopped
+		 * before the unauthenticated page is used.
+		 */
+		memset(plaintext, 0, BLCKSZ);
+		selog(ERROR, "Block %d of relation %s failed authentication", blkno, cfile->filename);
+		abort();
+	}
+#else
+	page_cipher_decrypt(page_crypto_context(), NULL, ciphertext, plaintext, NULL);
+#endif
+	COUNTERS_INC(decryptions);
+	COUNTERS_ADD(cryptoCycles, counters_cycles() - start);
+}
+
+/*
+ * The crypto libraries used do not offer multi-buffer AES for these modes,
+ * so the pages are processed one after the other with the same key
+ * schedule.
+ */
+void
+page_encryption_blocks(PageCipherFile *cfile, const unsigned int *blknos,
+					   unsigned char **plaintexts, unsigned char **ciphertexts,
+					   int nblocks)
+{
+	int			offset;
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		page_encryption(cfile, blknos[offset], plaintexts[offset], ciphertexts[offset]);
+	}
+}
+
+void
+page_decryption_blocks(PageCipherFile *cfile, const unsigned int *blknos,
+					   unsigned char **ciphertexts, unsigned char **plaintexts,
+					   int nblocks)
+{
+	int			offset;
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		page_decryption(cfile, blknos[offset], ciphertexts[offset], plaintexts[offset]);
+	}
+}
+
+/* Frees the cipher context of the calling thread. */
+void
+page_crypto_thread_close(void)
+{
+#ifndef CPAGES
+	PageCryptoThread **prev;
+
+	if (cthread == NULL
+		|| cthread_generation != __atomic_load_n(&cthreads_generation, __ATOMIC_ACQUIRE))
+	{
+		cthread = NULL;
+		return;
+	}
+
+	soe_mutex_lock(&cthreads_lock);
+	for (prev = &cthreads; *prev != cthread; prev = &(*prev)->next)
+	{
+		/* cthread is on the list */
+	}
+	*prev = cthread->next;
+	soe_mutex_unlock(&cthreads_lock);
+
+	page_cipher_context_free(cthread->ctx);
+	free(cthread);
+	cthread = NULL;
+#endif
+}
+
+/*
+ * Frees the cipher state of all files and the cipher contexts of all
+ * threads. No other thread may be running in the SOE.
+ */
+void
+page_crypto_close(void)
+{
+#ifndef CPAGES
+	PageCryptoThread *ct;
+#endif
+#ifdef PAGE_CIPHER_NONCE
+	PageCipherFile *cfile;
+
+	soe_mutex_lock(&cfiles_lock);
+	while (cfiles != NULL)
+	{
+		cfile = cfiles;
+		cfiles = cfile->next;
+		soe_mutex_destroy(&cfile->lock);
+		free(cfile->filename);
+		free(cfile->versions);
+		free(cfile->tags);
+		free(cfile);
+	}
+	ncfiles = 0;
+	soe_mutex_unlock(&cfiles_lock);
+#endif
+#ifndef CPAGES
+	soe_mutex_lock(&cthreads_lock);
+	while (cthreads != NULL)
+	{
+		ct = cthreads;
+		cthreads = ct->next;
+		page_cipher_context_free(ct->ctx);
+		free(ct);
+	}
+	__atomic_add_fetch(&cthreads_generation, 1, __ATOMIC_RELEASE);
+	soe_mutex_unlock(&cthreads_lock);
+	cthread = NULL;
+#endif
+}
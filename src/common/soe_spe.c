@@ -20,102 +20,182 @@ Ipp8u		key[] = "\x00\x01\x02\x03\x04\x05\x06\x07"
 Ipp8u		iv[] = "\xff\xee\xdd\xcc\xbb\xaa\x99\x88"
 "\x77\x66\x55\x44\x33\x22\x11\x00";
 
+#ifdef PAGE_CIPHER_GCM
+typedef IppsAES_GCMState PageAESState;
+#else
+typedef IppsAESSpec PageAESState;
+#endif
+
+/*
+ * AES state of a thread. The key is expanded once; with GCM each page only
+ * restarts the state with its nonce, so threads can't share it.
+ */
+struct PageCipherContext
+{
+	PageAESState *aes_ctx;
+	int			aes_ctx_size;
+};
 
-
-void
-page_encryption(unsigned char *plaintext, unsigned char *ciphertext)
+PageCipherContext *
+page_cipher_context(void)
 {
 	IppStatus	error_code = ippStsNoErr;
-	IppsAESSpec *ptr_ctx = NULL;
-	int			ctx_size = 0;
+	PageCipherContext *ctx;
 
-	if (plaintext == NULL)
+	ctx = (PageCipherContext *) malloc(sizeof(PageCipherContext));
+
+	if (ctx == NULL)
 	{
-		selog(ERROR, "input page to encrypt is NULL");
+		selog(ERROR, "Out of memory on page encryption");
+		return NULL;
 	}
 
-	error_code = ippsAESGetSize(&ctx_size);
+#ifdef PAGE_CIPHER_GCM
+	error_code = ippsAES_GCMGetSize(&ctx->aes_ctx_size);
+#else
+	error_code = ippsAESGetSize(&ctx->aes_ctx_size);
+#endif
 
 	if (error_code != ippStsNoErr)
 	{
+		free(ctx);
 		selog(ERROR, "Unexpected error on page_encryption");
+		return NULL;
 	}
 
-	ptr_ctx = (IppsAESSpec *) malloc(ctx_size);
+	ctx->aes_ctx = (PageAESState *) malloc(ctx->aes_ctx_size);
 
-	if (ptr_ctx == NULL)
+	if (ctx->aes_ctx == NULL)
 	{
+		free(ctx);
 		selog(ERROR, "Out of memory on page encryption");
+		return NULL;
 	}
 
-	error_code = ippsAESInit(key, KEY_SIZE, ptr_ctx, ctx_size);
+#ifdef PAGE_CIPHER_GCM
+	error_code = ippsAES_GCMInit(key, KEY_SIZE, ctx->aes_ctx, ctx->aes_ctx_size);
+#else
+	error_code = ippsAESInit(key, KEY_SIZE, ctx->aes_ctx, ctx->aes_ctx_size);
+#endif
 
 	if (error_code != ippStsNoErr)
 	{
-		memset(ptr_ctx, 0, ctx_size);
-		free(ptr_ctx);
+		page_cipher_context_free(ctx);
 		selog(ERROR, "Unexpected error when initializing ippsAES");
+		return NULL;
 	}
 
-	error_code = ippsAESEncryptCBC((uint8_t *) plaintext, (uint8_t *) ciphertext, BLCKSZ, ptr_ctx, (uint8_t *) iv);
+	return ctx;
+}
 
-	if (error_code != ippStsNoErr)
+void
+page_cipher_context_free(PageCipherContext *ctx)
+{
+	if (ctx != NULL)
 	{
-		memset(ptr_ctx, 0, ctx_size);
-		free(ptr_ctx);
-		selog(ERROR, "Unexpected error when encrypting with CBC");
+		memset(ctx->aes_ctx, 0, ctx->aes_ctx_size);
+		free(ctx->aes_ctx);
+		free(ctx);
 	}
-
-	memset(ptr_ctx, 0, ctx_size);
-	free(ptr_ctx);
 }
 
+
 void
-page_decryption(unsigned char *ciphertext, unsigned char *plaintext)
+page_cipher_encrypt(PageCipherContext *ctx, const unsigned char *piv,
+					unsigned char *plaintext, unsigned char *ciphertext,
+					unsigned char *tag)
 {
-
 	IppStatus	error_code = ippStsNoErr;
-	IppsAESSpec *ptr_ctx = NULL;
-	int			ctx_size = 0;
 
+#ifdef PAGE_CIPHER_CTR
+	Ipp8u		ctr[PAGE_IV_SIZE];
+#endif
 
-	if (ciphertext == NULL)
+	if (plaintext == NULL)
 	{
-		selog(ERROR, "input page to decrypt is NULL");
+		selog(ERROR, "input page to encrypt is NULL");
 	}
 
-	error_code = ippsAESGetSize(&ctx_size);
+	if (ctx == NULL)
+	{
+		return;
+	}
+
+#if defined(PAGE_CIPHER_GCM)
+	error_code = ippsAES_GCMStart(piv, PAGE_NONCE_SIZE, NULL, 0, ctx->aes_ctx);
+	if (error_code == ippStsNoErr)
+		error_code = ippsAES_GCMEncrypt(plaintext, ciphertext, BLCKSZ, ctx->aes_ctx);
+	if (error_code == ippStsNoErr)
+		error_code = ippsAES_GCMGetTag(tag, PAGE_TAG_SIZE, ctx->aes_ctx);
+#elif defined(PAGE_CIPHER_CTR)
+	/* The counter block is updated by the call. */
+	memcpy(ctr, piv, PAGE_IV_SIZE);
+	error_code = ippsAESEncryptCTR(plaintext, ciphertext, BLCKSZ, ctx->aes_ctx, ctr, 128);
+#else
+	error_code = ippsAESEncryptCBC((uint8_t *) plaintext, (uint8_t *) ciphertext, BLCKSZ, ctx->aes_ctx, (uint8_t *) iv);
+#endif
 
 	if (error_code != ippStsNoErr)
 	{
-		selog(ERROR, "Unexpected error on page_encryption");
+		selog(ERROR, "Unexpected error when encrypting page");
 	}
+}
+
+int
+page_cipher_decrypt(PageCipherContext *ctx, const unsigned char *piv,
+					unsigned char *ciphertext, unsigned char *plaintext,
+					const unsigned char *tag)
+{
+
+	IppStatus	error_code = ippStsNoErr;
 
-	ptr_ctx = (IppsAESSpec *) malloc(ctx_size);
+#if defined(PAGE_CIPHER_GCM)
+	Ipp8u		ptag[PAGE_TAG_SIZE];
+	unsigned char diff = 0;
+	int			offset;
+#elif defined(PAGE_CIPHER_CTR)
+	Ipp8u		ctr[PAGE_IV_SIZE];
+#endif
 
-	if (ptr_ctx == NULL)
+
+	if (ciphertext == NULL)
 	{
-		selog(ERROR, "Out of memory on page encryption");
+		selog(ERROR, "input page to decrypt is NULL");
 	}
 
-	error_code = ippsAESInit(key, KEY_SIZE, ptr_ctx, ctx_size);
-
-	if (error_code != ippStsNoErr)
+	if (ctx == NULL)
 	{
-		memset(ptr_ctx, 0, ctx_size);
-		free(ptr_ctx);
-		selog(ERROR, "Unexpected error when initializing ippsAES on decrypt");
+		return 0;
 	}
 
-	error_code = ippsAESDecryptCBC(ciphertext, plaintext, BLCKSZ, ptr_ctx, (uint8_t *) iv);
+#if defined(PAGE_CIPHER_GCM)
+	error_code = ippsAES_GCMStart(piv, PAGE_NONCE_SIZE, NULL, 0, ctx->aes_ctx);
+	if (error_code == ippStsNoErr)
+		error_code = ippsAES_GCMDecrypt(ciphertext, plaintext, BLCKSZ, ctx->aes_ctx);
+	if (error_code == ippStsNoErr)
+		error_code = ippsAES_GCMGetTag(ptag, PAGE_TAG_SIZE, ctx->aes_ctx);
+#elif defined(PAGE_CIPHER_CTR)
+	memcpy(ctr, piv, PAGE_IV_SIZE);
+	error_code = ippsAESDecryptCTR(ciphertext, plaintext, BLCKSZ, ctx->aes_ctx, ctr, 128);
+#else
+	error_code = ippsAESDecryptCBC(ciphertext, plaintext, BLCKSZ, ctx->aes_ctx, (uint8_t *) iv);
+#endif
 
 	if (error_code != ippStsNoErr)
 	{
-		memset(ptr_ctx, 0, ctx_size);
-		free(ptr_ctx);
-		selog(ERROR, "Unexpected error when encrypting with CBC");
+		selog(ERROR, "Unexpected error when decrypting page");
+		return 0;
+	}
+
+#ifdef PAGE_CIPHER_GCM
+	/* Compare the whole tag so the time does not depend on the mismatch. */
+	for (offset = 0; offset < PAGE_TAG_SIZE; offset++)
+	{
+		diff |= ptag[offset] ^ tag[offset];
 	}
 
-	memset(ptr_ctx, 0, ctx_size);
-	free(ptr_ctx);
+	return diff == 0;
+#else
+	return 1;
+#endif
 }
@@ -16,39 +16,115 @@
 
 unsigned char *key = (unsigned char *) "01234567890123456789012345678901";
 unsigned char *iv = (unsigned char *) "0123456789012345";
+
+#if defined(PAGE_CIPHER_GCM)
+#define PAGE_EVP_CIPHER() EVP_aes_256_gcm()
+#elif defined(PAGE_CIPHER_CTR)
+#define PAGE_EVP_CIPHER() EVP_aes_256_ctr()
+#else
+#define PAGE_EVP_CIPHER() EVP_aes_256_cbc()
 #endif
 
-/* #define BUFFLEN  BLCKSZ + SGX_AESGCM_MAC_SIZE + SGX_AESGCM_IV_SIZE */
+/*
+ * Encryption and decryption contexts of a thread. They are initialized
+ * with the key once and only have the IV reset for each page.
+ */
+struct PageCipherContext
+{
+	EVP_CIPHER_CTX *enc_ctx;
+	EVP_CIPHER_CTX *dec_ctx;
+};
 
-void
-page_encryption(unsigned char *plaintext, unsigned char *ciphertext)
+static EVP_CIPHER_CTX *
+page_crypto_ctx(int enc)
 {
-	/* If the pages are not clean */
-#ifndef CPAGES
 	EVP_CIPHER_CTX *ctx;
-	int			ciphertext_len;
-	int			len;
 
 	/* Create and initialise the context */
 	if (!(ctx = EVP_CIPHER_CTX_new()))
-		selog(ERROR, "could not create openssl context for encryption");
+	{
+		selog(ERROR, "could not create openssl context");
+		return NULL;
+	}
 
 	/*
-	 * Initialise the encryption operation. IMPORTANT - ensure you use a key
-	 * and IV size appropriate for your cipher In this example we are using
-	 * 256 bit AES (i.e. a 256 bit key). The IV size for *most* modes is the
-	 * same as the block size. For AES this is 128 bits
+	 * Initialise the cipher operation. IMPORTANT - ensure you use a key and
+	 * IV size appropriate for your cipher In this example we are using 256
+	 * bit AES (i.e. a 256 bit key). The IV size for *most* modes is the same
+	 * as the block size. For AES this is 128 bits
 	 */
-	if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv))
-		selog(ERROR, "could not init encryption context");
+	if (1 != EVP_CipherInit_ex(ctx, PAGE_EVP_CIPHER(), NULL, NULL, NULL, enc))
+		selog(ERROR, "could not init cipher context");
+
+#ifdef PAGE_CIPHER_GCM
+	if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, PAGE_NONCE_SIZE, NULL))
+		selog(ERROR, "could not set the GCM nonce size");
+#endif
+
+	if (1 != EVP_CipherInit_ex(ctx, NULL, NULL, key, NULL, enc))
+		selog(ERROR, "could not set cipher key");
 
 	EVP_CIPHER_CTX_set_padding(ctx, 0);
 
+	return ctx;
+}
+#endif
+
+PageCipherContext *
+page_cipher_context(void)
+{
+#ifndef CPAGES
+	PageCipherContext *ctx;
+
+	ctx = (PageCipherContext *) malloc(sizeof(PageCipherContext));
+	ctx->enc_ctx = page_crypto_ctx(1);
+	ctx->dec_ctx = page_crypto_ctx(0);
+
+	return ctx;
+#else
+	return NULL;
+#endif
+}
+
+void
+page_cipher_context_free(PageCipherContext *ctx)
+{
+#ifndef CPAGES
+	/* Clean up */
+	if (ctx != NULL)
+	{
+		EVP_CIPHER_CTX_free(ctx->enc_ctx);
+		EVP_CIPHER_CTX_free(ctx->dec_ctx);
+		free(ctx);
+	}
+#endif
+}
+
+/* #define BUFFLEN  BLCKSZ + SGX_AESGCM_MAC_SIZE + SGX_AESGCM_IV_SIZE */
+
+void
+page_cipher_encrypt(PageCipherContext *ctx, const unsigned char *piv,
+					unsigned char *plaintext, unsigned char *ciphertext,
+					unsigned char *tag)
+{
+	/* If the pages are not clean */
+#ifndef CPAGES
+	int			ciphertext_len;
+	int			len;
+
+#ifndef PAGE_CIPHER_NONCE
+	piv = iv;
+#endif
+
+	/* Restart the operation with the page IV and the existing key. */
+	if (1 != EVP_EncryptInit_ex(ctx->enc_ctx, NULL, NULL, NULL, piv))
+		selog(ERROR, "could not init encryption context");
+
 	/*
 	 * Provide the message to be encrypted, and obtain the encrypted output.
 	 * EVP_EncryptUpdate can be called multiple times if necessary
 	 */
-	if (1 != EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, BLCKSZ))
+	if (1 != EVP_EncryptUpdate(ctx->enc_ctx, ciphertext, &len, plaintext, BLCKSZ))
 		selog(ERROR, "could not encrypt update");
 
 	ciphertext_len = len;
@@ -57,7 +133,7 @@ page_encryption(unsigned char *plaintext, unsigned char *ciphertext)
 	 * Finalize the encryption. Further ciphertext bytes may be written at
 	 * this stage.
 	 */
-	if (1 != EVP_EncryptFinal_ex(ctx, ciphertext + len, &len))
+	if (1 != EVP_EncryptFinal_ex(ctx->enc_ctx, ciphertext + len, &len))
 		selog(ERROR, "could not finalize encrypt");
 
 	ciphertext_len += len;
@@ -67,54 +143,61 @@ page_encryption(unsigned char *plaintext, unsigned char *ciphertext)
 		selog(ERROR, "Decription plaintex length does not match");
 	}
 
-	/* Clean up */
-	EVP_CIPHER_CTX_free(ctx);
+#ifdef PAGE_CIPHER_GCM
+	if (1 != EVP_CIPHER_CTX_ctrl(ctx->enc_ctx, EVP_CTRL_GCM_GET_TAG, PAGE_TAG_SIZE, tag))
+		selog(ERROR, "could not get the page tag");
+#endif
 #endif
 
 }
 
-void
-page_decryption(unsigned char *ciphertext, unsigned char *plaintext)
+int
+page_cipher_decrypt(PageCipherContext *ctx, const unsigned char *piv,
+					unsigned char *ciphertext, unsigned char *plaintext,
+					const unsigned char *tag)
 {
 
 
 #ifndef CPAGES
-	EVP_CIPHER_CTX *ctx;
-
 	int			len;
 
 	int			plaintext_len;
 
-	/* Create and initialise the context */
-	if (!(ctx = EVP_CIPHER_CTX_new()))
-		selog(ERROR, "could not create openssl context for decryption");
+#ifndef PAGE_CIPHER_NONCE
+	piv = iv;
+#endif
 
-	/*
-	 * Initialise the decryption operation. IMPORTANT - ensure you use a key
-	 * and IV size appropriate for your cipher In this example we are using
-	 * 256 bit AES (i.e. a 256 bit key). The IV size for *most* modes is the
-	 * same as the block size. For AES this is 128 bits
-	 */
-	if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv))
+	/* Restart the operation with the page IV and the existing key. */
+	if (1 != EVP_DecryptInit_ex(ctx->dec_ctx, NULL, NULL, NULL, piv))
 		selog(ERROR, "could not decryption context");
 
-	EVP_CIPHER_CTX_set_padding(ctx, 0);
-
 	/*
 	 * Provide the message to be decrypted, and obtain the plaintext output.
 	 * EVP_DecryptUpdate can be called multiple times if necessary.
 	 */
-	if (1 != EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, BLCKSZ))
+	if (1 != EVP_DecryptUpdate(ctx->dec_ctx, plaintext, &len, ciphertext, BLCKSZ))
 		selog(ERROR, "could not decrypt update");
 
 	plaintext_len = len;
 
+#ifdef PAGE_CIPHER_GCM
+	/* The tag is checked when the decryption is finalized. */
+	if (1 != EVP_CIPHER_CTX_ctrl(ctx->dec_ctx, EVP_CTRL_GCM_SET_TAG, PAGE_TAG_SIZE, (void *) tag))
+		selog(ERROR, "could not set the page tag");
+#endif
+
 	/*
 	 * Finalise the decryption. Further plaintext bytes may be written at this
 	 * stage.
 	 */
-	if (1 != EVP_DecryptFinal_ex(ctx, plaintext + len, &len))
+	if (1 != EVP_DecryptFinal_ex(ctx->dec_ctx, plaintext + len, &len))
+	{
+#ifdef PAGE_CIPHER_GCM
+		return 0;
+#else
 		selog(ERROR, "could not finalize decrypt");
+#endif
+	}
 
 	plaintext_len += len;
 
@@ -123,9 +206,7 @@ page_decryption(unsigned char *ciphertext, unsigned char *plaintext)
 		selog(ERROR, "Decription plaintex length does not match");
 	}
 
-	/* Clean up */
-	EVP_CIPHER_CTX_free(ctx);
-
 #endif
 
+	return 1;
 }
@@ -0,0 +1,56 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_abbrev.h
+ *	  Abbreviated keys of the cached B+-tree pages.
+ *
+ * The upper levels of the trees are kept in enclave memory by the buffer
+ * managers, and every lookup searches them. The cached copy of a page gets
+ * a dense array with the abbreviated keys (see soe_keycmp.h) of its data
+ * items, built on its first search. String and bytea keys are abbreviated
+ * after the prefix that all the keys of the page share, so that keys with
+ * a long common prefix still have distinct abbreviated keys. _bt_binsrch
+ * then narrows the search with a branch-free binary search over the array,
+ * and only compares the scan key with the index tuples that have the same
+ * abbreviated key.
+ *
+ * The array lives with the cached copy and is never written to the page,
+ * so the page format does not change. The buffer managers drop it when the
+ * cached copy is written.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_ABBREV_H
+#define SOE_ABBREV_H
+
+#include "soe_c.h"
+#include "access/soe_skey.h"
+#include "catalog/soe_pg_attribute.h"
+#include "storage/soe_bufpage.h"
+
+typedef struct PageAbbrevKeys
+{
+	/* items first to first + nkeys - 1 of the page */
+	OffsetNumber first;
+	uint16		nkeys;
+	/* whether the first item is minus infinity */
+	bool		minusInfinity;
+	/* false if the keys have no bytes to abbreviate after their prefix */
+	bool		usable;
+	/* prefix of skip bytes shared by the keys, stored after keys */
+	char	   *prefix;
+	int			skip;
+	int			width;
+	uint64		keys[FLEXIBLE_ARRAY_MEMBER];
+}			PageAbbrevKeys;
+
+extern PageAbbrevKeys * abbrev_build(Form_pg_attribute att, Page page,
+									 OffsetNumber first, OffsetNumber last,
+									 bool minusInfinity);
+extern void abbrev_narrow(PageAbbrevKeys * abbrevs, Form_pg_attribute att,
+						  ScanKey scankey, OffsetNumber *low,
+						  OffsetNumber *high);
+
+#endif							/* SOE_ABBREV_H */
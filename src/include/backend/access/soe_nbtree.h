@@ -383,11 +383,15 @@ typedef BTScanOpaqueData * BTScanOpaque;
  * external entry points for btree, in nbtree.c
  */
 extern bool btinsert_s(VRelation indexRel, VRelation heapRel, ItemPointer ht_ctid, char *datum, unsigned int datumSize);
-extern IndexScanDesc btbeginscan_s(VRelation rel, const char *key, int keysize);
+extern IndexScanDesc btbeginscan_s(VRelation rel, const char *key, int keysize,
+								   SOEArena arena);
 extern bool btgettuple_s(IndexScanDesc scan);
+extern void btgetbatch_s(VRelation rel, const char **keys, const int *keySizes,
+						 int nkeys, ItemPointer tids);
 extern void btendscan_s(IndexScanDesc scan);
 extern void btree_load_s(VRelation indexRel, char* block, unsigned int level, unsigned int  offset);
-extern void btree_fanout_setup(int* fanouts, 
+extern void btree_load_level_s(VRelation indexRel, char* blocks, unsigned int nblocks, unsigned int level, unsigned int offset);
+extern void btree_fanout_setup(VRelation rel, int* fanouts,
                                unsigned int fanout_size,
                                unsigned int nlevels);
 
@@ -409,6 +413,7 @@ extern Buffer _bt_getbuf_s(VRelation rel, BlockNumber blkno, int access);
 extern void _bt_relbuf_s(VRelation rel, Buffer buf);
 extern void _bt_pageinit_s(Page page, Size size);
 extern Buffer _bt_getbuf_level_s(VRelation rel, BlockNumber blkno);
+extern BlockNumber _bt_level_nblocks_s(VRelation rel, unsigned int level);
 
 /*
  * prototypes for functions in nbtsearch.c
@@ -420,6 +425,8 @@ extern OffsetNumber _bt_binsrch_s(VRelation rel, Buffer buf, int keysz,
 								  ScanKey scankey, bool nextkey);
 extern int32 _bt_compare_s(VRelation rel, int keysz, ScanKey scankey,
 						   Page page, OffsetNumber offnum);
+extern void _bt_search_batch_s(VRelation rel, ScanKey scankeys, int nkeys,
+							   ItemPointer tids);
 extern bool _bt_first_s(IndexScanDesc scan);
 extern bool _bt_next_s(IndexScanDesc scan);
 extern void bt_dummy_search_s(VRelation rel, int maxHeight);
@@ -429,8 +436,6 @@ extern void bt_dummy_search_s(VRelation rel, int maxHeight);
  * prototypes for functions in nbtutils.c
  */
 extern ScanKey _bt_mkscankey_s(VRelation rel, IndexTuple itup, char *datum, int dsize);
-extern void _bt_freeskey_s(ScanKey skey);
-extern void _bt_freestack_s(BTStack stack);
 extern IndexTuple _bt_checkkeys_s(IndexScanDesc scan,
 								  Page page, OffsetNumber offnum, bool *continuescan);
 extern int	bpchartruelen_s(char *s, int len);
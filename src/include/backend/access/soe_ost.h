@@ -377,8 +377,12 @@ typedef BTScanOpaqueDataOST * BTScanOpaqueOST;
  * external entry points for btree, in nbtree.c
  */
 extern bool insert_ost(OSTRelation relstate, char *block, unsigned int level, unsigned int offset);
-extern IndexScanDesc btbeginscan_ost(OSTRelation rel, const char *key, int keysize);
+extern bool insert_level_ost(OSTRelation relstate, char *blocks, unsigned int nblocks, unsigned int level, unsigned int offset);
+extern IndexScanDesc btbeginscan_ost(OSTRelation rel, const char *key, int keysize,
+									 SOEArena arena);
 extern bool btgettuple_ost(IndexScanDesc scan);
+extern void btgetbatch_ost(OSTRelation rel, const char **keys,
+						   const int *keySizes, int nkeys, ItemPointer tids);
 extern void btendscan_ost(IndexScanDesc scan);
 
 
@@ -405,6 +409,8 @@ extern OffsetNumber _bt_binsrch_ost(OSTRelation rel, Buffer buf, int keysz,
 extern int32 _bt_compare_ost(OSTRelation rel, int keysz, ScanKey scankey,
 							 Page page, OffsetNumber offnum);
 extern bool _bt_first_ost(IndexScanDesc scan);
+extern void _bt_search_batch_ost(OSTRelation rel, ScanKey scankeys, int nkeys,
+								 ItemPointer tids);
 extern bool _bt_next_ost(IndexScanDesc scan);
 extern void bt_dummy_search_ost(OSTRelation rel, int maxHeight);
  
@@ -414,7 +420,6 @@ extern void bt_dummy_search_ost(OSTRelation rel, int maxHeight);
  */
 extern ScanKey _bt_mkscankey_ost(OSTRelation rel, IndexTuple itup, char *datum, int dsize);
 extern void _bt_freeskey_ost(ScanKey skey);
-extern void _bt_freestack_ost(BTStackOST stack);
 extern IndexTuple _bt_checkkeys_ost(IndexScanDesc scan,
 									Page page, OffsetNumber offnum, bool *continuescan);
 extern int	bpchartruelen_ost(char *s, int len);
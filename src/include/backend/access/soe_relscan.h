@@ -7,6 +7,7 @@
 #include "access/soe_skey.h"
 #include "access/soe_itup.h"
 #include "access/soe_htup.h"
+#include "utils/soe_arena.h"
 
 /*
  * We use the same IndexScanDescData structure for both amgettuple-based
@@ -24,6 +25,9 @@ typedef struct IndexScanDescData
 	/* index access method's private state */
 	void	   *opaque;			/* access-method-specific info */
 
+	/* arena of the scan state, reset when the scan ends */
+	SOEArena	arena;
+
 	/* xs_ctup/xs_cbuf/xs_recheck are valid after a successful index_getnext */
 	HeapTupleData xs_ctup;		/* current heap tuple, if any */
 	Buffer		xs_cbuf;		/* current heap buffer in scan, if any */
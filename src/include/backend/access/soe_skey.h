@@ -16,6 +16,7 @@
 
 
 #include "soe_c.h"
+#include "utils/soe_keycmp.h"
 
 
 /*
@@ -65,6 +66,7 @@ typedef struct ScanKeyData
 	Oid			sk_subtype;		/* strategy subtype */
 	char	   *sk_argument;	/* data to compare */
 	int			datumSize;
+	SOEKeyCompare sk_compare;	/* comparator of the key type */
 }			ScanKeyData;
 
 typedef ScanKeyData * ScanKey;
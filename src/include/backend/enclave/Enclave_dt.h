@@ -8,35 +8,64 @@ typedef unsigned int sgx_status_t;
 
 
 
-void		initSOE(const char *tName, const char *iName, int tNBlocks, 
+int			initSOE(const char *tName, const char *iName, int tNBlocks, 
                     int* fanouts, unsigned int fanout_size,
                     unsigned int nlevels,int nBlocks, unsigned int tOid,
                     unsigned int iOid, unsigned int functionOid, 
                     unsigned int indexHandler, char *attrDesc, 
                     unsigned int attrDescLength);
 
-void		initFSOE(const char *tName, const char *iName, int tNBlocks, 
+int			initFSOE(const char *tName, const char *iName, int tNBlocks, 
                      int *fanout, unsigned int fanout_size, 
                      unsigned int nlevels, unsigned int tOid, 
                      unsigned int iOid, char *pg_attr_desc, 
                      unsigned int pgDescSize);
 
-void		insert(const char *heapTuple, unsigned int tupleSize, 
+void		insert(int handle, const char *heapTuple, unsigned int tupleSize, 
                    char *datum, unsigned int datumSize);
 
-void		addIndexBlock(char *block, unsigned int blockSize, 
+void		addIndexBlock(int handle, char *block, unsigned int blockSize, 
                           unsigned int offset, unsigned int level);
 
-void		addHeapBlock(char *block, unsigned int blockSize, 
+void		addIndexLevel(int handle, char *blocks, unsigned int blocksSize,
+                          unsigned int nblocks, unsigned int offset,
+                          unsigned int level);
+
+void		addHeapBlock(int handle, char *block, unsigned int blockSize, 
                          unsigned int blkno);
 
-void		insertHeap(const char *heapTuple, unsigned int tupleSize);
+void		addHeapBlocks(int handle, char *blocks, unsigned int blocksSize,
+                          unsigned int nblocks, unsigned int blkno);
+
+void		insertHeap(int handle, const char *heapTuple, unsigned int tupleSize);
 
-int			getTuple(unsigned int opmode, unsigned int opoid, 
+int			getTuple(int handle, unsigned int opmode, unsigned int opoid, 
                      const char *key, int scanKeySize, char *tuple, 
                      unsigned int tupleLen, char *tupleData, 
                      unsigned int tupleDataLen);
 
+int			getTuples(int handle, unsigned int opmode, unsigned int opoid,
+                      const char *key, int scanKeySize, char *tuples,
+                      unsigned int tuplesLen, unsigned int *offsets,
+                      unsigned int maxTuples, unsigned int *nTuples);
+
+int			getTuplesBatch(int handle, const char *keys, unsigned int keysSize,
+                           const unsigned int *keySizes, unsigned int nkeys,
+                           char *tuples, unsigned int tuplesLen,
+                           unsigned int *offsets);
+
+void		endScan(int handle);
+
+int			getStats(int handle, char *stats, unsigned int statsSize, int reset);
+
+void		setLogLevel(int level);
+
+void		closeRelation(int handle);
+
+void		initRing(void *ring);
+
+void		runWorker(void);
+
 void		closeSoe();
 
 extern void oc_logger(const char *str);
@@ -48,6 +77,12 @@ extern sgx_status_t outFileRead(char *page, const char *filename, int blkno,
                                 int pageSize);
 extern sgx_status_t outFileWrite(const char *block, const char *filename, 
                                  int oblkno, int pageSize);
+extern sgx_status_t outFileReadv(char *pages, const char *filename,
+                                 const int *blknos, int nblocks,
+                                 int pageSize, int pagesSize);
+extern sgx_status_t outFileWritev(const char *pages, const char *filename,
+                                  const int *blknos, int nblocks,
+                                  int pageSize, int pagesSize);
 extern sgx_status_t outFileClose(const char *filename);
 
 #endif          /*ENCLAVE_DT_H*/
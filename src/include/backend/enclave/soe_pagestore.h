@@ -0,0 +1,52 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_pagestore.h
+ *	  Untrusted page store that implements the file OCALLs of the SOE.
+ *
+ * The page store keeps each relation file of the SOE as a file of a
+ * directory, so the SOE can run without the database that normally serves
+ * its OCALLs. A file is accessed through a shared memory mapping, or with
+ * pread and pwrite, optionally with O_DIRECT to bypass the page cache.
+ *
+ * The store is set up with soe_pagestore_configure before the first OCALL.
+ * Otherwise it is set up on the first OCALL from the environment:
+ *
+ *	SOE_PAGESTORE_DIR		directory of the files (default ".")
+ *	SOE_PAGESTORE_BACKEND	mmap (default), pread or direct
+ *	SOE_PAGESTORE_SYNC		none (default), close or write
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_PAGESTORE_H
+#define SOE_PAGESTORE_H
+
+typedef enum SOEPageStoreBackend
+{
+	SOE_PAGESTORE_MMAP,
+	SOE_PAGESTORE_PREAD,
+	/* pread and pwrite with O_DIRECT */
+	SOE_PAGESTORE_DIRECT
+}			SOEPageStoreBackend;
+
+/* When the written pages are forced to the device. */
+typedef enum SOEPageStoreSync
+{
+	SOE_PAGESTORE_SYNC_NONE,
+	/* when the relation file is closed */
+	SOE_PAGESTORE_SYNC_CLOSE,
+	/* on every write */
+	SOE_PAGESTORE_SYNC_WRITE
+}			SOEPageStoreSync;
+
+/*
+ * soe_pagestore_configure returns 0 on success and -1 if dir is not a
+ * directory. soe_pagestore_close closes every open relation file.
+ */
+extern int	soe_pagestore_configure(const char *dir, SOEPageStoreBackend backend,
+									SOEPageStoreSync sync);
+extern void soe_pagestore_close(void);
+
+#endif							/* SOE_PAGESTORE_H */
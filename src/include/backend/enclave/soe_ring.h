@@ -0,0 +1,57 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_ring.h
+ *	  Request ring shared between the enclave and the untrusted page store.
+ *
+ * The ring lives in untrusted memory. The enclave posts page reads and
+ * writes on its slots and spins until a worker thread on the untrusted
+ * side serves them, so the page I/O does not exit the enclave. The worker
+ * serves the requests with the same outFileRead and outFileWrite functions
+ * that implement the OCALLs.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_RING_H
+#define SOE_RING_H
+
+#define SOE_RING_SLOTS		64
+#define SOE_RING_NAMELEN	64
+#define SOE_RING_PAGESIZE	8192
+
+/* Slot states */
+#define SOE_RING_FREE		0
+#define SOE_RING_POSTED		1
+#define SOE_RING_DONE		2
+
+/* Slot operations */
+#define SOE_RING_READ		0
+#define SOE_RING_WRITE		1
+
+typedef struct SOERingSlot
+{
+	volatile int state;
+	int			op;
+	int			blkno;
+	char		filename[SOE_RING_NAMELEN];
+	char		page[SOE_RING_PAGESIZE];
+}			SOERingSlot;
+
+typedef struct SOERing
+{
+	volatile int stop;
+	SOERingSlot slots[SOE_RING_SLOTS];
+}			SOERing;
+
+/*
+ * Untrusted side. soe_ring_serve serves the requests posted on ring until
+ * its stop flag is set. soe_ring_start allocates a ring and starts a thread
+ * that serves it, and soe_ring_stop stops that thread and frees the ring.
+ */
+extern void soe_ring_serve(SOERing * ring);
+extern SOERing * soe_ring_start(void);
+extern void soe_ring_stop(SOERing * ring);
+
+#endif							/* SOE_RING_H */
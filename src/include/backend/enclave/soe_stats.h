@@ -0,0 +1,93 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_stats.h
+ *	  Runtime counters of the SOE returned by the getStats ECALL.
+ *
+ * The enclave keeps a set of counters for every relation, one for every
+ * ECALL of SOEStatsEcall with the calls on all relations, and one with the
+ * totals. getStats copies one of them to the caller as a SOEStats struct,
+ * whose layout only changes with SOE_STATS_VERSION, so it can be exported
+ * as is to a metrics system.
+ *
+ * A counter is charged to a relation and to an ECALL when it is updated by
+ * that ECALL on the relation. The file I/O and the page encryption run by
+ * the partition workers of runWorker only count in the totals.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_STATS_H
+#define SOE_STATS_H
+
+#include <stdint.h>
+
+#define SOE_STATS_VERSION	2
+
+/* Handle of getStats that returns the totals of all relations. */
+#define SOE_STATS_ALL		(-1)
+
+/* Handle of getStats that returns the counters of an SOEStatsEcall. */
+#define SOE_STATS_ECALL(ecall)	(-2 - (int) (ecall))
+
+/* ECALLs counted in SOEStats.ecalls */
+typedef enum SOEStatsEcall
+{
+	SOE_STATS_GETTUPLE,
+	SOE_STATS_GETTUPLES,
+	SOE_STATS_ENDSCAN,
+	SOE_STATS_INSERT,
+	/* addHeapBlock(s), addIndexBlock and addIndexLevel */
+	SOE_STATS_LOAD,
+	SOE_STATS_GETTUPLESBATCH,
+	SOE_STATS_NECALLS
+}			SOEStatsEcall;
+
+typedef struct SOEStats
+{
+	/* SOE_STATS_VERSION and sizeof(SOEStats) */
+	uint32_t	version;
+	uint32_t	size;
+
+	uint64_t	ecalls[SOE_STATS_NECALLS];
+
+	/* read_oram and write_oram calls, and dummy reads among the reads */
+	uint64_t	oramReads;
+	uint64_t	oramWrites;
+	uint64_t	dummyReads;
+
+	/* file reads and writes sent with OCALLs, and their bytes */
+	uint64_t	ocallReads;
+	uint64_t	ocallWrites;
+	uint64_t	bytesRead;
+	uint64_t	bytesWritten;
+	/* pages read and written through the request ring instead */
+	uint64_t	ringReads;
+	uint64_t	ringWrites;
+
+	/*
+	 * Pages encrypted and decrypted, and the TSC cycles spent on them. The
+	 * cycles are only measured on UNSAFE builds, as RDTSC can't be used in
+	 * every enclave.
+	 */
+	uint64_t	encryptions;
+	uint64_t	decryptions;
+	uint64_t	cryptoCycles;
+
+	/* buffers pinned by the table and index access methods */
+	uint64_t	buffersPinned;
+	/* tree levels descended by the index searches */
+	uint64_t	levelsDescended;
+	uint64_t	pageSplits;
+	uint64_t	bucketSplits;
+
+	/*
+	 * Largest number of blocks held in the stash of one ORAM. The stash is
+	 * seen from the oblivious file: a block read from the tree enters the
+	 * stash and leaves it when it is written back to the tree.
+	 */
+	uint64_t	stashHighWater;
+}			SOEStats;
+
+#endif							/* SOE_STATS_H */
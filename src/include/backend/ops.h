@@ -19,5 +19,10 @@
 #define STR_GREATER_THAN_OR_EQUAL 1061
 #define STR_EQUAL 1070
 
+/* Offset of getTuplesBatch for a key without a result */
+#define BATCH_NO_TUPLE 0xFFFFFFFF
+/* Offset of getTuplesBatch for a key whose tuple did not fit in the buffer */
+#define BATCH_NO_ROOM 0xFFFFFFFE
+
 
 #endif   /* SOE_OPS_H */
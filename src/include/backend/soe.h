@@ -19,6 +19,7 @@
 #include "access/soe_htup.h"
 #include <oram/ofile.h>
 #include "storage/soe_ost_bufmgr.h"
+#include "storage/soe_partition.h"
 
 
 //#include "access/attnum.h"
@@ -39,7 +40,9 @@ typedef uint16 StrategyNumber;
 
 //extern declarations
 
-extern ORAMState initORAMState(const char *name, int nBlocks, AMOFile* (*ofile)(), bool isHeap);
+extern ORAMState initORAMState(const char *name, int nBlocks, AMOFile* (*ofile)(), Amgr **amgr, unsigned int treeTopLevels, void *appData);
+
+extern ORAMPartitions initORAMPartitions(const char *name, int nBlocks, AMOFile* (*ofile)());
 
 extern void FormIndexDatum_s(HeapTuple tuple, Datum *values, bool *isnull);
 
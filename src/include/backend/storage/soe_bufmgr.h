@@ -6,6 +6,7 @@
 #include "storage/soe_buf.h"
 #include "storage/soe_bufpage.h"
 #include "storage/soe_block.h"
+#include "storage/soe_partition.h"
 
 #include <oram/oram.h>
 #include <oram/plblock.h>
@@ -53,6 +54,45 @@
 
 typedef void (*pageinit_function) (Page page, int blockNum, Size blocksize);
 
+/*
+ * Initial number of buffer descriptors of a VRelation. Only a handful of
+ * pages are ever pinned at the same time (a btree split pins the original
+ * page, its new sibling, the parent and the metapage), so the table rarely
+ * grows. VBUFFER_SLOTS is the initial size of the open-addressed index over
+ * the descriptors. It must be a power of two and larger than
+ * VBUFFER_POOL_SIZE so that a probe sequence always ends on an empty slot;
+ * both double together when every descriptor is pinned.
+ */
+#define VBUFFER_POOL_SIZE	128
+#define VBUFFER_SLOTS		256
+#define VBUFFER_NOSLOT		(-1)
+
+typedef struct VBlock
+{
+	int			id;
+	char	   *page;
+	int			refcount;
+	/* number of pins on the block */
+	int			freeNext;
+	/* next descriptor on the free list when the descriptor is unused */
+}		   *VBlock;
+
+/*
+ * Buffer table of a VRelation. Pinned blocks are found with a linear probe
+ * on slots, keyed by the block number, and unused descriptors are kept on a
+ * free list so pinning a block only allocates when the table grows.
+ * Descriptors only hold pinned blocks, so none can be evicted to make room.
+ */
+typedef struct VBufferTable
+{
+	struct VBlock *descs;
+	int		   *slots;
+	int			ndescs;
+	int			nslots;
+	int			freeList;
+	int			nused;
+}			VBufferTable;
+
 typedef struct VRelation
 {
 	BlockNumber currentBlock;
@@ -64,7 +104,11 @@ typedef struct VRelation
 	/* in memory free space map that keeps the number of items in each block */
 
 	ORAMState	oram;
-	List	   *buffer;
+	/* appData of oram, freed with the relation */
+	void	   *appData;
+	/* Partitions of the ORAM, or NULL if oram is used */
+	ORAMPartitions parts;
+	VBufferTable *buffer;
 	/* Buffer containing relation pages */
 
 	/*
@@ -91,14 +135,26 @@ typedef struct VRelation
      * */
     unsigned int level;
 
-}		   *VRelation;
+	/*
+	 * First logical block of each tree level on the index ORAM, set by
+	 * btree_fanout_setup for the nlevels levels of the tree.
+	 */
+	unsigned int *level_offsets;
+	unsigned int nlevels;
 
-typedef struct VBlock
-{
-	int			id;
-	char	   *page;
-}		   *VBlock;
+	/*
+	 * Copies of the blocks of the cachedLevels upper tree levels, which are
+	 * the blocks below cachedBlocks. They are read without accessing the
+	 * ORAM and written through to it. A block is NULL until it is first
+	 * read or written.
+	 */
+	unsigned int cachedLevels;
+	BlockNumber cachedBlocks;
+	char	  **cache;
+	/* Abbreviated keys of the cached blocks, see soe_abbrev.h */
+	struct PageAbbrevKeys **abbrevs;
 
+}		   *VRelation;
 
 
 
@@ -113,7 +169,7 @@ typedef struct VBlock
 #define P_NEW	InvalidBlockNumber	/* grow the file to get a new page */
 
 
-extern VRelation InitVRelation(ORAMState relstate, unsigned int oid, int total_blocks, pageinit_function pg_f);
+extern VRelation InitVRelation(ORAMState relstate, void *appData, unsigned int oid, int total_blocks, pageinit_function pg_f);
 
 extern Buffer ReadDummyBuffer(VRelation relation, BlockNumber blockNum);
                               
@@ -123,10 +179,14 @@ extern Page BufferGetPage_s(VRelation relation, Buffer buffer);
 
 extern void MarkBufferDirty_s(VRelation relation, Buffer buffer);
 
+extern void WriteBlock_s(VRelation relation, BlockNumber blockNum, Page page);
+
 extern void ReleaseBuffer_s(VRelation relation, Buffer buffer);
 
 extern BlockNumber BufferGetBlockNumber_s(Buffer buffer);
 
+extern struct PageAbbrevKeys **BufferGetAbbrevKeys_s(VRelation relation, Buffer buffer);
+
 extern BlockNumber NumberOfBlocks_s(VRelation rel);
 
 extern BlockNumber FreeSpaceBlock_s(VRelation rel);
@@ -135,5 +195,9 @@ extern void UpdateFSM(VRelation rel);
 
 extern void BufferFull_s(VRelation rel, Buffer buffer);
 
+extern void LoadedBlock_s(VRelation rel, BlockNumber blkno);
+
+extern void CacheLevels_s(VRelation rel, unsigned int nlevels, BlockNumber nblocks);
+
 extern void closeVRelation(VRelation rel);
 #endif          /* SOE_BUFMGR_H*/
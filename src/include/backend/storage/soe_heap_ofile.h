@@ -3,6 +3,7 @@
 
 #include "soe_c.h"
 #include "storage/soe_bufpage.h"
+#include "storage/soe_ofile.h"
 #include <oram/ofile.h>
 
 
@@ -16,6 +17,25 @@ typedef struct OblivPageOpaqueData
 
 typedef OblivPageOpaqueData * OblivPageOpaque;
 
+/*
+ * Partition of a heap, passed as the appData of its ORAM. The ORAMs of all
+ * partitions share the relation file, each one placed after the previous
+ * partition. Heap block b is block b / npartitions of partition
+ * b % npartitions. An unpartitioned heap is a single partition.
+ */
+typedef struct HeapPartitionData
+{
+	ORAMFileData ofile;
+	int			partition;
+	int			npartitions;
+	/* first file block of the partition */
+	unsigned int offset;
+	/* number of file blocks of the partition ORAM */
+	unsigned int nblocks;
+}			HeapPartitionData;
+
+typedef HeapPartitionData * HeapPartition;
+
 void		heap_pageInit(Page page, int blkno, Size blocksize);
 
 extern AMOFile * heap_ofileCreate();
@@ -0,0 +1,77 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_lock.h
+ *	  Locks used to run the SOE from several threads.
+ *
+ * Inside the enclave the locks are the SGX SDK thread primitives, and on
+ * the UNSAFE build they are the pthread ones. Every enclave thread runs on
+ * its own TCS, so soe_thread_self identifies the thread of the client that
+ * made the ECALL.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_LOCK_H
+#define SOE_LOCK_H
+
+#ifdef UNSAFE
+
+#include <pthread.h>
+
+typedef pthread_mutex_t SOEMutex;
+typedef pthread_rwlock_t SOERWLock;
+typedef pthread_t SOEThread;
+typedef pthread_cond_t SOECond;
+
+#define SOE_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define SOE_RWLOCK_INITIALIZER PTHREAD_RWLOCK_INITIALIZER
+#define SOE_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+
+#define soe_mutex_init(m)		pthread_mutex_init((m), NULL)
+#define soe_mutex_destroy(m)	pthread_mutex_destroy(m)
+#define soe_mutex_lock(m)		pthread_mutex_lock(m)
+#define soe_mutex_unlock(m)		pthread_mutex_unlock(m)
+
+#define soe_rwlock_rdlock(l)	pthread_rwlock_rdlock(l)
+#define soe_rwlock_wrlock(l)	pthread_rwlock_wrlock(l)
+#define soe_rwlock_rdunlock(l)	pthread_rwlock_unlock(l)
+#define soe_rwlock_wrunlock(l)	pthread_rwlock_unlock(l)
+
+#define soe_cond_wait(c, m)		pthread_cond_wait((c), (m))
+#define soe_cond_broadcast(c)	pthread_cond_broadcast(c)
+
+#define soe_thread_self()		pthread_self()
+
+#else
+
+#include "sgx_thread.h"
+
+typedef sgx_thread_mutex_t SOEMutex;
+typedef sgx_thread_rwlock_t SOERWLock;
+typedef sgx_thread_t SOEThread;
+typedef sgx_thread_cond_t SOECond;
+
+#define SOE_MUTEX_INITIALIZER SGX_THREAD_MUTEX_INITIALIZER
+#define SOE_RWLOCK_INITIALIZER SGX_THREAD_RWLOCK_INITIALIZER
+#define SOE_COND_INITIALIZER SGX_THREAD_COND_INITIALIZER
+
+#define soe_mutex_init(m)		sgx_thread_mutex_init((m), NULL)
+#define soe_mutex_destroy(m)	sgx_thread_mutex_destroy(m)
+#define soe_mutex_lock(m)		sgx_thread_mutex_lock(m)
+#define soe_mutex_unlock(m)		sgx_thread_mutex_unlock(m)
+
+#define soe_rwlock_rdlock(l)	sgx_thread_rwlock_rdlock(l)
+#define soe_rwlock_wrlock(l)	sgx_thread_rwlock_wrlock(l)
+#define soe_rwlock_rdunlock(l)	sgx_thread_rwlock_rdunlock(l)
+#define soe_rwlock_wrunlock(l)	sgx_thread_rwlock_wrunlock(l)
+
+#define soe_cond_wait(c, m)		sgx_thread_cond_wait((c), (m))
+#define soe_cond_broadcast(c)	sgx_thread_cond_broadcast(c)
+
+#define soe_thread_self()		sgx_thread_self()
+
+#endif
+
+#endif							/* SOE_LOCK_H */
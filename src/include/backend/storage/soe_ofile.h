@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_ofile.h
+ *	  Enclave state of an ORAM that its oblivious file works on.
+ *
+ * The appData given to each ORAM starts with an ORAMFileData, which the
+ * oblivious file calls receive back on every block they read or write. The
+ * state of the ORAM is set up once, when the ORAM is created, so the calls
+ * reach it without looking the relation file up by name. The partitions of
+ * a heap and the levels of an OST index embed it as the first member of
+ * their own appData.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_OFILE_H
+#define SOE_OFILE_H
+
+#include "soe_c.h"
+
+typedef struct ORAMFileData
+{
+	/* cached top levels of the bucket tree, or NULL */
+	struct TreeTopFile *treetop;
+	/* stash tracker of the ORAM */
+	struct CountersORAM *counters;
+	/* page cipher state of the file, shared by the ORAMs of the file */
+	struct PageCipherFile *cipher;
+}			ORAMFileData;
+
+typedef ORAMFileData *ORAMFile;
+
+#endif							/* SOE_OFILE_H */
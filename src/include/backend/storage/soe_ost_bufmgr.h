@@ -4,6 +4,7 @@
 #include "storage/soe_buf.h"
 #include "storage/soe_bufpage.h"
 #include "storage/soe_block.h"
+#include "storage/soe_ofile.h"
 
 
 #include <oram/oram.h>
@@ -30,13 +31,35 @@
     (bufnum) != InvalidBuffer  \
 )
 
+/*
+ * Placement of a tree level on the index file. Level 0 is the root block
+ * and every level l > 0 is the file region of the ORAM orams[l - 1]. The
+ * descriptor of the level being accessed is the appData of the ORAM and
+ * oblivious file calls.
+ */
+typedef struct OSTLevelData
+{
+	ORAMFileData ofile;
+	int			level;
+	/* first file block of the level */
+	unsigned int offset;
+	/* number of file blocks of the level */
+	unsigned int nblocks;
+}			OSTLevelData;
+
+typedef OSTLevelData *OSTLevel;
+
 typedef struct OSTreeState
 {
 	int		   *fanouts;
 	int			nlevels;
 	unsigned int iOid;
 	ORAMState  *orams;
+	/* access managers of the level orams */
+	Amgr	  **amgrs;
 	char	   *iname;
+	/* nlevels + 1 level descriptors */
+	OSTLevel	levels;
 }		   *OSTreeState;
 
 /* Read only Relation to execute the OST protocol. */
@@ -57,6 +80,17 @@ typedef struct OSTRelation
 	/* Current level being usd on the hierarchical trees */
 	unsigned int level;
 
+	/*
+	 * Copies of the blocks of the cachedLevels upper levels, one array per
+	 * level. They are read without accessing the level ORAMs or the root
+	 * file block and written through to them. A block is NULL until it is
+	 * first read or written.
+	 */
+	unsigned int cachedLevels;
+	char	 ***cache;
+	/* Abbreviated keys of the cached blocks, see soe_abbrev.h */
+	struct PageAbbrevKeys ***abbrevs;
+
 }		   *OSTRelation;
 
 
@@ -82,10 +116,14 @@ extern Page BufferGetPage_ost(OSTRelation relation, Buffer buffer);
 
 extern void MarkBufferDirty_ost(OSTRelation relation, Buffer buffer);
 
+extern void WriteBlock_ost(OSTRelation relation, BlockNumber blockNum, Page page);
+
 extern void ReleaseBuffer_ost(OSTRelation relation, Buffer buffer);
 
 extern BlockNumber BufferGetBlockNumber_ost(Buffer buffer);
 
+extern struct PageAbbrevKeys **BufferGetAbbrevKeys_ost(OSTRelation relation, Buffer buffer);
+
 extern void closeOSTRelation(OSTRelation rel);
 
 /* extern void setclevel(unsigned int nlevel); */
@@ -10,8 +10,7 @@
 #include <oram/ofile.h>
 
 
-extern void init_root(const char* filename);
-extern void ost_status(OSTreeState state);
+extern void init_root(const char* filename, OSTLevel root);
 extern AMOFile * ost_ofileCreate();
 
 void		ost_pageInit(Page page, int blkno, Size blocksize);
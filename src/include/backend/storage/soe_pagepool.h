@@ -0,0 +1,39 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_pagepool.h
+ *	  Slab pool of the pages and buffer descriptors of the buffer managers.
+ *
+ * The pool serves BLCKSZ pages, aligned on BLCKSZ, and buffer descriptors
+ * from a reserve of PAGE_POOL_SIZE objects of each kind, allocated once.
+ * The objects freed by a thread are kept on a free list of the thread, and
+ * only move to the shared list of the pool in batches. When the reserve is
+ * exhausted the objects are allocated with malloc.
+ *
+ * pagepool_free also takes pages that were not allocated by the pool, such
+ * as the pages returned by read_oram, and frees them with free, so a buffer
+ * manager releases all its pages the same way.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_PAGEPOOL_H
+#define SOE_PAGEPOOL_H
+
+#include "soe_c.h"
+
+/* Pages and descriptors in the reserve of the pool */
+#ifndef PAGE_POOL_SIZE
+#define PAGE_POOL_SIZE 1024
+#endif
+
+/* Largest buffer descriptor served by the pool */
+#define PAGE_POOL_DESC_SIZE 64
+
+extern char *pagepool_alloc(void);
+extern void pagepool_free(void *page);
+extern void *pagepool_desc_alloc(Size size);
+extern void pagepool_desc_free(void *desc);
+
+#endif							/* SOE_PAGEPOOL_H */
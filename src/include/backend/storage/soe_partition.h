@@ -0,0 +1,52 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_partition.h
+ *	  Heap ORAM split in independent partitions.
+ *
+ * A partitioned heap stores its blocks on HEAP_PARTITIONS smaller ORAMs,
+ * each with its own stash, position map and region of the relation file.
+ * To hide the partition of the block being accessed, every access reads or
+ * writes the block on its partition and reads a random block on each of the
+ * others. The accesses to the partitions are run in parallel by the enclave
+ * threads that entered through the runWorker ECALL, and by the requesting
+ * thread itself.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_PARTITION_H
+#define SOE_PARTITION_H
+
+#include "soe_c.h"
+#include "storage/soe_heap_ofile.h"
+
+#include <oram/oram.h>
+
+/* Number of partitions of the heap ORAMs. A single partition disables it. */
+#ifndef HEAP_PARTITIONS
+#define HEAP_PARTITIONS 1
+#endif
+
+typedef struct ORAMPartitionsData
+{
+	int			npartitions;
+	/* number of heap blocks on each partition */
+	unsigned int nblocks;
+	ORAMState  *orams;
+	Amgr	  **amgrs;
+	/* appData of the partition ORAMs */
+	HeapPartitionData *partitions;
+}			ORAMPartitionsData;
+
+typedef ORAMPartitionsData * ORAMPartitions;
+
+extern int	partition_read(ORAMPartitions parts, char **page, BlockNumber blkno);
+extern int	partition_write(ORAMPartitions parts, char *page, BlockNumber blkno);
+extern void partition_close(ORAMPartitions parts);
+
+extern void partition_worker_run(void);
+extern void partition_workers_stop(void);
+
+#endif							/* SOE_PARTITION_H */
@@ -0,0 +1,49 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_treetop.h
+ *	  Top levels of the ORAM bucket trees kept decrypted in the enclave.
+ *
+ * Every ORAM access reads and writes a whole path from the root of the
+ * bucket tree, so the buckets of the upper levels are on every path. The
+ * oblivious files keep the blocks of the first levels of each tree in
+ * enclave memory: reads of those blocks are served without an OCALL or a
+ * decryption, and writes only update the enclave copy.
+ *
+ * The ORAM file is taken to hold the buckets of the tree in heap order,
+ * BKCAP blocks per bucket, so the first nlevels levels are the first
+ * (2^nlevels - 1) * BKCAP blocks of the file. The cache is correct on any
+ * other layout, it only saves fewer accesses.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_TREETOP_H
+#define SOE_TREETOP_H
+
+#include "soe_c.h"
+#include "storage/soe_block.h"
+#include "storage/soe_ofile.h"
+
+/*
+ * Levels of the bucket tree of each ORAM kept in the enclave. It applies to
+ * the table and DYNAMIC index ORAMs of every relation alike; the level
+ * ORAMs of an OST index do not use the cache.
+ */
+#ifndef ORAM_TREETOP_LEVELS
+#define ORAM_TREETOP_LEVELS 4
+#endif
+
+/*
+ * Cache of one ORAM, kept on the ORAMFileData of the ORAM. A NULL cache
+ * holds no block.
+ */
+typedef struct TreeTopFile TreeTopFile;
+
+extern TreeTopFile *treetop_create(const char *filename, unsigned int nlevels);
+extern bool treetop_read(TreeTopFile *tfile, BlockNumber blkno, char *page);
+extern bool treetop_write(TreeTopFile *tfile, BlockNumber blkno, const char *page);
+extern void treetop_close(TreeTopFile *tfile);
+
+#endif							/* SOE_TREETOP_H */
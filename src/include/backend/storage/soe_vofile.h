@@ -0,0 +1,53 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_vofile.h
+ *	  Vectored I/O on the relation files used by the oblivious files.
+ *
+ * The ORAM library reads and writes the blocks of a path one at a time
+ * through the AMOFile callbacks. The writes of the callbacks are queued
+ * and sent to the untrusted side in a single outFileWritev call when the
+ * buffer layer completes the ORAM access with vofile_flush. The reads of a
+ * bucket are served by a single outFileReadv, see vofile_read_bucket.
+ *
+ * When a request ring is set with vofile_set_ring, reads and writes are
+ * posted on the ring instead of being sent with OCALLs.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_VOFILE_H
+#define SOE_VOFILE_H
+
+#ifdef UNSAFE
+#include "Enclave_dt.h"
+#else
+#include "sgx_trts.h"
+#include "Enclave_t.h"
+#endif
+
+/*
+ * Maximum number of queued writes. A PathORAM access writes BKCAP blocks
+ * per tree level, so this covers the path of any tree that fits in memory.
+ */
+#define VOFILE_BATCH_BLOCKS 256
+
+/*  Bucket capacity */
+#ifdef SMALL_BKCAP
+#define BKCAP 1
+#else
+#define BKCAP 4
+#endif
+
+extern sgx_status_t vofile_read(char *page, const char *filename, int blkno);
+extern void vofile_read_ahead(const char *filename, int blkno, int nblocks);
+extern sgx_status_t vofile_readv(char *pages, const char *filename, const int *blknos, int nblocks);
+extern sgx_status_t vofile_read_bucket(char *page, const char *filename, int blkno, int nblocks);
+extern char *vofile_write_page(const char *filename, int blkno);
+extern void vofile_flush(void);
+extern void vofile_set_ring(void *ring);
+extern void vofile_thread_close(void);
+extern void vofile_close(void);
+
+#endif							/* SOE_VOFILE_H */
@@ -0,0 +1,37 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_arena.h
+ *	  Bump-pointer arenas for the temporaries of the requests.
+ *
+ * An arena hands out memory from chunks obtained with malloc and releases
+ * it all at once with arena_reset, which keeps the chunks for the next
+ * allocations. Each thread has a request arena for the memory that is not
+ * used after the ECALL that allocates it, reset by soe.c when the ECALL
+ * releases its relation. The state of an index scan outlives the ECALL and
+ * is allocated on the scan arena of its session instead.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_ARENA_H
+#define SOE_ARENA_H
+
+#include "soe_c.h"
+
+/* Size of the chunks of an arena, larger allocations get their own chunk */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct SOEArenaData *SOEArena;
+
+extern SOEArena arena_create(void);
+extern void *arena_alloc(SOEArena arena, Size size);
+extern void arena_reset(SOEArena arena);
+extern void arena_destroy(SOEArena arena);
+
+/* Request arena of the calling thread */
+extern void *request_alloc(Size size);
+extern void request_reset(void);
+
+#endif							/* SOE_ARENA_H */
@@ -0,0 +1,69 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_counters.h
+ *	  Updates of the runtime counters of soe_stats.h.
+ *
+ * COUNTERS_ADD adds to a counter of the totals, and of the relation and the
+ * ECALL that run on the calling thread, which soe.c sets with
+ * counters_set_relation and COUNTERS_ECALL. The counters are updated with
+ * relaxed atomics, so the threads of different relations do not contend on
+ * a lock.
+ *
+ * The stash of each ORAM is followed from the blocks that its oblivious
+ * file reads and writes: counters_oram_create makes the tracker of the
+ * ORAM, kept on its ORAMFileData, and the oblivious files report its real
+ * blocks with counters_block_read and counters_block_written.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_COUNTERS_H
+#define SOE_COUNTERS_H
+
+#include "soe_c.h"
+#include "soe_stats.h"
+#include "storage/soe_block.h"
+
+extern SOEStats counters_total;
+extern SOEStats counters_ecalls[SOE_STATS_NECALLS];
+extern __thread SOEStats *counters_relation;
+extern __thread SOEStats *counters_ecall;
+
+#define COUNTERS_ADD(field, n) \
+	do { \
+		__atomic_add_fetch(&counters_total.field, (n), __ATOMIC_RELAXED); \
+		if (counters_relation != NULL) \
+			__atomic_add_fetch(&counters_relation->field, (n), __ATOMIC_RELAXED); \
+		if (counters_ecall != NULL) \
+			__atomic_add_fetch(&counters_ecall->field, (n), __ATOMIC_RELAXED); \
+	} while (0)
+
+#define COUNTERS_INC(field) COUNTERS_ADD(field, 1)
+
+/*
+ * Counts a call of ecall and charges the counters updated by the calling
+ * thread to it, until counters_set_relation(NULL) ends the ECALL.
+ */
+#define COUNTERS_ECALL(ecall) \
+	do { \
+		counters_ecall = &counters_ecalls[(ecall)]; \
+		COUNTERS_INC(ecalls[(ecall)]); \
+	} while (0)
+
+extern void counters_set_relation(SOEStats * stats);
+extern void counters_reset(SOEStats * stats);
+extern void counters_copy(SOEStats * dest, const SOEStats * stats);
+
+/* TSC cycles for cryptoCycles, or 0 where they are not measured. */
+extern uint64 counters_cycles(void);
+
+typedef struct CountersORAM CountersORAM;
+
+extern CountersORAM *counters_oram_create(unsigned int nblocks);
+extern void counters_block_read(CountersORAM * coram, int blkno);
+extern void counters_block_written(CountersORAM * coram, int blkno);
+extern void counters_oram_close(CountersORAM * coram);
+
+#endif							/* SOE_COUNTERS_H */
@@ -0,0 +1,62 @@
+/*-------------------------------------------------------------------------
+ *
+ * soe_keycmp.h
+ *	  Comparators of the index keys by the type of the indexed column.
+ *
+ * The B+-tree scans compare their key with the key of an index tuple
+ * through the comparator of the ScanKey, picked by keycmp_lookup from the
+ * pg_attribute of the indexed column given to initSOE and initFSOE.
+ * Fixed-width types (int2, int4, int8, oid, float4, float8, date and
+ * timestamp) are stored in the index tuples as in postgres, without a
+ * varlena header, and the scan key holds their binary value. bytea keys
+ * are compared by their bytes and length. Other types keep the string
+ * comparison of bpchar keys.
+ *
+ * The abbreviated key of a value is normalized to 8 bytes that order the
+ * keys of all types as unsigned integers: a key with a smaller abbreviated
+ * key than a datum is smaller than the datum, and equal abbreviated keys
+ * tell nothing. Strings and bytea are abbreviated by width bytes after a
+ * prefix of skip bytes, which the caller checks the key against.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SOE_KEYCMP_H
+#define SOE_KEYCMP_H
+
+#include "soe_c.h"
+#include "catalog/soe_pg_attribute.h"
+
+/* pg_type OIDs of the key types with their own comparator */
+#define BYTEAOID		17
+#define INT8OID			20
+#define INT2OID			21
+#define INT4OID			23
+#define OIDOID			26
+#define FLOAT4OID		700
+#define FLOAT8OID		701
+#define BPCHAROID		1042
+#define DATEOID			1082
+#define TIMESTAMPOID	1114
+#define TIMESTAMPTZOID	1184
+
+/*
+ * Compares key, of keySize bytes, with datum, the key attribute of an index
+ * tuple. Returns <0, 0 or >0 as key is less than, equal to or greater than
+ * datum.
+ */
+typedef int32 (*SOEKeyCompare) (const char *key, int keySize, const char *datum);
+
+extern SOEKeyCompare keycmp_lookup(Form_pg_attribute att);
+extern bool keycmp_is_string(Form_pg_attribute att);
+extern unsigned int keycmp_strategy(unsigned int opoid);
+extern const char *keycmp_datum_bytes(Form_pg_attribute att, const char *datum, int *len);
+extern uint64 keycmp_abbrev_datum(Form_pg_attribute att, const char *datum,
+								  int skip, int width);
+extern int	keycmp_abbrev_key(Form_pg_attribute att, const char *key, int keySize,
+							  const char *prefix, int skip, int width,
+							  uint64 *abbrev);
+
+#endif							/* SOE_KEYCMP_H */
@@ -3,7 +3,12 @@
  * soe_pe.h
  *	  Implementation of page block encryption/decryption.
  *
- *
+ * The page cipher is selected at build time. AES-CBC with a fixed IV is
+ * used by default. With PAGE_CIPHER_CTR or PAGE_CIPHER_GCM every write of a
+ * block uses a new nonce built from a session salt, the file, the block
+ * number and the number of times the block was written. The write counters
+ * and the GCM tags are kept inside the enclave, so the pages written to the
+ * relation files keep their size.
  *
  * Copyright (c) 2018-2019, HASLab
  *
@@ -14,8 +19,52 @@
 #ifndef SOE_PE_H
 #define SOE_PE_H
 
+#if defined(PAGE_CIPHER_CTR) || defined(PAGE_CIPHER_GCM)
+#define PAGE_CIPHER_NONCE
+#endif
+
+/* Size of the IV of the CTR mode. GCM uses the first 12 bytes as nonce. */
+#define PAGE_IV_SIZE	16
+#define PAGE_NONCE_SIZE 12
+#define PAGE_TAG_SIZE	16
+
+/*
+ * Cipher state of a relation file, returned by page_cipher_open and kept
+ * by the ORAMs of the file. It is NULL when the page cipher has no state.
+ */
+typedef struct PageCipherFile PageCipherFile;
+
+PageCipherFile *page_cipher_open(const char *filename);
+
+/*
+ * The cipher key schedule is set up on the first call of each thread and
+ * reused for its following pages. page_crypto_thread_close frees the one of
+ * the calling thread and page_crypto_close frees those of all threads. The
+ * input and output pages may be the same buffer to encrypt or decrypt a
+ * page in place.
+ * blkno is the block of the page on the file.
+ */
+void		page_encryption(PageCipherFile *cfile, unsigned int blkno, unsigned char *plaintextBlock, unsigned char *ciphertextBlock);
+void		page_decryption(PageCipherFile *cfile, unsigned int blkno, unsigned char *ciphertextBlock, unsigned char *plaintextBlock);
+
+/* Encrypt or decrypt nblocks pages of the same file in a single call. */
+void		page_encryption_blocks(PageCipherFile *cfile, const unsigned int *blknos, unsigned char **plaintextBlocks, unsigned char **ciphertextBlocks, int nblocks);
+void		page_decryption_blocks(PageCipherFile *cfile, const unsigned int *blknos, unsigned char **ciphertextBlocks, unsigned char **plaintextBlocks, int nblocks);
+
+void		page_crypto_thread_close(void);
+void		page_crypto_close(void);
+
+/*
+ * Cipher primitives implemented with the crypto library of the build
+ * (soe_upe.c or soe_spe.c). A context holds the expanded key and is used by
+ * a single thread. iv is ignored in CBC mode and tag is only used in GCM
+ * mode. page_cipher_decrypt returns 0 if the page fails authentication.
+ */
+typedef struct PageCipherContext PageCipherContext;
 
-void		page_encryption(unsigned char *plaintextBlock, unsigned char *ciphertextBlock);
-void		page_decryption(unsigned char *ciphertextBlock, unsigned char *plaintextBlock);
+PageCipherContext *page_cipher_context(void);
+void		page_cipher_context_free(PageCipherContext *ctx);
+void		page_cipher_encrypt(PageCipherContext *ctx, const unsigned char *iv, unsigned char *plaintextBlock, unsigned char *ciphertextBlock, unsigned char *tag);
+int			page_cipher_decrypt(PageCipherContext *ctx, const unsigned char *iv, unsigned char *ciphertextBlock, unsigned char *plaintextBlock, const unsigned char *tag);
 
 #endif          /*SOE_PE_H*/
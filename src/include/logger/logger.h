@@ -3,6 +3,11 @@
  * logger.h
  *	  log definitions for any logging system to be integrated
  *
+ * selog only formats a message if its level is at least the compile-time
+ * floor SELOG_MIN_LEVEL and the runtime level set with selog_set_level.
+ * The level of a call is a constant, so the calls below the floor are
+ * removed by the compiler. The messages are buffered in the enclave and
+ * sent to the host in batches, see logger.c.
  *
  * Copyright (c) 2018-2019, HASLab
  *
@@ -44,6 +49,25 @@
 #define ERROR		20			/* user error - abort transaction; return to
 								 * known state */
 
-void		selog(int level, const char *message,...);
+/* Lowest level compiled in, set with LOG_MIN_LEVEL on the Makefile. */
+#ifndef SELOG_MIN_LEVEL
+#define SELOG_MIN_LEVEL DEBUG5
+#endif
+
+/* Lowest level logged, never below SELOG_MIN_LEVEL. */
+extern int	selog_level;
+
+#define selog_enabled(level) \
+	((level) >= SELOG_MIN_LEVEL && (level) >= selog_level)
+
+#define selog(level, ...) \
+	do { \
+		if (selog_enabled(level)) \
+			selog_write((level), __VA_ARGS__); \
+	} while (0)
+
+extern void selog_write(int level, const char *message,...);
+extern void selog_set_level(int level);
+extern void selog_flush(void);
 
 #endif              /* SOE_LOGGER_H */
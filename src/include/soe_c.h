@@ -882,6 +882,15 @@ typedef uint16 StrategyNumber;
 
 #define BATCH_SIZE 1000
 
+/*
+ * Enclave memory used to keep the upper levels of each index, which every
+ * lookup reads, out of the ORAM. The levels are cached from the root down
+ * while they fit. 0 disables the cache.
+ */
+#ifndef INDEX_CACHE_SIZE
+#define INDEX_CACHE_SIZE (4 * 1024 * 1024)
+#endif
+
 /* ----------------
  *		Variable-length datatypes all share the 'struct varlena' header.
  *
@@ -902,6 +911,9 @@ struct varlena
 	char		vl_dat[FLEXIBLE_ARRAY_MEMBER];	/* Data content is here */
 };
 
+/* Header size of a 4-byte varlena, used by the VARSIZE macros above. */
+#define VARHDRSZ		((int32) sizeof(int32))
+
 
 typedef struct varlena BpChar;	/* blank-padded char, ie SQL char(n) */
 
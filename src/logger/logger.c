@@ -1,5 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * logger.c
+ *	  Buffered log of the SOE.
+ *
+ * Messages are formatted in an enclave buffer, one per line, and sent to
+ * the host with a single oc_logger OCALL when the buffer is full, when an
+ * ERROR is logged, and on selog_flush, which is called when a relation or
+ * the SOE is closed. Messages still buffered when the enclave is destroyed
+ * without closeSoe are lost.
+ *
+ * Copyright (c) 2018-2019, HASLab
+ *
+ * IDENTIFICATION
+ *        logger/logger.c
+ *
+ *-------------------------------------------------------------------------
+ */
 
 #include "logger/logger.h"
+#include "storage/soe_lock.h"
 
 #ifdef UNSAFE
 #include "Enclave_dt.h"
@@ -13,49 +32,110 @@
 #include <stdarg.h>
 #include <oram/logger.h>
 
+/* Size of the log buffer, a multiple of the largest message. */
+#define SELOG_BUFFER_SIZE (BUFSIZE * 32)
 
+int			selog_level = SELOG_MIN_LEVEL;
+
+static char log_buffer[SELOG_BUFFER_SIZE];
+static int	log_used = 0;
+static SOEMutex log_lock = SOE_MUTEX_INITIALIZER;
+
+/* Sends the buffered lines to the host. The caller holds log_lock. */
+static void
+selog_send(void)
+{
+	if (log_used == 0)
+	{
+		return;
+	}
+
+	/* The last newline ends the string of the OCALL. */
+	log_buffer[log_used - 1] = '\0';
+	oc_logger(log_buffer);
+	log_used = 0;
+}
+
+static void
+selog_vwrite(int level, const char *message, va_list ap)
+{
+	int			written;
+
+	soe_mutex_lock(&log_lock);
+
+	if (SELOG_BUFFER_SIZE - log_used < BUFSIZE)
+	{
+		selog_send();
+	}
+
+	/* Messages longer than BUFSIZE are truncated. */
+	written = vsnprintf(log_buffer + log_used, BUFSIZE, message, ap);
+	if (written < 0)
+	{
+		written = 0;
+	}
+	else if (written >= BUFSIZE)
+	{
+		written = BUFSIZE - 1;
+	}
+
+	/* Some messages end with their own newline. */
+	if (written > 0 && log_buffer[log_used + written - 1] == '\n')
+	{
+		written--;
+	}
+	log_buffer[log_used + written] = '\n';
+	log_used += written + 1;
+
+	if (level >= ERROR)
+	{
+		selog_send();
+	}
+
+	soe_mutex_unlock(&log_lock);
+}
+
+/* Log function of liboram, under the same levels as selog. */
 void
 logger(int level, const char *message,...)
 {
-	/* char* buf = (char*) malloc(sizeof(char)*BUFSIZE); */
-	char		buf[BUFSIZE];
-
-	memset(buf, 0, BUFSIZE);
-	/* int written = 0; */
-	/* int result; */
 	va_list		ap;
 
-	va_start(ap, message);
-
-	/*
-	 * written = vsnprintf(buf, BUFSIZE, message, ap); if(written < BUFSIZE){
-	 * buf = realloc(buf, sizeof(char)*written); memset(buf, 0, written); }
-	 */
+	if (!selog_enabled(level))
+	{
+		return;
+	}
 
-	vsnprintf(buf, BUFSIZE, message, ap);
+	va_start(ap, message);
+	selog_vwrite(level, message, ap);
 	va_end(ap);
-	oc_logger(buf);
 }
 
+/* Logs a message that passed the level check of selog. */
 void
-selog(int level, const char *message,...)
+selog_write(int level, const char *message,...)
 {
-	/* char* buf = (char*) malloc(sizeof(char)*BUFSIZE); */
-	char		buf[BUFSIZE];
-
-	memset(buf, 0, BUFSIZE);
-	/* int written = 0; */
-	/* int result; */
 	va_list		ap;
 
 	va_start(ap, message);
+	selog_vwrite(level, message, ap);
+	va_end(ap);
+}
 
-	/*
-	 * written = vsnprintf(buf, BUFSIZE, message, ap); if(written < BUFSIZE){
-	 * buf = realloc(buf, sizeof(char)*written); memset(buf, 0, written); }
-	 */
+/*
+ * Sets the lowest level logged. Levels under SELOG_MIN_LEVEL are not
+ * compiled in and stay disabled.
+ */
+void
+selog_set_level(int level)
+{
+	selog_level = level;
+}
 
-	vsnprintf(buf, BUFSIZE, message, ap);
-	va_end(ap);
-	oc_logger(buf);
+void
+selog_flush(void)
+{
+	soe_mutex_lock(&log_lock);
+	selog_send();
+	soe_mutex_unlock(&log_lock);
 }